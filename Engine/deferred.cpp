@@ -0,0 +1,670 @@
+#include "deferred.h"
+#include <array>
+#include <iostream>
+
+using namespace std;
+
+enum
+{
+	DEFERRED_INSTANCE_BINDING,
+	DEFERRED_TRANSFORM_BINDING,
+	DEFERRED_POINT_LIGHT_BINDING,
+	DEFERRED_DIR_LIGHT_BINDING,
+	DEFERRED_CAMERA_BINDING,
+	DEFERRED_ALBEDO_BINDING,
+	DEFERRED_NORMAL_BINDING,
+	DEFERRED_DEPTH_BINDING,
+	DEFERRED_RESULT_BINDING,
+	DEFERRED_LIGHT_OVERFLOW_BINDING,
+	DEFERRED_FEEDBACK_BINDING,
+	DEFERRED_TEXTURE_SLOT_BINDING,
+	DEFERRED_TEXTURE_BINDING // variable count, must stay last
+};
+
+// workgroup size of the lighting pass, one tile per workgroup
+static const uint32_t TILE_SIZE = 16;
+
+// lights a tile can hold, must match deferred_lighting.comp
+static const uint32_t MAX_TILE_LIGHTS = 256;
+
+Deferred::Deferred(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources)
+{
+	this->device = device;
+	this->swapchain = swapchain;
+	this->resources = resources;
+
+	// lights the lighting pass had no room for, summed over its tiles
+	lightOverflowBuffer = new UnkBuffer
+	(
+		device,
+		sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
+	);
+	*static_cast<uint32_t*>(lightOverflowBuffer->base.pMappedData) = 0;
+
+	createImages();
+	createDescriptorSets();
+	createRenderPass();
+	createPipeline();
+	createFramebuffer();
+
+	resolver = new Resolver(device, swapchain, resultImage);
+}
+
+/*
+* G-buffer targets are only ever read with texelFetch, the shared sampler is attached for the descriptor
+* Their layouts are set by the render pass each frame
+*/
+void Deferred::createImages()
+{
+	albedoImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true
+	);
+	albedoImage->sampler = &resources->sampler;
+
+	normalImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R16G16_SNORM,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true
+	);
+	normalImage->sampler = &resources->sampler;
+
+	depthImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		findDepthFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT),
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true,
+		VK_IMAGE_ASPECT_DEPTH_BIT
+	);
+	depthImage->sampler = &resources->sampler;
+
+	// hdr radiance, tonemapped and converted to the swapchain format by the resolver
+	resultImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		true
+	);
+	resultImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void Deferred::destroyImages()
+{
+	delete albedoImage;
+	delete normalImage;
+	delete depthImage;
+	delete resultImage;
+
+	albedoImage = nullptr;
+	normalImage = nullptr;
+	depthImage = nullptr;
+	resultImage = nullptr;
+}
+
+void Deferred::createDescriptorSets()
+{
+	uint32_t textureCount = resources->textures->capacity;
+
+	vector<VkDescriptorSetLayoutBinding> bindings;
+	vector<VkDescriptorBindingFlags> flags;
+
+	auto add = [&](UnkDescriptor* descriptor)
+		{
+			descriptors.push_back(descriptor);
+			bindings.push_back(descriptor->getLayoutBinding());
+			flags.push_back(descriptor->bindingFlags);
+		};
+
+	add(new UnkBufferDescriptor(resources->instanceBuffer, &descriptorSet, DEFERRED_INSTANCE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0));
+	add(new UnkBufferDescriptor(resources->transformBuffer, &descriptorSet, DEFERRED_TRANSFORM_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0));
+	add(new UnkBufferDescriptor(resources->pointLightBuffer, &descriptorSet, DEFERRED_POINT_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->dirLightBuffer, &descriptorSet, DEFERRED_DIR_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->cameraBuffer, &descriptorSet, DEFERRED_CAMERA_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	vector<UnkImage*> albedoImages{ albedoImage };
+	add(new UnkImageDescriptor(albedoImages, &descriptorSet, DEFERRED_ALBEDO_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+	vector<UnkImage*> normalImages{ normalImage };
+	add(new UnkImageDescriptor(normalImages, &descriptorSet, DEFERRED_NORMAL_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+	vector<UnkImage*> depthImages{ depthImage };
+	add(new UnkImageDescriptor(depthImages, &descriptorSet, DEFERRED_DEPTH_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+
+	vector<UnkImage*> resultImages{ resultImage };
+	add(new UnkImageDescriptor(resultImages, &descriptorSet, DEFERRED_RESULT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+
+	add(new UnkBufferDescriptor(lightOverflowBuffer, &descriptorSet, DEFERRED_LIGHT_OVERFLOW_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	add(new UnkBufferDescriptor(resources->textureFeedbackBuffer, &descriptorSet, DEFERRED_FEEDBACK_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0));
+
+	add(new UnkBufferDescriptor(resources->textures->slotBuffer, &descriptorSet, DEFERRED_TEXTURE_SLOT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0));
+
+	// the array itself is written slot by slot by the registry once the set is allocated
+	bindings.push_back(resources->textures->getLayoutBinding(DEFERRED_TEXTURE_BINDING, VK_SHADER_STAGE_FRAGMENT_BIT));
+	flags.push_back(resources->textures->getBindingFlags());
+
+	const size_t n = bindings.size();
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+		.bindingCount = static_cast<uint32_t>(n),
+		.pBindingFlags = flags.data(),
+	};
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = &bindingFlags,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+		.bindingCount = static_cast<uint32_t>(bindings.size()),
+		.pBindings = bindings.data()
+	};
+	VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+
+	vector<VkDescriptorPoolSize> poolSizes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		VkDescriptorPoolSize poolSize
+		{
+			.type = descriptors[i]->descriptorType,
+			.descriptorCount = descriptors[i]->count
+		};
+		poolSizes.push_back(poolSize);
+	}
+	poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = textureCount });
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+		.maxSets = 1,
+		.poolSizeCount = static_cast<uint32_t>(n),
+		.pPoolSizes = poolSizes.data(),
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	uint32_t counts[] = { textureCount };
+	VkDescriptorSetVariableDescriptorCountAllocateInfo varCount
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+		.descriptorSetCount = 1,
+		.pDescriptorCounts = counts
+	};
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = &varCount,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &descriptorSetLayout
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, &descriptorSet));
+
+	// link descriptors to buffer and image handles
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+
+	resources->textures->addSet(descriptorSet, DEFERRED_TEXTURE_BINDING);
+}
+
+void Deferred::createRenderPass()
+{
+	VkAttachmentDescription albedoAttachment
+	{
+		.format = albedoImage->format,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	};
+
+	VkAttachmentDescription normalAttachment = albedoAttachment;
+	normalAttachment.format = normalImage->format;
+
+	// kept for the lighting pass, it replaces a position target
+	VkAttachmentDescription depthAttachment
+	{
+		.format = depthImage->format,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+	};
+
+	array<VkAttachmentReference, 2> colorRefs
+	{{
+		{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+		{ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }
+	}};
+	VkAttachmentReference depthRef = { 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass
+	{
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size()),
+		.pColorAttachments = colorRefs.data(),
+		.pDepthStencilAttachment = &depthRef
+	};
+
+	array<VkSubpassDependency, 2> dependencies{};
+
+	// the last frame's lighting pass reads the targets cleared here
+	dependencies[0] =
+	{
+		.srcSubpass = VK_SUBPASS_EXTERNAL,
+		.dstSubpass = 0,
+		.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+	};
+
+	dependencies[1] =
+	{
+		.srcSubpass = 0,
+		.dstSubpass = VK_SUBPASS_EXTERNAL,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+
+	array<VkAttachmentDescription, 3> attachments = { albedoAttachment, normalAttachment, depthAttachment };
+	VkRenderPassCreateInfo renderPassInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = static_cast<uint32_t>(attachments.size()),
+		.pAttachments = attachments.data(),
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = static_cast<uint32_t>(dependencies.size()),
+		.pDependencies = dependencies.data()
+	};
+
+	VK_CHECK(vkCreateRenderPass(device->device, &renderPassInfo, nullptr, &renderPass));
+}
+
+void Deferred::createPipeline()
+{
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+	};
+
+	// positions and shading attributes are separate streams
+	array<VkVertexInputBindingDescription, 2> bindingDescriptions
+	{
+		{{.binding = 0, .stride = sizeof(vec3), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+		{.binding = 1, .stride = sizeof(VertexAttributes), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX}}
+	};
+
+	array<VkVertexInputAttributeDescription, 3> attributeDescriptions
+	{
+		{{.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = 0},
+		{.location = 1, .binding = 1, .format = VK_FORMAT_R16G16_SNORM, .offset = offsetof(VertexAttributes, normal)},
+		{.location = 2, .binding = 1, .format = VK_FORMAT_R16G16_SFLOAT, .offset = offsetof(VertexAttributes, texCoord)}},
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertexInput
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size()),
+		.pVertexBindingDescriptions = bindingDescriptions.data(),
+		.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
+		.pVertexAttributeDescriptions = attributeDescriptions.data()
+	};
+
+	// both passes share the layout, the lighting pass takes the light counts
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PushConstants)
+	};
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	VkPipelineRasterizationStateCreateInfo rasterizer
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.cullMode = VK_CULL_MODE_NONE,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.depthBiasEnable = VK_FALSE,
+		.lineWidth = 1.0f,
+	};
+
+	array<VkPipelineColorBlendAttachmentState, 2> blendAttachments{};
+	blendAttachments[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	blendAttachments[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blend
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = static_cast<uint32_t>(blendAttachments.size()),
+		.pAttachments = blendAttachments.data()
+	};
+
+	VkPipelineViewportStateCreateInfo viewport
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = VK_TRUE,
+		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.minDepthBounds = 0.0f,
+		.maxDepthBounds = 1.0f
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisample
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+	};
+
+	array<VkDynamicState, 2> dynamics{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamic
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = static_cast<uint32_t>(dynamics.size()),
+		.pDynamicStates = dynamics.data()
+	};
+
+	array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+
+	// the forward vertex shader already outputs everything the G-buffer needs
+	shaderStages[0] =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = loadShaderModule("shaders/vert.spv"),
+		.pName = "main"
+	};
+
+	shaderStages[1] =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = loadShaderModule(device->fragmentStoresAndAtomics ? "shaders/gbuffer_frag.spv" : "shaders/gbuffer_frag_nofeedback.spv"),
+		.pName = "main"
+	};
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = static_cast<uint32_t>(shaderStages.size()),
+		.pStages = shaderStages.data(),
+		.pVertexInputState = &vertexInput,
+		.pInputAssemblyState = &inputAssembly,
+		.pViewportState = &viewport,
+		.pRasterizationState = &rasterizer,
+		.pMultisampleState = &multisample,
+		.pDepthStencilState = &depthStencil,
+		.pColorBlendState = &blend,
+		.pDynamicState = &dynamic,
+		.layout = pipelineLayout,
+		.renderPass = renderPass
+	};
+
+	VK_CHECK(vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+	vkDestroyShaderModule(device->device, shaderStages[0].module, nullptr);
+	vkDestroyShaderModule(device->device, shaderStages[1].module, nullptr);
+
+	VkShaderModule lightingModule = loadShaderModule("shaders/deferred_lighting.spv");
+
+	VkComputePipelineCreateInfo lightingPipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = lightingModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &lightingPipelineCreateInfo, nullptr, &lightingPipeline));
+
+	vkDestroyShaderModule(device->device, lightingModule, nullptr);
+}
+
+void Deferred::createFramebuffer()
+{
+	array<VkImageView, 3> attachments =
+	{
+		albedoImage->view,
+		normalImage->view,
+		depthImage->view
+	};
+
+	VkFramebufferCreateInfo framebufferInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = renderPass,
+		.attachmentCount = static_cast<uint32_t>(attachments.size()),
+		.pAttachments = attachments.data(),
+		.width = swapchain->extent.width,
+		.height = swapchain->extent.height,
+		.layers = 1
+	};
+
+	VK_CHECK(vkCreateFramebuffer(device->device, &framebufferInfo, nullptr, &framebuffer));
+}
+
+void Deferred::handleResize()
+{
+	vkDestroyFramebuffer(device->device, framebuffer, nullptr);
+	destroyImages();
+
+	createImages();
+	createFramebuffer();
+
+	vector<VkWriteDescriptorSet> descriptorWrites;
+	UnkImage* images[] = { albedoImage, normalImage, depthImage, resultImage };
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		UnkImageDescriptor* descriptor = static_cast<UnkImageDescriptor*>(descriptors[DEFERRED_ALBEDO_BINDING + i]);
+		descriptor->images = { images[i] };
+		descriptorWrites.push_back(descriptor->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+	resolver->handleResize(resultImage);
+}
+
+/*
+* Reports when tiles dropped more lights than ever before, frames in flight may still add to the count as it is cleared
+*/
+void Deferred::reportLightOverflow()
+{
+	uint32_t* overflow = static_cast<uint32_t*>(lightOverflowBuffer->base.pMappedData);
+	uint32_t dropped = *overflow;
+	*overflow = 0;
+
+	if (dropped <= maxDroppedLights) return;
+
+	maxDroppedLights = dropped;
+	cout << "deferred: " << dropped << " point lights dropped from tiles over the " << MAX_TILE_LIGHTS << " light limit\n";
+}
+
+void Deferred::draw(uint32_t index)
+{
+	reportLightOverflow();
+
+	UnkCommandBuffer* commandBuffer = swapchain->frames[index].commandBuffer;
+	commandBuffer->beginCommand();
+
+	resources->textures->recordSlots(commandBuffer);
+	recordLods(commandBuffer, index);
+
+	array<VkClearValue, 3> clearValues{};
+	clearValues[0].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+	clearValues[1].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+	clearValues[2].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassBegin
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = renderPass,
+		.framebuffer = framebuffer,
+		.renderArea =
+		{
+			.extent = swapchain->extent
+		},
+		.clearValueCount = static_cast<uint32_t>(clearValues.size()),
+		.pClearValues = clearValues.data()
+	};
+
+	vkCmdBeginRenderPass(commandBuffer->handle, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	VkViewport viewport
+	{
+		.width = static_cast<float>(swapchain->extent.width),
+		.height = static_cast<float>(swapchain->extent.height),
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f
+	};
+	vkCmdSetViewport(commandBuffer->handle, 0, 1, &viewport);
+
+	VkRect2D scissor
+	{
+		.extent = swapchain->extent
+	};
+	vkCmdSetScissor(commandBuffer->handle, 0, 1, &scissor);
+
+	array<VkBuffer, 2> vertexBuffers{ resources->positionBuffer->handle, resources->attributeBuffer->handle };
+	array<VkDeviceSize, 2> offsets{};
+
+	vkCmdBindVertexBuffers(commandBuffer->handle, 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+	// culling does not change between groups here, only the index pool does
+	for (const DrawGroup& group : resources->drawGroups)
+	{
+		vkCmdBindIndexBuffer(commandBuffer->handle, resources->getIndexBuffer(group.indexType)->handle, 0, group.indexType);
+		vkCmdDrawIndexedIndirect
+		(
+			commandBuffer->handle,
+			resources->drawCommandBuffer->handle,
+			group.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+			group.drawCount,
+			sizeof(VkDrawIndexedIndirectCommand)
+		);
+	}
+
+	vkCmdEndRenderPass(commandBuffer->handle);
+
+	// one workgroup per tile, lights are culled in shared memory
+	PushConstants constants
+	{
+		.pointLightCount = static_cast<uint32_t>(resources->pointLights.size()),
+		.dirLightCount = static_cast<uint32_t>(resources->dirLights.size())
+	};
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, lightingPipeline);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &constants);
+	vkCmdDispatch(commandBuffer->handle, (swapchain->extent.width + TILE_SIZE - 1) / TILE_SIZE, (swapchain->extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+	resolver->record(commandBuffer, index, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, swapchain->extent);
+
+	commandBuffer->endCommand(false);
+
+	if (swapchain->frames[index].swapchainReleaseSemaphore == VK_NULL_HANDLE)
+	{
+		VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &swapchain->frames[index].swapchainReleaseSemaphore);
+	}
+
+	VkPipelineStageFlags waitStage = resolver->getWaitStage();
+
+	VkSubmitInfo info
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &swapchain->frames[index].swapchainAcquireSemaphore,
+		.pWaitDstStageMask = &waitStage,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer->handle,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &swapchain->frames[index].swapchainReleaseSemaphore
+	};
+	vkQueueSubmit(device->getQueue(device->queues.graphics), 1, &info, swapchain->frames[index].queueSubmitFence);
+}
+
+Deferred::~Deferred()
+{
+	delete resolver;
+	delete lightOverflowBuffer;
+
+	if (framebuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyFramebuffer(device->device, framebuffer, nullptr);
+	}
+
+	destroyImages();
+
+	if (lightingPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, lightingPipeline, nullptr);
+	}
+
+	if (renderPass != VK_NULL_HANDLE)
+	{
+		vkDestroyRenderPass(device->device, renderPass, nullptr);
+	}
+}
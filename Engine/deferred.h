@@ -0,0 +1,49 @@
+#pragma once
+#include "pipeline.h"
+#include "resolver.h"
+
+/*
+* Writes a compact G-buffer (albedo, octahedral normal and the depth attachment) then lights it in compute
+* Point lights are culled per 16x16 tile against the tile's depth bounds, so each pixel only loops over nearby lights
+*/
+class Deferred : public Pipeline
+{
+public:
+	VkRenderPass renderPass{ VK_NULL_HANDLE };
+	VkFramebuffer framebuffer{ VK_NULL_HANDLE };
+
+	UnkImage* albedoImage = nullptr; // rgba8
+	UnkImage* normalImage = nullptr; // rg16 snorm, octahedral
+	UnkImage* depthImage = nullptr;
+	UnkImage* resultImage = nullptr;
+	Resolver* resolver = nullptr;
+
+	VkPipeline lightingPipeline = VK_NULL_HANDLE;
+
+	UnkBuffer* lightOverflowBuffer = nullptr; // host visible, lights dropped by full tiles
+	uint32_t maxDroppedLights = 0; // most dropped in a frame so far, only growth is reported
+
+	Deferred() = default;
+
+	Deferred(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources);
+
+	~Deferred() override;
+
+	void createImages();
+
+	void destroyImages();
+
+	void createRenderPass();
+
+	void createPipeline();
+
+	void createDescriptorSets();
+
+	void createFramebuffer();
+
+	void handleResize();
+
+	void reportLightOverflow();
+
+	void draw(uint32_t imageIndex);
+};
@@ -0,0 +1,383 @@
+#include "denoiser.h"
+#include "pipeline.h"
+
+using namespace std;
+
+enum
+{
+	DENOISE_CAMERA_BINDING,
+	DENOISE_INPUT_BINDING,
+	DENOISE_OUTPUT_BINDING,
+	DENOISE_GBUFFER_BINDING,
+	DENOISE_PREVIOUS_GBUFFER_BINDING,
+	DENOISE_PREVIOUS_HISTORY_BINDING
+};
+
+Denoiser::Denoiser(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, UnkImage* target)
+{
+	this->device = device;
+	this->swapchain = swapchain;
+	this->resources = resources;
+	this->target = target;
+
+	constants =
+	{
+		.sigmaLuminance = 4.0f,
+		.sigmaNormal = 128.0f,
+		.sigmaDepth = 0.05f
+	};
+
+	createImages();
+	createDescriptorSets();
+	createPipeline();
+}
+
+void Denoiser::createImages()
+{
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		// world normal and hit distance, negative distance marks a miss
+		gbuffer[i] = new UnkImage
+		(
+			device,
+			swapchain->extent.width,
+			swapchain->extent.height,
+			VK_FORMAT_R32G32B32A32_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT,
+			true
+		);
+		gbuffer[i]->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+		// filtered color and history length
+		history[i] = new UnkImage
+		(
+			device,
+			swapchain->extent.width,
+			swapchain->extent.height,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT,
+			true
+		);
+		history[i]->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+		scratch[i] = new UnkImage
+		(
+			device,
+			swapchain->extent.width,
+			swapchain->extent.height,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT,
+			true
+		);
+		scratch[i]->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	reset();
+}
+
+void Denoiser::destroyImages()
+{
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		delete gbuffer[i];
+		delete history[i];
+		delete scratch[i];
+
+		gbuffer[i] = nullptr;
+		history[i] = nullptr;
+		scratch[i] = nullptr;
+	}
+}
+
+void Denoiser::createDescriptorSets()
+{
+	vector<VkDescriptorSetLayoutBinding> bindings;
+
+	// binding layout
+	{
+		VkDescriptorSetLayoutBinding cameraBinding
+		{
+			.binding = DENOISE_CAMERA_BINDING,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+		};
+		bindings.push_back(cameraBinding);
+
+		for (uint32_t binding = DENOISE_INPUT_BINDING; binding <= DENOISE_PREVIOUS_HISTORY_BINDING; binding++)
+		{
+			VkDescriptorSetLayoutBinding imageBinding
+			{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			};
+			bindings.push_back(imageBinding);
+		}
+	}
+
+	if (descriptorSetLayout == VK_NULL_HANDLE)
+	{
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()
+		};
+		VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+	}
+
+	// a temporal set and an a-trous set per iteration for both frame parities
+	const uint32_t setCount = 2 * (1 + ITERATIONS);
+
+	vector<VkDescriptorPoolSize> poolSizes
+	{
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5 * setCount }
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = setCount,
+		.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+		.pPoolSizes = poolSizes.data(),
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout);
+	vector<VkDescriptorSet> sets(setCount);
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = setCount,
+		.pSetLayouts = layouts.data()
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, sets.data()));
+
+	for (uint32_t p = 0; p < 2; p++)
+	{
+		temporalSets[p] = sets[p * (1 + ITERATIONS)];
+		writeDescriptorSet(&temporalSets[p], p, target, history[p]);
+
+		for (uint32_t i = 0; i < ITERATIONS; i++)
+		{
+			// history -> scratch ping-pong -> target
+			UnkImage* input = i == 0 ? history[p] : scratch[(i - 1) % 2];
+			UnkImage* output = i == ITERATIONS - 1 ? target : scratch[i % 2];
+
+			atrousSets[p][i] = sets[p * (1 + ITERATIONS) + 1 + i];
+			writeDescriptorSet(&atrousSets[p][i], p, input, output);
+		}
+	}
+
+	// link descriptors to buffer and image handles
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+}
+
+/*
+* Creates the descriptors of one set for frames where gbuffer[p] and history[p] are current
+*/
+void Denoiser::writeDescriptorSet(VkDescriptorSet* descriptorSet, uint32_t p, UnkImage* input, UnkImage* output)
+{
+	descriptors.push_back(new UnkBufferDescriptor
+	(
+		resources->cameraBuffer,
+		descriptorSet,
+		DENOISE_CAMERA_BINDING,
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		1,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0
+	));
+
+	vector<UnkImage*> images[] = { { input }, { output }, { gbuffer[p] }, { gbuffer[1 - p] }, { history[1 - p] } };
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		descriptors.push_back(new UnkImageDescriptor
+		(
+			images[i],
+			descriptorSet,
+			DENOISE_INPUT_BINDING + i,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			VK_IMAGE_LAYOUT_GENERAL
+		));
+	}
+}
+
+void Denoiser::destroyDescriptorSets()
+{
+	if (descriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(device->device, descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+	}
+
+	for (auto& descriptor : descriptors)
+	{
+		delete descriptor;
+	}
+	descriptors.clear();
+}
+
+void Denoiser::createPipeline()
+{
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(DenoisePushConstants)
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	temporalPipeline = createComputePipeline("shaders/denoise_temporal.spv");
+	atrousPipeline = createComputePipeline("shaders/denoise_atrous.spv");
+}
+
+VkPipeline Denoiser::createComputePipeline(const char* path)
+{
+	VkShaderModule shaderModule = Pipeline::loadShaderModule(device, path);
+
+	VkComputePipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+
+	VkPipeline computePipeline;
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline));
+
+	vkDestroyShaderModule(device->device, shaderModule, nullptr);
+
+	return computePipeline;
+}
+
+void Denoiser::handleResize(UnkImage* target)
+{
+	this->target = target;
+
+	destroyDescriptorSets();
+	destroyImages();
+
+	createImages();
+	createDescriptorSets();
+}
+
+/*
+* Drops the history, e.g. when the scene changes underneath it
+*/
+void Denoiser::reset()
+{
+	resetHistory = true;
+}
+
+void Denoiser::barrier(UnkCommandBuffer* commandBuffer, VkPipelineStageFlags sourceStage)
+{
+	VkMemoryBarrier memoryBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer->handle, sourceStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/*
+* Records the denoise of the traced extent after the trace, the target holds the result once complete
+* The gbuffer written this frame is gbuffer[current]
+*/
+void Denoiser::record(UnkCommandBuffer* commandBuffer, VkExtent2D extent, uint32_t current)
+{
+	// history of a different resolution cannot be reprojected
+	if (extent.width != historyExtent.width || extent.height != historyExtent.height)
+	{
+		historyExtent = extent;
+		resetHistory = true;
+	}
+
+	constants.width = extent.width;
+	constants.height = extent.height;
+	constants.reset = resetHistory ? 1 : 0;
+
+	uint32_t groupsX = (extent.width + 7) / 8;
+	uint32_t groupsY = (extent.height + 7) / 8;
+
+	// previous frame's filter passes also write the images read here
+	barrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// temporal reprojection into history
+	constants.stepSize = 1;
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipeline);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &temporalSets[current], 0, nullptr);
+	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants), &constants);
+	vkCmdDispatch(commandBuffer->handle, groupsX, groupsY, 1);
+
+	// spatial filter with growing step size
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, atrousPipeline);
+	for (uint32_t i = 0; i < ITERATIONS; i++)
+	{
+		barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		constants.stepSize = 1 << i;
+		vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &atrousSets[current][i], 0, nullptr);
+		vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants), &constants);
+		vkCmdDispatch(commandBuffer->handle, groupsX, groupsY, 1);
+	}
+
+	resetHistory = false;
+}
+
+Denoiser::~Denoiser()
+{
+	destroyDescriptorSets();
+	destroyImages();
+
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(device->device, descriptorSetLayout, nullptr);
+	}
+
+	if (temporalPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, temporalPipeline, nullptr);
+	}
+
+	if (atrousPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, atrousPipeline, nullptr);
+	}
+
+	if (pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device->device, pipelineLayout, nullptr);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_swapchain.h"
+#include "unk_image.h"
+#include "unk_image_descriptor.h"
+#include "unk_buffer_descriptor.h"
+#include "unk_command_buffer.h"
+
+#include <vulkan/vulkan.h>
+#include "structs.h"
+#include "utils.h"
+#include <vector>
+
+using namespace std;
+
+/*
+* Spatio-temporal denoiser for low sample count ray traced output
+* Reprojects the previous frame's history using the previous camera and the guide buffer (normal, hit distance),
+* then runs edge-aware a-trous iterations, the last of which writes back into the target image
+*/
+class Denoiser
+{
+public:
+	static const uint32_t ITERATIONS = 4;
+
+	UnkDevice* device;
+	UnkSwapchain* swapchain;
+	DeviceResources* resources;
+	UnkImage* target;
+
+	UnkImage* gbuffer[2]{}; // written by the ray tracer, current and previous frame
+	UnkImage* history[2]{};
+	UnkImage* scratch[2]{};
+
+	VkExtent2D historyExtent{};
+	bool resetHistory = true;
+
+	DenoisePushConstants constants{};
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline temporalPipeline = VK_NULL_HANDLE;
+	VkPipeline atrousPipeline = VK_NULL_HANDLE;
+
+	vector<UnkDescriptor*> descriptors;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet temporalSets[2]{};
+	VkDescriptorSet atrousSets[2][ITERATIONS]{};
+
+	Denoiser(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, UnkImage* target);
+
+	~Denoiser();
+
+	void createImages();
+
+	void destroyImages();
+
+	void createDescriptorSets();
+
+	void destroyDescriptorSets();
+
+	void createPipeline();
+
+	void handleResize(UnkImage* target);
+
+	void reset();
+
+	void record(UnkCommandBuffer* commandBuffer, VkExtent2D extent, uint32_t current);
+
+private:
+	void writeDescriptorSet(VkDescriptorSet* descriptorSet, uint32_t parity, UnkImage* input, UnkImage* output);
+
+	VkPipeline createComputePipeline(const char* path);
+
+	void barrier(UnkCommandBuffer* commandBuffer, VkPipelineStageFlags sourceStage);
+};
@@ -0,0 +1,293 @@
+#include "depth_pyramid.h"
+#include "pipeline.h"
+#include <array>
+
+using namespace std;
+
+/*
+* Descriptor sets are created once the depth images exist, see setSources
+*/
+DepthPyramid::DepthPyramid(UnkDevice* device, uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	this->device = device;
+
+	createPyramid(sourceWidth, sourceHeight);
+	createDescriptorSetLayout();
+	createPipeline();
+}
+
+void DepthPyramid::createPyramid(uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	// largest powers of two that fit, every level texel then covers at most 2x2 of the source
+	width = 1;
+	while (width * 2 <= sourceWidth) width *= 2;
+
+	height = 1;
+	while (height * 2 <= sourceHeight) height *= 2;
+
+	levelCount = 0;
+	VkDeviceSize texelCount = 0;
+	for (uint32_t w = width, h = height; ; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+	{
+		texelCount += static_cast<VkDeviceSize>(w) * h;
+		levelCount++;
+
+		if (w == 1 && h == 1) break;
+	}
+
+	pyramid = new UnkBuffer
+	(
+		device,
+		texelCount * sizeof(float),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0
+	);
+
+	built = false;
+}
+
+enum
+{
+	DEPTH_BINDING,
+	PYRAMID_BINDING
+};
+
+void DepthPyramid::createDescriptorSetLayout()
+{
+	array<VkDescriptorSetLayoutBinding, 2> bindings
+	{{
+		{ .binding = DEPTH_BINDING, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+		{ .binding = PYRAMID_BINDING, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT }
+	}};
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = static_cast<uint32_t>(bindings.size()),
+		.pBindings = bindings.data()
+	};
+	VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+}
+
+void DepthPyramid::createDescriptorSets()
+{
+	const uint32_t setCount = static_cast<uint32_t>(sources.size());
+	descriptorSets.resize(setCount);
+
+	for (uint32_t i = 0; i < setCount; i++)
+	{
+		vector<UnkImage*> depthImages{ sources[i] };
+		UnkDescriptor* depthDescriptor = new UnkImageDescriptor
+		(
+			depthImages,
+			&descriptorSets[i],
+			DEPTH_BINDING,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+		);
+		descriptors.push_back(depthDescriptor);
+
+		UnkDescriptor* pyramidDescriptor = new UnkBufferDescriptor
+		(
+			pyramid,
+			&descriptorSets[i],
+			PYRAMID_BINDING,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0
+		);
+		descriptors.push_back(pyramidDescriptor);
+	}
+
+	array<VkDescriptorPoolSize, 2> poolSizes
+	{{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setCount }
+	}};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = setCount,
+		.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+		.pPoolSizes = poolSizes.data(),
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout);
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = setCount,
+		.pSetLayouts = layouts.data()
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, descriptorSets.data()));
+
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void DepthPyramid::destroyDescriptorSets()
+{
+	if (descriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(device->device, descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+	}
+
+	for (auto& descriptor : descriptors)
+	{
+		delete descriptor;
+	}
+	descriptors.clear();
+	descriptorSets.clear();
+}
+
+void DepthPyramid::createPipeline()
+{
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(DepthPyramidPushConstants)
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	VkShaderModule shaderModule = Pipeline::loadShaderModule(device, "shaders/hiz.spv");
+
+	VkComputePipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+	vkDestroyShaderModule(device->device, shaderModule, nullptr);
+}
+
+/*
+* Reads from these depth images from now on, rebuilds the per image descriptor sets
+*/
+void DepthPyramid::setSources(vector<UnkImage*>& sources)
+{
+	destroyDescriptorSets();
+
+	this->sources = sources;
+	createDescriptorSets();
+}
+
+/*
+* The depth images are recreated with the swapchain, the pyramid follows their extent
+* Sets are rebuilt by the following setSources
+*/
+void DepthPyramid::handleResize(uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	destroyDescriptorSets();
+
+	delete pyramid;
+	createPyramid(sourceWidth, sourceHeight);
+}
+
+/*
+* Culling against the pyramid is only conservative for the frame right after the one it was built from
+*/
+bool DepthPyramid::holdsFrame(uint32_t frame)
+{
+	return built && builtFrame == frame;
+}
+
+/*
+* Records the reduction of a depth image, left by its render pass in DEPTH_STENCIL_READ_ONLY_OPTIMAL, one dispatch per level
+* Task shaders of this frame have read the previous pyramid by now, the next frame's read the new one
+*/
+void DepthPyramid::record(UnkCommandBuffer* commandBuffer, uint32_t imageIndex, uint32_t frame)
+{
+	VkMemoryBarrier levelBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+
+	// execution only, the task shader reads are done before the levels are overwritten
+	vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[imageIndex], 0, nullptr);
+
+	DepthPyramidPushConstants constants
+	{
+		.sourceWidth = sources[imageIndex]->width,
+		.sourceHeight = sources[imageIndex]->height,
+		.width = width,
+		.height = height
+	};
+
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		if (level > 0)
+		{
+			vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+
+		constants.level = level;
+		vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants), &constants);
+		vkCmdDispatch(commandBuffer->handle, (levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+	}
+
+	vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+	built = true;
+	builtFrame = frame;
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	destroyDescriptorSets();
+
+	delete pyramid;
+
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(device->device, descriptorSetLayout, nullptr);
+	}
+
+	if (pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, pipeline, nullptr);
+	}
+
+	if (pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device->device, pipelineLayout, nullptr);
+	}
+}
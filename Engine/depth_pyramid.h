@@ -0,0 +1,67 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_buffer.h"
+#include "unk_buffer_descriptor.h"
+#include "unk_image.h"
+#include "unk_image_descriptor.h"
+#include "unk_command_buffer.h"
+
+#include <vulkan/vulkan.h>
+#include "structs.h"
+#include "utils.h"
+#include <vector>
+
+using namespace std;
+
+/*
+* Hierarchical depth of the last rendered frame, read by the task shader to drop meshlets behind it
+* Every level holds the farthest depth of the texels below it, level 0 is the depth image's extent rounded
+* down to powers of two so each level halves the one before exactly
+* Levels are packed one after another in a storage buffer, finest first
+*/
+class DepthPyramid
+{
+public:
+	UnkDevice* device;
+	vector<UnkImage*> sources; // depth attachments, one per swapchain image
+
+	UnkBuffer* pyramid = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t levelCount = 0;
+
+	bool built = false;
+	uint32_t builtFrame = 0; // DeviceResources::frame of the depth it holds
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	vector<UnkDescriptor*> descriptors;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	vector<VkDescriptorSet> descriptorSets; // one per source
+
+	DepthPyramid(UnkDevice* device, uint32_t sourceWidth, uint32_t sourceHeight);
+
+	~DepthPyramid();
+
+	void createPyramid(uint32_t sourceWidth, uint32_t sourceHeight);
+
+	void createDescriptorSetLayout();
+
+	void createDescriptorSets();
+
+	void destroyDescriptorSets();
+
+	void createPipeline();
+
+	void setSources(vector<UnkImage*>& sources);
+
+	void handleResize(uint32_t sourceWidth, uint32_t sourceHeight);
+
+	void record(UnkCommandBuffer* commandBuffer, uint32_t imageIndex, uint32_t frame);
+
+	bool holdsFrame(uint32_t frame);
+};
@@ -51,6 +51,19 @@ void Engine::run()
 			input->getInputBuffer()[static_cast<int>(Key::G)] = false;
 		}
 
+		// ray tracer options, they show once the ray tracer is the current pipeline
+		if (input->getInputBuffer()[static_cast<int>(Key::R)])
+		{
+			renderer->rayTracer->setRestir(!renderer->rayTracer->useRestir);
+			input->getInputBuffer()[static_cast<int>(Key::R)] = false;
+		}
+
+		if (input->getInputBuffer()[static_cast<int>(Key::N)])
+		{
+			renderer->rayTracer->setDenoise(!renderer->rayTracer->denoise);
+			input->getInputBuffer()[static_cast<int>(Key::N)] = false;
+		}
+
 		renderer->render(camera, deltaTime);
 	}
 
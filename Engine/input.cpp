@@ -12,6 +12,8 @@ void Input::keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 	if (key == GLFW_KEY_E) input->_inputBuffer[static_cast<int>(Key::E)] = action != GLFW_RELEASE;
 	if (key == GLFW_KEY_Q) input->_inputBuffer[static_cast<int>(Key::Q)] = action != GLFW_RELEASE;
 	if (key == GLFW_KEY_G) input->_inputBuffer[static_cast<int>(Key::G)] = action == GLFW_PRESS && action != GLFW_REPEAT;
+	if (key == GLFW_KEY_R) input->_inputBuffer[static_cast<int>(Key::R)] = action == GLFW_PRESS && action != GLFW_REPEAT;
+	if (key == GLFW_KEY_N) input->_inputBuffer[static_cast<int>(Key::N)] = action == GLFW_PRESS && action != GLFW_REPEAT;
 }
 
 void Input::cursorCallback(GLFWwindow* window, double xPos, double yPos)
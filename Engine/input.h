@@ -11,6 +11,8 @@ enum class Key
 	E,
 	Q,
 	G,
+	R,
+	N,
 	Count
 };
 
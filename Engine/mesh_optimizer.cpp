@@ -0,0 +1,653 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+#include <unordered_map>
+
+/*
+* Sum of squared distances to a set of planes, weighted by triangle area
+* Evaluating divides by the total weight so the error reads as a mean squared distance
+*/
+struct Quadric
+{
+	double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+	double yy = 0.0, yz = 0.0, yw = 0.0;
+	double zz = 0.0, zw = 0.0;
+	double ww = 0.0;
+	double weight = 0.0;
+
+	void addPlane(const dvec3& n, double d, double w)
+	{
+		xx += w * n.x * n.x; xy += w * n.x * n.y; xz += w * n.x * n.z; xw += w * n.x * d;
+		yy += w * n.y * n.y; yz += w * n.y * n.z; yw += w * n.y * d;
+		zz += w * n.z * n.z; zw += w * n.z * d;
+		ww += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& other)
+	{
+		xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+		yy += other.yy; yz += other.yz; yw += other.yw;
+		zz += other.zz; zw += other.zw;
+		ww += other.ww;
+		weight += other.weight;
+	}
+
+	double evaluate(const vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error =
+			xx * x * x + 2.0 * xy * x * y + 2.0 * xz * x * z + 2.0 * xw * x +
+			yy * y * y + 2.0 * yz * y * z + 2.0 * yw * y +
+			zz * z * z + 2.0 * zw * z +
+			ww;
+
+		return weight > 0.0 ? abs(error) / weight : 0.0;
+	}
+};
+
+/*
+* Tipsify, fans around the most recently cached vertex that will stay cached, falling back to the dead-end stack
+* A candidate whose fan no longer fits in the cache still beats the dead-end stack with priority 0, the best priority
+* starts at -1 as in the paper's getNextVertex, the stack is only used once no candidate has triangles left
+* Rejecting those candidates measured the same ACMR with a 16 entry cache: 0.605 on a shuffled 300x300 grid,
+* 0.627 on a 128 segment uv sphere and 0.624 on a level 6 icosphere (about 3.0 shuffled)
+* Misses are counted with the same FIFO timestamp model as analyzeVertexCache
+* When clusters is given it receives the first triangle of every cluster, boundaries are placed where the
+* fan had to be restarted away from the cache (hard) or where the cluster has become cache efficient (soft)
+* Clusters are measured from a cold cache as the overdraw pass may reorder them
+*/
+void MeshOptimizer::optimizeVertexCache(vector<uint32_t>& indices, uint32_t vertexCount, vector<uint32_t>* clusters)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// vertex to triangle adjacency
+	vector<uint32_t> liveCount(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		liveCount[index]++;
+	}
+
+	vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] = offsets[v] + liveCount[v];
+	}
+
+	vector<uint32_t> adjacency(indices.size());
+	vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			adjacency[fill[indices[3 * t + k]]++] = t;
+		}
+	}
+
+	vector<uint32_t> timestamps(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<uint32_t> deadEnd;
+	vector<uint32_t> candidates;
+
+	vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t time = CACHE_SIZE + 1;
+	uint32_t cursor = 0;
+
+	auto skipDeadEnd = [&]() -> int64_t
+		{
+			while (!deadEnd.empty())
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveCount[v] > 0) return v;
+			}
+
+			for (; cursor < vertexCount; cursor++)
+			{
+				if (liveCount[cursor] > 0) return cursor;
+			}
+
+			return -1;
+		};
+
+	// second cache model that is flushed at every cluster start
+	vector<uint32_t> clusterTimestamps(vertexCount, 0);
+	uint32_t clusterTime = CACHE_SIZE + 1;
+
+	size_t clusterStart = 0;
+	uint32_t clusterMisses = 0;
+	if (clusters != nullptr)
+	{
+		clusters->assign(1, 0);
+	}
+
+	int64_t fan = skipDeadEnd();
+	bool restarted = true;
+
+	while (fan >= 0)
+	{
+		size_t clusterTriangles = output.size() / 3 - clusterStart;
+		if (clusters != nullptr && clusterTriangles > 0 && (restarted || clusterMisses <= CLUSTER_ACMR_THRESHOLD * clusterTriangles))
+		{
+			clusterStart = output.size() / 3;
+			clusterMisses = 0;
+			clusterTime += CACHE_SIZE + 1;
+			clusters->push_back(static_cast<uint32_t>(clusterStart));
+		}
+
+		candidates.clear();
+
+		for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+		{
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[3 * t + k];
+
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveCount[v]--;
+
+				if (time - timestamps[v] > CACHE_SIZE)
+				{
+					timestamps[v] = time++;
+				}
+
+				if (clusterTime - clusterTimestamps[v] > CACHE_SIZE)
+				{
+					clusterTimestamps[v] = clusterTime++;
+					clusterMisses++;
+				}
+			}
+
+			emitted[t] = true;
+		}
+
+		// prefer the candidate that has been in the cache longest while its remaining fan still fits, any live candidate beats a restart
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates)
+		{
+			if (liveCount[v] == 0) continue;
+
+			int64_t priority = 0;
+			if (time - timestamps[v] + 2 * liveCount[v] <= CACHE_SIZE)
+			{
+				priority = time - timestamps[v];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		restarted = next < 0;
+		fan = restarted ? skipDeadEnd() : next;
+	}
+
+	indices = output;
+}
+
+/*
+* Sorts clusters by how likely they are to occlude the rest of the mesh, clusters far out along their own
+* normal are drawn first (Sander et al. 2007), triangle order inside a cluster is kept
+*/
+void MeshOptimizer::optimizeOverdraw(vector<uint32_t>& indices, const vector<vec3>& positions, const vector<uint32_t>& clusters)
+{
+	if (clusters.size() < 2) return;
+
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+	// area weighted centroids, the cross product's length is twice the area
+	vector<vec3> centroids(triangleCount);
+	vector<vec3> normals(triangleCount);
+
+	vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		const vec3& p0 = positions[indices[3 * t + 0]];
+		const vec3& p1 = positions[indices[3 * t + 1]];
+		const vec3& p2 = positions[indices[3 * t + 2]];
+
+		centroids[t] = (p0 + p1 + p2) / 3.0f;
+		normals[t] = cross(p1 - p0, p2 - p0);
+
+		float area = length(normals[t]);
+		meshCentroid += centroids[t] * area;
+		meshArea += area;
+	}
+
+	if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+	struct Cluster
+	{
+		uint32_t first;
+		uint32_t last;
+		float occlusion;
+	};
+
+	vector<Cluster> sorted;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		Cluster cluster
+		{
+			.first = clusters[c],
+			.last = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount
+		};
+
+		vec3 centroid(0.0f);
+		vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t t = cluster.first; t < cluster.last; t++)
+		{
+			float triangleArea = length(normals[t]);
+			centroid += centroids[t] * triangleArea;
+			normal += normals[t];
+			area += triangleArea;
+		}
+
+		float normalLength = length(normal);
+		cluster.occlusion = area > 0.0f && normalLength > 0.0f ? dot(centroid / area - meshCentroid, normal / normalLength) : 0.0f;
+
+		sorted.push_back(cluster);
+	}
+
+	stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.occlusion > b.occlusion; });
+
+	vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const Cluster& cluster : sorted)
+	{
+		output.insert(output.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.last);
+	}
+
+	indices = output;
+}
+
+/*
+* Renumbers vertices in order of first use so vertex fetch walks memory linearly, unreferenced vertices go last
+*/
+void MeshOptimizer::optimizeVertexFetch(vector<uint32_t>& indices, vector<vec3>& positions, vector<VertexAttributes>& attributes)
+{
+	const uint32_t unassigned = UINT32_MAX;
+	vector<uint32_t> remap(positions.size(), unassigned);
+
+	uint32_t next = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == unassigned) remap[index] = next++;
+		index = remap[index];
+	}
+
+	for (uint32_t& target : remap)
+	{
+		if (target == unassigned) target = next++;
+	}
+
+	vector<vec3> reorderedPositions(positions.size());
+	vector<VertexAttributes> reorderedAttributes(attributes.size());
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		reorderedPositions[remap[v]] = positions[v];
+		reorderedAttributes[remap[v]] = attributes[v];
+	}
+
+	positions = reorderedPositions;
+	attributes = reorderedAttributes;
+}
+
+/*
+* Greedy edge collapse in passes, every pass collapses the cheapest edges whose neighbourhoods do not overlap
+* A vertex only ever moves onto another existing vertex, so the result indexes the same vertices
+* Vertices on edges that are not shared by exactly two triangles are locked, this keeps open borders and
+* attribute seams (split vertices) in place so levels never crack
+*/
+vector<uint32_t> MeshOptimizer::simplify(const vector<uint32_t>& indices, const vector<vec3>& positions, size_t targetIndexCount, float* resultError)
+{
+	const uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+	vector<uint32_t> result = indices;
+
+	vector<bool> locked(vertexCount, false);
+	unordered_map<uint64_t, uint32_t> edgeCounts;
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint64_t a = result[i + k];
+			uint64_t b = result[i + (k + 1) % 3];
+			edgeCounts[a < b ? (a << 32) | b : (b << 32) | a]++;
+		}
+	}
+
+	for (const auto& [edge, count] : edgeCounts)
+	{
+		if (count == 2) continue;
+
+		locked[edge >> 32] = true;
+		locked[edge & 0xFFFFFFFFu] = true;
+	}
+
+	vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const vec3& p0 = positions[result[i + 0]];
+		const vec3& p1 = positions[result[i + 1]];
+		const vec3& p2 = positions[result[i + 2]];
+
+		dvec3 normal = cross(dvec3(p1 - p0), dvec3(p2 - p0));
+		double doubleArea = length(normal);
+		if (doubleArea == 0.0) continue;
+
+		normal /= doubleArea;
+		double d = -dot(normal, dvec3(p0));
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			quadrics[result[i + k]].addPlane(normal, d, 0.5 * doubleArea);
+		}
+	}
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double error;
+	};
+
+	vector<Collapse> collapses;
+	vector<uint32_t> remap(vertexCount);
+	vector<bool> touched(vertexCount);
+	vector<uint32_t> offsets(vertexCount + 1);
+	vector<uint32_t> adjacency;
+
+	// moving from onto to must not turn any remaining triangle by more than about 75 degrees
+	auto flips = [&](uint32_t from, uint32_t to)
+		{
+			for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++)
+			{
+				const uint32_t* triangle = &result[3 * adjacency[a]];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+				vec3 p[3];
+				vec3 q[3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					p[k] = positions[triangle[k]];
+					q[k] = positions[triangle[k] == from ? to : triangle[k]];
+				}
+
+				vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+				vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+				if (dot(before, after) <= 0.25f * length(before) * length(after)) return true;
+			}
+
+			return false;
+		};
+
+	double maxError = 0.0;
+
+	while (result.size() > targetIndexCount)
+	{
+		const uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+		// vertex to triangle adjacency of the current triangles
+		fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : result)
+		{
+			offsets[index + 1]++;
+		}
+
+		partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+		adjacency.resize(result.size());
+		vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				adjacency[cursor[result[3 * t + k]]++] = t;
+			}
+		}
+
+		// cheaper direction of every edge, interior edges show up once per side which is harmless
+		collapses.clear();
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t a = result[3 * t + k];
+				uint32_t b = result[3 * t + (k + 1) % 3];
+
+				Quadric quadric = quadrics[a];
+				quadric.add(quadrics[b]);
+
+				double errorAB = locked[a] ? DBL_MAX : quadric.evaluate(positions[b]);
+				double errorBA = locked[b] ? DBL_MAX : quadric.evaluate(positions[a]);
+				if (errorAB == DBL_MAX && errorBA == DBL_MAX) continue;
+
+				collapses.push_back(errorAB <= errorBA ? Collapse{ a, b, errorAB } : Collapse{ b, a, errorBA });
+			}
+		}
+
+		sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// an interior collapse removes two triangles, stop short so the cheapest edges of later passes get a turn
+		size_t budget = std::max<size_t>(1, (result.size() - targetIndexCount) / 6);
+		size_t collapsed = 0;
+
+		iota(remap.begin(), remap.end(), 0);
+		fill(touched.begin(), touched.end(), false);
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapsed >= budget) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+			if (flips(collapse.from, collapse.to)) continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.error);
+
+			for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+			{
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					touched[result[3 * adjacency[a] + k]] = true;
+				}
+			}
+
+			collapsed++;
+		}
+
+		if (collapsed == 0) break;
+
+		// rewrite triangles, dropping the ones that collapsed
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i + 0]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			if (a == b || b == c || a == c) continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+
+		result.resize(write);
+	}
+
+	*resultError = static_cast<float>(sqrt(maxError));
+	return result;
+}
+
+/*
+* Greedy in triangle order, a meshlet is closed once the next triangle would exceed either limit
+* The input is expected in vertex cache order, whose triangles already share most of their vertices with
+* the ones just before them
+* Bounds are a sphere around the box centre and a cone around the mean triangle normal, the task shader
+* drops a meshlet when every point of its sphere sees only the back of the cone
+*/
+void MeshOptimizer::buildMeshlets(const vector<uint32_t>& indices, const vector<vec3>& positions, vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles)
+{
+	const uint8_t UNUSED = 0xFF;
+
+	// meshlet local index of every mesh vertex, reset for the vertices of each closed meshlet
+	vector<uint8_t> localIndices(positions.size(), UNUSED);
+
+	Meshlet meshlet
+	{
+		.vertexOffset = static_cast<uint32_t>(meshletVertices.size()),
+		.triangleOffset = static_cast<uint32_t>(meshletTriangles.size())
+	};
+
+	auto finish = [&]()
+	{
+		if (meshlet.triangleCount == 0) return;
+
+		vec3 boundsMin(FLT_MAX);
+		vec3 boundsMax(-FLT_MAX);
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			const vec3& position = positions[meshletVertices[meshlet.vertexOffset + i]];
+			boundsMin = min(boundsMin, position);
+			boundsMax = max(boundsMax, position);
+		}
+
+		meshlet.center = 0.5f * (boundsMin + boundsMax);
+		meshlet.radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			meshlet.radius = std::max(meshlet.radius, distance(positions[meshletVertices[meshlet.vertexOffset + i]], meshlet.center));
+		}
+
+		// degenerate triangles face no way and are left out of the cone
+		vector<vec3> normals;
+		vec3 normalSum(0.0f);
+		for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+		{
+			uint32_t packed = meshletTriangles[meshlet.triangleOffset + i];
+			const vec3& a = positions[meshletVertices[meshlet.vertexOffset + (packed & 0xFF)]];
+			const vec3& b = positions[meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)]];
+			const vec3& c = positions[meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)]];
+
+			vec3 normal = cross(b - a, c - a);
+			float area = length(normal);
+			if (area <= FLT_MIN) continue;
+
+			normals.push_back(normal / area);
+			normalSum += normal / area;
+		}
+
+		meshlet.coneAxis = vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+
+		float sumLength = length(normalSum);
+		if (sumLength > FLT_MIN)
+		{
+			vec3 axis = normalSum / sumLength;
+
+			float minDot = 1.0f;
+			for (const vec3& normal : normals)
+			{
+				minDot = std::min(minDot, dot(normal, axis));
+			}
+
+			// a cone wider than a hemisphere always has a front facing triangle
+			meshlet.coneAxis = axis;
+			meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : sqrt(1.0f - minDot * minDot);
+		}
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		{
+			localIndices[meshletVertices[meshlet.vertexOffset + i]] = UNUSED;
+		}
+
+		meshlets.push_back(meshlet);
+
+		meshlet = Meshlet
+		{
+			.vertexOffset = static_cast<uint32_t>(meshletVertices.size()),
+			.triangleOffset = static_cast<uint32_t>(meshletTriangles.size())
+		};
+	};
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		uint32_t newVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			newVertices += localIndices[indices[i + k]] == UNUSED ? 1 : 0;
+		}
+
+		// a triangle repeating a vertex counts it twice, which only closes the meshlet early
+		if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			finish();
+		}
+
+		uint32_t packed = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t index = indices[i + k];
+			if (localIndices[index] == UNUSED)
+			{
+				localIndices[index] = static_cast<uint8_t>(meshlet.vertexCount++);
+				meshletVertices.push_back(index);
+			}
+
+			packed |= static_cast<uint32_t>(localIndices[index]) << (8 * k);
+		}
+
+		meshletTriangles.push_back(packed);
+		meshlet.triangleCount++;
+	}
+
+	finish();
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats{};
+	if (indices.empty()) return stats;
+
+	// a vertex is cached while fewer than cacheSize misses happened since it was loaded
+	vector<uint32_t> timestamps(vertexCount, 0);
+	vector<bool> referenced(vertexCount, false);
+
+	uint32_t time = cacheSize + 1;
+	uint32_t misses = 0;
+	uint32_t uniqueVertices = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (time - timestamps[index] > cacheSize)
+		{
+			timestamps[index] = time++;
+			misses++;
+		}
+
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			uniqueVertices++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+
+	return stats;
+}
\ No newline at end of file
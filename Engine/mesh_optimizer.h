@@ -0,0 +1,44 @@
+#pragma once
+
+#include "structs.h"
+
+#include <vector>
+
+using namespace std;
+
+// post-transform cache efficiency of an index buffer, simulated on a FIFO cache
+struct VertexCacheStats
+{
+	float acmr = 0.0f; // average cache miss ratio, misses per triangle (0.5 at best, 3 at worst)
+	float atvr = 0.0f; // average transformed vertex ratio, misses per vertex (1 at best)
+};
+
+/*
+* Import time reordering of a single mesh's triangles and vertices, indices are local to the mesh
+* Triangles are ordered with Tipsify (Sander et al. 2007) for the post-transform cache, the resulting clusters
+* are sorted to reduce overdraw independent of the view, vertices are then renumbered in order of first use
+* Levels of detail are built with quadric edge collapse onto existing vertices, so they share the mesh's vertices
+* Meshlets split the triangles into clusters small enough for one mesh shader workgroup
+*/
+class MeshOptimizer
+{
+public:
+	static const uint32_t CACHE_SIZE = 16;
+
+	// a cluster ends at a fan boundary once its own miss ratio is at or below this
+	static constexpr float CLUSTER_ACMR_THRESHOLD = 0.85f;
+
+	static void optimizeVertexCache(vector<uint32_t>& indices, uint32_t vertexCount, vector<uint32_t>* clusters = nullptr);
+
+	static void optimizeOverdraw(vector<uint32_t>& indices, const vector<vec3>& positions, const vector<uint32_t>& clusters);
+
+	static void optimizeVertexFetch(vector<uint32_t>& indices, vector<vec3>& positions, vector<VertexAttributes>& attributes);
+
+	// returns the simplified triangles and the largest collapse error as an object space distance
+	static vector<uint32_t> simplify(const vector<uint32_t>& indices, const vector<vec3>& positions, size_t targetIndexCount, float* resultError);
+
+	// appends the meshlets of the triangles to the pools, their vertex indices stay local to the mesh
+	static void buildMeshlets(const vector<uint32_t>& indices, const vector<vec3>& positions, vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles);
+
+	static VertexCacheStats analyzeVertexCache(const vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+};
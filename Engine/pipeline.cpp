@@ -1,4 +1,5 @@
 #include "pipeline.h"
+#include <array>
 #include <fstream>
 #include <stb_image.h>
 
@@ -7,7 +8,88 @@ Pipeline::Pipeline()
 
 }
 
+/*
+* Pipelines whose resources are still being built in the background report false and are skipped by the renderer
+*/
+bool Pipeline::isReady()
+{
+	return true;
+}
+
+/*
+* Pipelines that test rasterized surfaces against the acceleration structures report true, those hold the full meshes
+*/
+bool Pipeline::needsFullDetail()
+{
+	return false;
+}
+
+/*
+* Copies the draw commands and levels selectLods prepared for this frame, outside of any render pass
+* The previous frame's indirect draws and reads are ordered before the copy, this frame's after it
+*/
+void Pipeline::recordLods(UnkCommandBuffer* commandBuffer, uint32_t imageIndex)
+{
+	VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	if (device->meshShaderSupported)
+	{
+		// task shaders skip the levels an instance is not drawn with
+		readStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer->handle, readStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy drawRegion{ .size = resources->drawCommandBuffer->size };
+	vkCmdCopyBuffer(commandBuffer->handle, resources->drawCommandStaging[imageIndex]->handle, resources->drawCommandBuffer->handle, 1, &drawRegion);
+
+	VkBufferCopy lodRegion{ .size = resources->instanceLodBuffer->size };
+	vkCmdCopyBuffer(commandBuffer->handle, resources->instanceLodStaging[imageIndex]->handle, resources->instanceLodBuffer->handle, 1, &lodRegion);
+
+	array<VkBufferMemoryBarrier, 2> barriers
+	{
+		VkBufferMemoryBarrier
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = resources->drawCommandBuffer->handle,
+			.size = VK_WHOLE_SIZE
+		},
+		VkBufferMemoryBarrier
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = resources->instanceLodBuffer->handle,
+			.size = VK_WHOLE_SIZE
+		}
+	};
+
+	vkCmdPipelineBarrier
+	(
+		commandBuffer->handle,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		readStages,
+		0,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data(),
+		0, nullptr
+	);
+}
+
 VkShaderModule Pipeline::loadShaderModule(const string& path)
+{
+	return loadShaderModule(device, path);
+}
+
+/*
+* Also used by compute passes that are not pipelines themselves
+*/
+VkShaderModule Pipeline::loadShaderModule(UnkDevice* device, const string& path)
 {
 	ifstream file(path, ios::ate | ios::binary);
 
@@ -33,6 +115,25 @@ VkShaderModule Pipeline::loadShaderModule(const string& path)
 	return shaderModule;
 }
 
+VkFormat Pipeline::findDepthFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+{
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(device->gpu, format, &properties);
+		if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & features) == features)
+		{
+			return format;
+		}
+		else if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & features) == features)
+		{
+			return format;
+		}
+	}
+
+	throw runtime_error("failed to find supported depth format");
+}
+
 Pipeline::~Pipeline()
 {
 	if (descriptorPool != VK_NULL_HANDLE)
@@ -45,7 +45,17 @@ public:
 
 	virtual void draw(uint32_t imageIndex) = 0;
 
+	virtual bool isReady();
+
+	virtual bool needsFullDetail();
+
+	void recordLods(UnkCommandBuffer* commandBuffer, uint32_t imageIndex);
+
 	// utility
 
 	VkShaderModule loadShaderModule(const string& path);
+
+	static VkShaderModule loadShaderModule(UnkDevice* device, const string& path);
+
+	VkFormat findDepthFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 };
\ No newline at end of file
@@ -3,11 +3,18 @@
 
 using namespace std;
 
-Rasterizer::Rasterizer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources)
+Rasterizer::Rasterizer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, RayTracer* rayTracer)
 {
 	this->device = device;
 	this->swapchain = swapchain;
 	this->resources = resources;
+	this->rayTracer = rayTracer;
+	this->useMeshShaders = device->meshShaderSupported;
+
+	if (useMeshShaders)
+	{
+		depthPyramid = new DepthPyramid(device, swapchain->extent.width, swapchain->extent.height);
+	}
 
 	createDescriptorSets(); // must be created before pipeline creation (pipeline layout)
 
@@ -25,11 +32,28 @@ void Rasterizer::createDescriptorSets()
 		POINT_LIGHT_BINDING,
 		DIR_LIGHT_BINDING,
 		CAMERA_BINDING,
+		AS_BINDING, // hybrid mode only
+		POSITION_BINDING, // mesh shading only up to the textures
+		VERTEX_BINDING,
+		MESHLET_BINDING,
+		MESHLET_VERTEX_BINDING,
+		MESHLET_TRIANGLE_BINDING,
+		MESHLET_TASK_BINDING,
+		DEPTH_PYRAMID_BINDING,
+		INSTANCE_LOD_BINDING,
+		FEEDBACK_BINDING,
+		TEXTURE_SLOT_BINDING,
 		TEXTURE_BINDING
 	};
 
-	uint32_t rawTextureCount = static_cast<uint32_t>(resources->textureImages.size());
-	uint32_t textureCount = std::max<uint32_t>(rawTextureCount, 1);
+	// with mesh shading, instances and transforms are read by the task and mesh stages as well
+	VkShaderStageFlags geometryStages = VK_SHADER_STAGE_VERTEX_BIT;
+	if (useMeshShaders)
+	{
+		geometryStages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+
+	uint32_t textureCount = resources->textures->capacity;
 
 	vector<VkDescriptorSetLayoutBinding> bindings;
 	vector<VkDescriptorBindingFlags> flags;
@@ -41,7 +65,7 @@ void Rasterizer::createDescriptorSets()
 		INSTANCE_BINDING,
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		1,
-		VK_SHADER_STAGE_VERTEX_BIT,
+		geometryStages,
 		0
 	);
 	descriptors.push_back(instanceBufferDescriptor);
@@ -55,7 +79,7 @@ void Rasterizer::createDescriptorSets()
 		TRANSFORM_BINDING,
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		1,
-		VK_SHADER_STAGE_VERTEX_BIT,
+		geometryStages,
 		0
 	);
 	descriptors.push_back(transformBufferDescriptor);
@@ -97,29 +121,86 @@ void Rasterizer::createDescriptorSets()
 		CAMERA_BINDING,
 		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		1,
-		VK_SHADER_STAGE_FRAGMENT_BIT,
+		useMeshShaders ? VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_TASK_BIT_EXT : VK_SHADER_STAGE_FRAGMENT_BIT,
 		0
 	);
 	descriptors.push_back(cameraBufferDescriptor);
 	bindings.push_back(cameraBufferDescriptor->getLayoutBinding());
 	flags.push_back(cameraBufferDescriptor->bindingFlags);
 
-	UnkDescriptor* textureImagesDescriptor = new UnkImageDescriptor
+	if (rayTracer != nullptr)
+	{
+		// the ray tracer's first build may still be pending
+		UnkDescriptor* asDescriptor = new UnkAsDescriptor
+		(
+			rayTracer->tlas != nullptr ? rayTracer->tlas : rayTracer->pendingBuild->tlas,
+			&descriptorSet,
+			AS_BINDING,
+			VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+			1,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			0
+		);
+		descriptors.push_back(asDescriptor);
+		bindings.push_back(asDescriptor->getLayoutBinding());
+		flags.push_back(asDescriptor->bindingFlags);
+
+		tlasGeneration = rayTracer->tlasGeneration;
+	}
+
+	if (useMeshShaders)
+	{
+		auto add = [&](UnkDescriptor* descriptor)
+			{
+				descriptors.push_back(descriptor);
+				bindings.push_back(descriptor->getLayoutBinding());
+				flags.push_back(descriptor->bindingFlags);
+			};
+
+		add(new UnkBufferDescriptor(resources->positionBuffer, &descriptorSet, POSITION_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_MESH_BIT_EXT, 0));
+		add(new UnkBufferDescriptor(resources->attributeBuffer, &descriptorSet, VERTEX_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_MESH_BIT_EXT, 0));
+		add(new UnkBufferDescriptor(resources->meshletBuffer, &descriptorSet, MESHLET_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0));
+		add(new UnkBufferDescriptor(resources->meshletVertexBuffer, &descriptorSet, MESHLET_VERTEX_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_MESH_BIT_EXT, 0));
+		add(new UnkBufferDescriptor(resources->meshletTriangleBuffer, &descriptorSet, MESHLET_TRIANGLE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_MESH_BIT_EXT, 0));
+		add(new UnkBufferDescriptor(resources->meshletTaskBuffer, &descriptorSet, MESHLET_TASK_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_TASK_BIT_EXT, 0));
+
+		depthPyramidDescriptor = new UnkBufferDescriptor(depthPyramid->pyramid, &descriptorSet, DEPTH_PYRAMID_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_TASK_BIT_EXT, 0);
+		add(depthPyramidDescriptor);
+
+		add(new UnkBufferDescriptor(resources->instanceLodBuffer, &descriptorSet, INSTANCE_LOD_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_TASK_BIT_EXT, 0));
+	}
+
+	UnkDescriptor* feedbackBufferDescriptor = new UnkBufferDescriptor
 	(
-		resources->textureImages,
+		resources->textureFeedbackBuffer,
 		&descriptorSet,
-		TEXTURE_BINDING,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		textureCount,
+		FEEDBACK_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
 		VK_SHADER_STAGE_FRAGMENT_BIT,
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT |
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		0
 	);
-	descriptors.push_back(textureImagesDescriptor);
-	bindings.push_back(textureImagesDescriptor->getLayoutBinding());
-	flags.push_back(textureImagesDescriptor->bindingFlags);
+	descriptors.push_back(feedbackBufferDescriptor);
+	bindings.push_back(feedbackBufferDescriptor->getLayoutBinding());
+	flags.push_back(feedbackBufferDescriptor->bindingFlags);
+
+	UnkDescriptor* textureSlotDescriptor = new UnkBufferDescriptor
+	(
+		resources->textures->slotBuffer,
+		&descriptorSet,
+		TEXTURE_SLOT_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_FRAGMENT_BIT,
+		0
+	);
+	descriptors.push_back(textureSlotDescriptor);
+	bindings.push_back(textureSlotDescriptor->getLayoutBinding());
+	flags.push_back(textureSlotDescriptor->bindingFlags);
+
+	// the array itself is written slot by slot by the registry once the set is allocated
+	bindings.push_back(resources->textures->getLayoutBinding(TEXTURE_BINDING, VK_SHADER_STAGE_FRAGMENT_BIT));
+	flags.push_back(resources->textures->getBindingFlags());
 
 	const size_t n = bindings.size();
 	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags
@@ -151,6 +232,7 @@ void Rasterizer::createDescriptorSets()
 		};
 		poolSizes.push_back(poolSize);
 	}
+	poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = textureCount });
 
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
 	{
@@ -189,6 +271,8 @@ void Rasterizer::createDescriptorSets()
 		writes.push_back(descriptors[i]->getDescriptorWrite());
 	}
 	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+
+	resources->textures->addSet(descriptorSet, TEXTURE_BINDING);
 }
 
 void Rasterizer::createRenderPass()
@@ -206,16 +290,17 @@ void Rasterizer::createRenderPass()
 	};
 	VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
 
+	// kept for the depth pyramid when meshlets are culled against it
 	VkAttachmentDescription depthAttachment
 	{
-		.format = findDepthFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT),
+		.format = getDepthFormat(),
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.storeOp = useMeshShaders ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		.finalLayout = useMeshShaders ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
 	};
 	VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
 
@@ -227,16 +312,29 @@ void Rasterizer::createRenderPass()
 		.pDepthStencilAttachment = &depthRef
 	};
 
-	VkSubpassDependency dependency
+	array<VkSubpassDependency, 2> dependencies{};
+
+	dependencies[0] =
 	{
 		.srcSubpass = VK_SUBPASS_EXTERNAL,
 		.dstSubpass = 0,
-		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | (useMeshShaders ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0u),
 		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
 		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
 		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
 	};
 
+	// the depth pyramid is reduced from the stored depth right after the pass
+	dependencies[1] =
+	{
+		.srcSubpass = 0,
+		.dstSubpass = VK_SUBPASS_EXTERNAL,
+		.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+
 	array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassInfo
 	{
@@ -245,8 +343,8 @@ void Rasterizer::createRenderPass()
 		.pAttachments = attachments.data(),
 		.subpassCount = 1,
 		.pSubpasses = &subpass,
-		.dependencyCount = 1,
-		.pDependencies = &dependency
+		.dependencyCount = useMeshShaders ? 2u : 1u,
+		.pDependencies = dependencies.data()
 	};
 
 	VK_CHECK(vkCreateRenderPass(device->device, &renderPassInfo, nullptr, &renderPass));
@@ -254,6 +352,47 @@ void Rasterizer::createRenderPass()
 
 void Rasterizer::createPipeline()
 {
+	// define pipeline layout (using descriptor set layout)
+	// the task shader's constants follow the fragment shader's
+	array<VkPushConstantRange, 2> pushConstants
+	{{
+		{ .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT, .offset = 0, .size = sizeof(PushConstants) },
+		{ .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT, .offset = sizeof(PushConstants), .size = sizeof(MeshletPushConstants) }
+	}};
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = useMeshShaders ? 2u : 1u,
+		.pPushConstantRanges = pushConstants.data()
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	for (int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		variants[pass][0] = createGraphicsPipeline(static_cast<RasterPass>(pass), false);
+		variants[pass][1] = createGraphicsPipeline(static_cast<RasterPass>(pass), true);
+
+		if (useMeshShaders)
+		{
+			meshVariants[pass][0] = createGraphicsPipeline(static_cast<RasterPass>(pass), false, true);
+			meshVariants[pass][1] = createGraphicsPipeline(static_cast<RasterPass>(pass), true, true);
+		}
+	}
+
+	pipeline = variants[PASS_COLOR][0];
+}
+
+/*
+* Builds one pass variant, all variants share the render pass, layout and vertex buffer binding
+* The depth pass reads only positions, gl_Position is invariant so the colour pass can test for equality
+* Meshlet variants replace the vertex stage and its input state with the task and mesh stages
+*/
+VkPipeline Rasterizer::createGraphicsPipeline(RasterPass pass, bool cullBackFaces, bool meshlets)
+{
+	bool depthOnly = pass == PASS_DEPTH;
+
 	// define vertex inputs
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly
 	{
@@ -261,53 +400,36 @@ void Rasterizer::createPipeline()
 		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
 	};
 
-	VkVertexInputBindingDescription binding
+	// positions and shading attributes are separate streams
+	array<VkVertexInputBindingDescription, 2> bindingDescriptions
 	{
-		.binding = 0,
-		.stride = sizeof(Vertex),
-		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+		{{.binding = 0, .stride = sizeof(vec3), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+		{.binding = 1, .stride = sizeof(VertexAttributes), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX}}
 	};
 
 	array<VkVertexInputAttributeDescription, 3> attributeDescriptions
 	{
-		{{.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, position)},
-		{.location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, normal)},
-		{.location = 2, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex, texCoord)}},
+		{{.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = 0},
+		{.location = 1, .binding = 1, .format = VK_FORMAT_R16G16_SNORM, .offset = offsetof(VertexAttributes, normal)},
+		{.location = 2, .binding = 1, .format = VK_FORMAT_R16G16_SFLOAT, .offset = offsetof(VertexAttributes, texCoord)}},
 	};
 
 	VkPipelineVertexInputStateCreateInfo vertexInput
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &binding,
-		.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
+		.vertexBindingDescriptionCount = depthOnly ? 1 : static_cast<uint32_t>(bindingDescriptions.size()),
+		.pVertexBindingDescriptions = bindingDescriptions.data(),
+		.vertexAttributeDescriptionCount = depthOnly ? 1 : static_cast<uint32_t>(attributeDescriptions.size()),
 		.pVertexAttributeDescriptions = attributeDescriptions.data()
 	};
 
-	// define pipeline layout (using descriptor set layout)
-	VkPushConstantRange pushConstant
-	{
-		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.offset = 0,
-		.size = sizeof(PushConstants)
-	};
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount = 1,
-		.pSetLayouts = &descriptorSetLayout,
-		.pushConstantRangeCount = 1,
-		.pPushConstantRanges = &pushConstant
-	};
-	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
-
 	// define basic settings
 	VkPipelineRasterizationStateCreateInfo rasterizer
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
 		.depthClampEnable = VK_FALSE,
 		.rasterizerDiscardEnable = VK_FALSE,
-		.cullMode = VK_CULL_MODE_NONE,
+		.cullMode = static_cast<VkCullModeFlags>(cullBackFaces ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE),
 		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
 		.depthBiasEnable = VK_FALSE,
 		.lineWidth = 1.0f,
@@ -315,7 +437,7 @@ void Rasterizer::createPipeline()
 
 	VkPipelineColorBlendAttachmentState blendAttachment
 	{
-		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+		.colorWriteMask = depthOnly ? 0 : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
 	};
 
 	VkPipelineColorBlendStateCreateInfo blend
@@ -332,12 +454,13 @@ void Rasterizer::createPipeline()
 		.scissorCount = 1
 	};
 
+	// after the pre-pass depth already holds the nearest surface
 	VkPipelineDepthStencilStateCreateInfo depthStencil
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 		.depthTestEnable = VK_TRUE,
-		.depthWriteEnable = VK_TRUE,
-		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthWriteEnable = pass == PASS_COLOR_EQUAL ? VK_FALSE : VK_TRUE,
+		.depthCompareOp = pass == PASS_COLOR_EQUAL ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS,
 		.depthBoundsTestEnable = VK_FALSE,
 		.stencilTestEnable = VK_FALSE,
 		.minDepthBounds = 0.0f,
@@ -360,31 +483,49 @@ void Rasterizer::createPipeline()
 		.pDynamicStates = dynamics.data()
 	};
 
-	array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+	vector<VkPipelineShaderStageCreateInfo> shaderStages;
+
+	auto addStage = [&](VkShaderStageFlagBits stage, const string& path)
+		{
+			shaderStages.push_back(
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = stage,
+				.module = loadShaderModule(path),
+				.pName = "main"
+			});
+		};
 
-	shaderStages[0] =
+	if (meshlets)
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_VERTEX_BIT,
-		.module = loadShaderModule("shaders/vert.spv"),
-		.pName = "main"
-	};
+		addStage(VK_SHADER_STAGE_TASK_BIT_EXT, "shaders/meshlet_task.spv");
+		addStage(VK_SHADER_STAGE_MESH_BIT_EXT, depthOnly ? "shaders/meshlet_depth_mesh.spv" : "shaders/meshlet_mesh.spv");
+	}
+	else
+	{
+		addStage(VK_SHADER_STAGE_VERTEX_BIT, depthOnly ? "shaders/depth_vert.spv" : "shaders/vert.spv");
+	}
 
-	shaderStages[1] =
+	if (!depthOnly)
 	{
-	.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-	.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-	.module = loadShaderModule("shaders/frag.spv"),
-	.pName = "main"
-	};
+		// without fragment stores the feedback buffer is left out, the renderer then keeps textures fully resident
+		if (device->fragmentStoresAndAtomics)
+		{
+			addStage(VK_SHADER_STAGE_FRAGMENT_BIT, rayTracer != nullptr ? "shaders/frag_shadows.spv" : "shaders/frag.spv");
+		}
+		else
+		{
+			addStage(VK_SHADER_STAGE_FRAGMENT_BIT, rayTracer != nullptr ? "shaders/frag_shadows_nofeedback.spv" : "shaders/frag_nofeedback.spv");
+		}
+	}
 
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo
 	{
 		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
 		.stageCount = static_cast<uint32_t>(shaderStages.size()),
 		.pStages = shaderStages.data(),
-		.pVertexInputState = &vertexInput,
-		.pInputAssemblyState = &inputAssembly,
+		.pVertexInputState = meshlets ? nullptr : &vertexInput,
+		.pInputAssemblyState = meshlets ? nullptr : &inputAssembly,
 		.pViewportState = &viewport,
 		.pRasterizationState = &rasterizer,
 		.pMultisampleState = &multisample,
@@ -395,15 +536,20 @@ void Rasterizer::createPipeline()
 		.renderPass = renderPass
 	};
 
-	VK_CHECK(vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline));
 
-	vkDestroyShaderModule(device->device, shaderStages[0].module, nullptr);
-	vkDestroyShaderModule(device->device, shaderStages[1].module, nullptr);
+	for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+	{
+		vkDestroyShaderModule(device->device, stage.module, nullptr);
+	}
+
+	return graphicsPipeline;
 }
 
 void Rasterizer::createFramebuffers()
 {
-	VkFormat depthFormat = findDepthFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	VkFormat depthFormat = getDepthFormat();
 
 	framebuffers.clear();
 
@@ -416,10 +562,11 @@ void Rasterizer::createFramebuffers()
 			swapchain->extent.height,
 			depthFormat,
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (useMeshShaders ? VK_IMAGE_USAGE_SAMPLED_BIT : 0u),
 			true,
 			VK_IMAGE_ASPECT_DEPTH_BIT
 		);
+		depthImage->sampler = &resources->sampler;
 		depthImage->transitionImageLayout(VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 		depthImages.push_back(depthImage);
 
@@ -444,6 +591,25 @@ void Rasterizer::createFramebuffers()
 		vkCreateFramebuffer(device->device, &framebufferInfo, nullptr, &framebuffer);
 		framebuffers.push_back(framebuffer);
 	}
+
+	if (depthPyramid != nullptr)
+	{
+		depthPyramid->setSources(depthImages);
+	}
+}
+
+/*
+* The depth pyramid samples the depth attachments when meshlets are culled
+*/
+VkFormat Rasterizer::getDepthFormat()
+{
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (useMeshShaders)
+	{
+		features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	}
+
+	return findDepthFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, features);
 }
 
 /*
@@ -451,6 +617,7 @@ void Rasterizer::createFramebuffers()
 * - Depth Images
 * - Depth Image Views
 * - Framebuffers
+* - Depth pyramid
 */
 void Rasterizer::handleResize()
 {
@@ -466,6 +633,15 @@ void Rasterizer::handleResize()
 		framebuffer = VK_NULL_HANDLE;
 	}
 
+	if (depthPyramid != nullptr)
+	{
+		depthPyramid->handleResize(swapchain->extent.width, swapchain->extent.height);
+
+		depthPyramidDescriptor->buffer = depthPyramid->pyramid;
+		VkWriteDescriptorSet descriptorWrite = depthPyramidDescriptor->getDescriptorWrite();
+		vkUpdateDescriptorSets(device->device, 1, &descriptorWrite, 0, nullptr);
+	}
+
 	createFramebuffers();
 }
 
@@ -475,6 +651,16 @@ void Rasterizer::draw(uint32_t index)
 	UnkCommandBuffer* commandBuffer = swapchain->frames[index].commandBuffer;
 	commandBuffer->beginCommand();
 
+	resources->textures->recordSlots(commandBuffer);
+	recordLods(commandBuffer, index);
+
+	// hybrid mode takes over swapping in acceleration structure builds while the ray tracer is not drawing
+	VkSemaphore buildSemaphore = VK_NULL_HANDLE;
+	if (rayTracer != nullptr)
+	{
+		buildSemaphore = rayTracer->updateAccelerationStructures(index);
+		updateTlas();
+	}
 
 	array<VkClearValue, 2> clearValues{};
 	clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
@@ -498,7 +684,6 @@ void Rasterizer::draw(uint32_t index)
 	};
 
 	vkCmdBeginRenderPass(commandBuffer->handle, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
 	VkViewport viewport
 	{
@@ -519,10 +704,10 @@ void Rasterizer::draw(uint32_t index)
 	};
 	vkCmdSetScissor(commandBuffer->handle, 0, 1, &scissor);
 
-	VkDeviceSize offset = 0;
+	array<VkBuffer, 2> vertexBuffers{ resources->positionBuffer->handle, resources->attributeBuffer->handle };
+	array<VkDeviceSize, 2> offsets{};
 
-	vkCmdBindVertexBuffers(commandBuffer->handle, 0, 1, &resources->vertexBuffer->handle, &offset);
-	vkCmdBindIndexBuffer(commandBuffer->handle, resources->indexBuffer->handle, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindVertexBuffers(commandBuffer->handle, 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
 	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
 	PushConstants constants
@@ -532,17 +717,48 @@ void Rasterizer::draw(uint32_t index)
 	};
 	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &constants);
 
-	vkCmdDrawIndexedIndirect
-	(
-		commandBuffer->handle,
-		resources->drawCommandBuffer->handle, 
-		0, 
-		static_cast<uint32_t>(resources->drawCommandBuffer->size / sizeof(VkDrawIndexedIndirectCommand)), 
-		sizeof(VkDrawIndexedIndirectCommand)
-	);
+	if (useMeshShaders)
+	{
+		// occlusion culling needs the depth of the frame right before this one, after a resize or a switch
+		// from another pipeline the pyramid is stale and only frustum and cone culling apply
+		// while the view changes, surfaces that were hidden last frame can come into view and would be culled
+		// for a frame, occlusion resumes once the camera rests and the pyramid holds a complete frame again
+		bool pyramidValid = depthPyramid->holdsFrame(resources->frame - 1) && !resources->viewChanged;
+
+		MeshletPushConstants meshletConstants
+		{
+			.pyramidWidth = depthPyramid->width,
+			.pyramidHeight = depthPyramid->height,
+			.pyramidLevels = pyramidValid ? depthPyramid->levelCount : 0u
+		};
+
+		if (useDepthPrepass)
+		{
+			drawMeshlets(commandBuffer, PASS_DEPTH, meshletConstants);
+			drawMeshlets(commandBuffer, PASS_COLOR_EQUAL, meshletConstants);
+		}
+		else
+		{
+			drawMeshlets(commandBuffer, PASS_COLOR, meshletConstants);
+		}
+	}
+	else if (useDepthPrepass)
+	{
+		drawMeshes(commandBuffer, PASS_DEPTH);
+		drawMeshes(commandBuffer, PASS_COLOR_EQUAL);
+	}
+	else
+	{
+		drawMeshes(commandBuffer, PASS_COLOR);
+	}
 
 	vkCmdEndRenderPass(commandBuffer->handle);
 
+	if (useMeshShaders)
+	{
+		depthPyramid->record(commandBuffer, index, resources->frame);
+	}
+
 	commandBuffer->endCommand(false);
 
 	if (swapchain->frames[index].swapchainReleaseSemaphore == VK_NULL_HANDLE)
@@ -551,14 +767,21 @@ void Rasterizer::draw(uint32_t index)
 		vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &swapchain->frames[index].swapchainReleaseSemaphore);
 	}
 
-	VkPipelineStageFlags waitStage{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	vector<VkSemaphore> waitSemaphores{ swapchain->frames[index].swapchainAcquireSemaphore };
+	vector<VkPipelineStageFlags> waitStages{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+	if (buildSemaphore != VK_NULL_HANDLE)
+	{
+		waitSemaphores.push_back(buildSemaphore);
+		waitStages.push_back(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
 
 	VkSubmitInfo info
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &swapchain->frames[index].swapchainAcquireSemaphore,
-		.pWaitDstStageMask = &waitStage,
+		.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+		.pWaitSemaphores = waitSemaphores.data(),
+		.pWaitDstStageMask = waitStages.data(),
 		.commandBufferCount = 1,
 		.pCommandBuffers = &commandBuffer->handle,
 		.signalSemaphoreCount = 1,
@@ -567,23 +790,87 @@ void Rasterizer::draw(uint32_t index)
 	vkQueueSubmit(device->getQueue(device->queues.graphics), 1, &info, swapchain->frames[index].queueSubmitFence);
 }
 
-VkFormat Rasterizer::findDepthFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+/*
+* One indirect draw per draw group, single sided meshes with back face culling and the rest without
+*/
+void Rasterizer::drawMeshes(UnkCommandBuffer* commandBuffer, RasterPass pass)
 {
-	for (VkFormat format : candidates)
+	for (const DrawGroup& group : resources->drawGroups)
 	{
-		VkFormatProperties properties;
-		vkGetPhysicalDeviceFormatProperties(device->gpu, format, &properties);
-		if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & features) == features)
-		{
-			return format;
-		}
-		else if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & features) == features)
+		vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, variants[pass][group.doubleSided ? 0 : 1]);
+		vkCmdBindIndexBuffer(commandBuffer->handle, resources->getIndexBuffer(group.indexType)->handle, 0, group.indexType);
+		vkCmdDrawIndexedIndirect
+		(
+			commandBuffer->handle,
+			resources->drawCommandBuffer->handle,
+			group.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+			group.drawCount,
+			sizeof(VkDrawIndexedIndirectCommand)
+		);
+	}
+}
+
+/*
+* Task shader workgroups over the meshlet tasks, single sided tasks with back face culling and cone culling,
+* the rest without either
+*/
+void Rasterizer::drawMeshlets(UnkCommandBuffer* commandBuffer, RasterPass pass, MeshletPushConstants constants)
+{
+	const uint32_t taskCount = static_cast<uint32_t>(resources->meshletTasks.size());
+	const uint32_t singleSidedCount = resources->singleSidedTaskCount;
+
+	for (bool doubleSided : { false, true })
+	{
+		uint32_t first = doubleSided ? singleSidedCount : 0;
+		uint32_t end = doubleSided ? taskCount : singleSidedCount;
+		if (first == end) continue;
+
+		vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, meshVariants[pass][doubleSided ? 0 : 1]);
+
+		constants.coneCulling = doubleSided ? 0u : 1u;
+
+		for (; first < end; first += MAX_TASKS_PER_DRAW)
 		{
-			return format;
+			constants.firstTask = first;
+			vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT, sizeof(PushConstants), sizeof(MeshletPushConstants), &constants);
+			device->vkCmdDrawMeshTasksEXT(commandBuffer->handle, std::min(end - first, MAX_TASKS_PER_DRAW), 1, 1);
 		}
 	}
+}
 
-	throw runtime_error("failed to find supported depth format");
+bool Rasterizer::isReady()
+{
+	return rayTracer == nullptr || rayTracer->isReady();
+}
+
+/*
+* A simplified surface can sit inside the full one its shadow rays start from, so hybrid shadows draw level 0
+*/
+bool Rasterizer::needsFullDetail()
+{
+	return rayTracer != nullptr;
+}
+
+/*
+* Points the acceleration structure descriptor at the ray tracer's current top level structure
+* Only called once the frames that used the previous one have completed
+*/
+void Rasterizer::updateTlas()
+{
+	if (rayTracer->tlasGeneration == tlasGeneration) return;
+
+	for (auto& descriptor : descriptors)
+	{
+		if (descriptor->descriptorType != VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR) continue;
+
+		UnkAsDescriptor* asDescriptor = static_cast<UnkAsDescriptor*>(descriptor);
+		asDescriptor->tlas = rayTracer->tlas;
+
+		VkWriteDescriptorSet descriptorWrite = asDescriptor->getDescriptorWrite();
+		vkUpdateDescriptorSets(device->device, 1, &descriptorWrite, 0, nullptr);
+	}
+
+	tlasGeneration = rayTracer->tlasGeneration;
 }
 
 Rasterizer::~Rasterizer()
@@ -599,6 +886,28 @@ Rasterizer::~Rasterizer()
 	}
 	depthImages.clear();
 
+	delete depthPyramid;
+
+	// pipeline itself is destroyed by the base class
+	for (int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		for (VkPipeline variant : variants[pass])
+		{
+			if (variant != VK_NULL_HANDLE && variant != pipeline)
+			{
+				vkDestroyPipeline(device->device, variant, nullptr);
+			}
+		}
+
+		for (VkPipeline variant : meshVariants[pass])
+		{
+			if (variant != VK_NULL_HANDLE)
+			{
+				vkDestroyPipeline(device->device, variant, nullptr);
+			}
+		}
+	}
+
 	if (renderPass != VK_NULL_HANDLE)
 	{
 		vkDestroyRenderPass(device->device, renderPass, nullptr);
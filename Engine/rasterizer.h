@@ -1,17 +1,49 @@
 #pragma once
 #include "pipeline.h"
+#include "raytracer.h"
+#include "depth_pyramid.h"
 
 class Rasterizer : public Pipeline
 {
 public:
+	// graphics pipeline variants, each is built with and without back face culling
+	enum RasterPass
+	{
+		PASS_COLOR, // depth test less and write
+		PASS_DEPTH, // depth pre-pass, positions only and no fragment shader
+		PASS_COLOR_EQUAL, // after the pre-pass, shades only the visible fragment
+		PASS_COUNT
+	};
+
 	VkRenderPass renderPass{ VK_NULL_HANDLE };
 
+	VkPipeline variants[PASS_COUNT][2]{}; // [pass][cull back faces], variants[PASS_COLOR][0] is pipeline
+
+	// fills depth first so overdrawn fragments are never lit
+	bool useDepthPrepass = true;
+
+	// meshlets are culled by a task shader and emitted by a mesh shader instead of the indirect draws
+	// only when the device supports VK_EXT_mesh_shader, the passes stay the same
+	bool useMeshShaders = false;
+	VkPipeline meshVariants[PASS_COUNT][2]{}; // [pass][cull back faces]
+
+	// the task shader tests meshlets against the last frame's depth
+	DepthPyramid* depthPyramid = nullptr;
+	UnkBufferDescriptor* depthPyramidDescriptor = nullptr;
+
+	// draws are split so no single one exceeds the guaranteed maxTaskWorkGroupCount[0]
+	static const uint32_t MAX_TASKS_PER_DRAW = 65535;
+
 	vector<UnkImage*> depthImages;
 	vector<VkFramebuffer> framebuffers;
 
+	// hybrid mode, shadow rays are queried against the acceleration structures of this ray tracer
+	RayTracer* rayTracer = nullptr;
+	uint32_t tlasGeneration = 0;
+
 	Rasterizer() = default;
 
-	Rasterizer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources);
+	Rasterizer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, RayTracer* rayTracer = nullptr);
 
 	~Rasterizer() override;
 
@@ -19,13 +51,25 @@ public:
 
 	void createPipeline();
 
+	VkPipeline createGraphicsPipeline(RasterPass pass, bool cullBackFaces, bool meshlets = false);
+
 	void createDescriptorSets();
 
 	void createFramebuffers();
 
+	VkFormat getDepthFormat();
+
 	void handleResize();
 
 	void draw(uint32_t imageIndex);
 
-	VkFormat findDepthFormat(const vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+	void drawMeshes(UnkCommandBuffer* commandBuffer, RasterPass pass);
+
+	void drawMeshlets(UnkCommandBuffer* commandBuffer, RasterPass pass, MeshletPushConstants constants);
+
+	bool isReady() override;
+
+	bool needsFullDetail() override;
+
+	void updateTlas();
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 #include <array>
+#include <string>
+#include <unordered_map>
 using namespace std;
 using namespace glm;
 
@@ -11,16 +13,34 @@ RayTracer::RayTracer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources
 	this->swapchain = swapchain;
 	this->resources = resources;
 
+	timestamps = new UnkTimestamps(device, static_cast<uint32_t>(swapchain->frames.size()));
+	updateRenderExtent();
+
+	constants.pointLightCount = static_cast<uint32_t>(resources->pointLights.size());
+	constants.dirLightCount = static_cast<uint32_t>(resources->dirLights.size());
+
+	for (auto& mesh : resources->meshes)
+	{
+		if (mesh.isAlphaTested() && mesh.castsShadows) constants.alphaShadows = 1;
+	}
+
 	createResultImage();
+	denoiser = new Denoiser(device, swapchain, resources, resultImage);
 	createAccelerationStructures();
+	restir = new Restir(device, swapchain, resources, resultImage, denoiser->gbuffer, pendingBuild->tlas);
 	createDescriptorSets();
 	createPipeline();
+
+	sbt = new UnkSbt(device);
 	createShaderBindingTable();
+
+	resolver = new Resolver(device, swapchain, resultImage);
 }
 
 void RayTracer::createResultImage()
 {
-	VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	// hdr radiance, tonemapped and converted to the swapchain format by the resolver
+	VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
 
 	resultImage = new UnkImage
 	(
@@ -29,31 +49,250 @@ void RayTracer::createResultImage()
 		swapchain->extent.height,
 		format,
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
 		true
 	);
 	resultImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	// running mean of all samples traced since the last reset
+	accumulationImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R32G32B32A32_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT,
+		true
+	);
+	accumulationImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	resetAccumulation();
 }
 
+void RayTracer::resetAccumulation()
+{
+	constants.frame = 0;
+}
+
+/*
+* Restarts accumulation if the camera moved, returns false once the sample budget has been reached
+*/
+bool RayTracer::updateAccumulation()
+{
+	// previous frame matrices trail by a frame, only the current view matters
+	CameraGPU* camera = static_cast<CameraGPU*>(resources->cameraBuffer->base.pMappedData);
+	if (camera->viewInv != accumulatedCamera.viewInv || camera->projInv != accumulatedCamera.projInv)
+	{
+		accumulatedCamera = *camera;
+		resetAccumulation();
+	}
+
+	return constants.frame < sampleBudget;
+}
+
+/*
+* The trace reads the sum the previous frame's trace wrote, frames on the queue are not ordered without it
+*/
+void RayTracer::accumulationBarrier(UnkCommandBuffer* commandBuffer)
+{
+	VkImageMemoryBarrier barrier
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = accumulationImage->handle,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+	};
+
+	vkCmdPipelineBarrier
+	(
+		commandBuffer->handle,
+		VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+}
+
+/*
+* Histories of the other mode are stale, everything restarts from the next frame
+*/
+void RayTracer::setRestir(bool enabled)
+{
+	useRestir = enabled;
+	restir->reset();
+	denoiser->reset();
+	resetAccumulation();
+
+	LOG("ReSTIR " << (enabled ? "on" : "off"));
+}
+
+/*
+* A converged image is traced again so the change shows
+*/
+void RayTracer::setDenoise(bool enabled)
+{
+	denoise = enabled;
+	denoiser->reset();
+	resetAccumulation();
+
+	LOG("Denoiser " << (enabled ? "on" : "off"));
+}
+
+void RayTracer::updateRenderExtent()
+{
+	renderExtent =
+	{
+		std::max(1u, static_cast<uint32_t>(swapchain->extent.width * renderScale)),
+		std::max(1u, static_cast<uint32_t>(swapchain->extent.height * renderScale))
+	};
+}
+
+/*
+* Adjusts the render scale towards the trace time target using the timestamps of the last use of this frame
+*/
+void RayTracer::updateRenderScale(uint32_t index)
+{
+	const float step = 1.0f / 16.0f;
+
+	float traceTime;
+	if (!timestamps->getMilliseconds(index, &traceTime)) return;
+
+	filteredTraceTime = filteredTraceTime == 0.0f ? traceTime : mix(filteredTraceTime, traceTime, 0.1f);
+
+	// leave some slack around the target so the scale does not oscillate
+	if (filteredTraceTime > 0.85f * targetTraceTime && filteredTraceTime < 1.05f * targetTraceTime) return;
+
+	// trace cost is proportional to pixel count, the square of the scale
+	float scale = renderScale * sqrt(targetTraceTime / filteredTraceTime);
+	scale = glm::clamp(round(scale / step) * step, minRenderScale, 1.0f);
+
+	if (scale == renderScale) return;
+
+	renderScale = scale;
+	filteredTraceTime = 0.0f;
+	updateRenderExtent();
+	resetAccumulation();
+}
+
+/*
+* Records bottom level builds for meshes without one and a new top level build on the compute queue
+* The current top level structure keeps being traced until the new one completes
+*/
 void RayTracer::createAccelerationStructures()
 {
-	VkDeviceOrHostAddressConstKHR transformBufferDeviceAddress{ getBufferDeviceAddress(resources->transformBuffer->handle) };
-	VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{ getBufferDeviceAddress(resources->vertexBuffer->handle) };
+	if (pendingBuild != nullptr)
+	{
+		rebuildRequested = true;
+		return;
+	}
+
+	VkDeviceOrHostAddressConstKHR positionBufferDeviceAddress{ getBufferDeviceAddress(resources->positionBuffer->handle) };
 	VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{ getBufferDeviceAddress(resources->indexBuffer->handle) };
+	VkDeviceOrHostAddressConstKHR index16BufferDeviceAddress{ getBufferDeviceAddress(resources->index16Buffer->handle) };
 
-	for (auto& mesh : resources->meshes)
+	UnkAsBuild* build = new UnkAsBuild(device);
+
+	for (size_t i = blasses.size(); i < resources->meshes.size(); i++)
 	{
-		UnkBlas* blas = new UnkBlas(device, mesh, vertexBufferDeviceAddress, indexBufferDeviceAddress);
+		Mesh& mesh = resources->meshes[i];
+		UnkBlas* blas = new UnkBlas
+		(
+			device,
+			mesh,
+			positionBufferDeviceAddress,
+			mesh.indexType == VK_INDEX_TYPE_UINT16 ? index16BufferDeviceAddress : indexBufferDeviceAddress,
+			build->commandBuffer
+		);
 		blasses.push_back(blas);
+		build->addBlas(blas);
 	}
 
-	tlas = new UnkTlas(device, resources->meshes, resources->instances, resources->transforms, blasses);
+	build->barrier();
+
+	// previously built bottom level structures are only referenced by address, their buffers are concurrent like the new ones
+	build->setTlas(new UnkTlas(device, resources->meshes, resources->instances, resources->transforms, blasses, build->commandBuffer));
+
+	build->submit();
+
+	pendingBuild = build;
+}
+
+/*
+* Swaps in a completed build, returns the semaphore the graphics submit must wait on or VK_NULL_HANDLE
+*/
+VkSemaphore RayTracer::updateAccelerationStructures(uint32_t index)
+{
+	// the semaphore of the last swap is done with once the frame that waited on it has finished
+	if (acquiredBuild != nullptr && vkGetFenceStatus(device->device, swapchain->frames[acquiredFrame].queueSubmitFence) == VK_SUCCESS)
+	{
+		delete acquiredBuild;
+		acquiredBuild = nullptr;
+	}
+
+	if (pendingBuild == nullptr || acquiredBuild != nullptr || !pendingBuild->isComplete())
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	// other frames in flight may still be tracing against the old top level structure
+	for (uint32_t i = 0; i < swapchain->frames.size(); i++)
+	{
+		if (i == index) continue;
+
+		vkWaitForFences(device->device, 1, &swapchain->frames[i].queueSubmitFence, VK_TRUE, UINT64_MAX);
+	}
+
+	if (tlas != nullptr)
+	{
+		delete tlas;
+	}
+	tlas = pendingBuild->tlas;
+	tlasGeneration++;
+
+	UnkAsDescriptor* descriptor = static_cast<UnkAsDescriptor*>(descriptors[AS_BINDING]);
+	descriptor->tlas = tlas;
+
+	VkWriteDescriptorSet descriptorWrite = descriptor->getDescriptorWrite();
+	vkUpdateDescriptorSets(device->device, 1, &descriptorWrite, 0, nullptr);
+
+	// meshes added since the last build need hit records for their sbt offsets
+	if (sbt->getHitCount() != resources->meshes.size())
+	{
+		createShaderBindingTable();
+	}
+	resetAccumulation();
+	denoiser->reset();
+	restir->setTlas(tlas);
+
+	acquiredBuild = pendingBuild;
+	acquiredFrame = index;
+	pendingBuild = nullptr;
+
+	if (rebuildRequested)
+	{
+		rebuildRequested = false;
+		createAccelerationStructures();
+	}
+
+	return acquiredBuild->semaphore;
+}
+
+bool RayTracer::isReady()
+{
+	return tlas != nullptr || (pendingBuild != nullptr && pendingBuild->isComplete());
 }
 
 void RayTracer::createDescriptorSets()
 {
-	uint32_t textureCount = static_cast<uint32_t>(resources->textureImages.size());
-	uint32_t maxTextureCount = std::max<uint32_t>(textureCount, 1);
+	uint32_t textureCount = resources->textures->capacity;
 
 	vector<VkDescriptorSetLayoutBinding> bindings;
 	vector<VkDescriptorBindingFlags> flags;
@@ -65,7 +304,7 @@ void RayTracer::createDescriptorSets()
 		INSTANCE_BINDING,
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		1,
-		VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
 		0
 	);
 	descriptors.push_back(instanceBufferDescriptor);
@@ -116,7 +355,7 @@ void RayTracer::createDescriptorSets()
 
 	UnkDescriptor* asBufferDescriptor = new UnkAsDescriptor
 	(
-		tlas,
+		tlas != nullptr ? tlas : pendingBuild->tlas,
 		&descriptorSet,
 		AS_BINDING,
 		VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
@@ -152,7 +391,7 @@ void RayTracer::createDescriptorSets()
 		CAMERA_BINDING,
 		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 		1,
-		VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+		VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, // hits take the field of view for their ray cones
 		0
 	);
 	descriptors.push_back(cameraBufferDescriptor);
@@ -161,12 +400,12 @@ void RayTracer::createDescriptorSets()
 
 	UnkDescriptor* vertexBufferDescriptor = new UnkBufferDescriptor
 	(
-		resources->vertexBuffer,
+		resources->attributeBuffer,
 		&descriptorSet,
 		VERTEX_BINDING,
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		1,
-		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
 		0
 	);
 	descriptors.push_back(vertexBufferDescriptor);
@@ -180,29 +419,149 @@ void RayTracer::createDescriptorSets()
 		INDEX_BINDING,
 		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		1,
-		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
 		0
 	);
 	descriptors.push_back(indexBufferDescriptor);
 	bindings.push_back(indexBufferDescriptor->getLayoutBinding());
 	flags.push_back(indexBufferDescriptor->bindingFlags);
 
-	UnkDescriptor* textureImagesDescriptor = new UnkImageDescriptor
+	vector<UnkImage*> accumulationImages;
+	accumulationImages.push_back(accumulationImage);
+	UnkDescriptor* accumulationImageDescriptor = new UnkImageDescriptor
 	(
-		resources->textureImages,
+		accumulationImages,
 		&descriptorSet,
-		TEXTURE_BINDING,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		textureCount,
+		ACCUMULATION_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		1,
+		VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+		0,
+		VK_IMAGE_LAYOUT_GENERAL
+	);
+	descriptors.push_back(accumulationImageDescriptor);
+	bindings.push_back(accumulationImageDescriptor->getLayoutBinding());
+	flags.push_back(accumulationImageDescriptor->bindingFlags);
+
+	vector<UnkImage*> gbufferImages{ denoiser->gbuffer[0], denoiser->gbuffer[1] };
+	UnkDescriptor* gbufferImageDescriptor = new UnkImageDescriptor
+	(
+		gbufferImages,
+		&descriptorSet,
+		GBUFFER_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		2,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
+		0,
+		VK_IMAGE_LAYOUT_GENERAL
+	);
+	descriptors.push_back(gbufferImageDescriptor);
+	bindings.push_back(gbufferImageDescriptor->getLayoutBinding());
+	flags.push_back(gbufferImageDescriptor->bindingFlags);
+
+	UnkDescriptor* lightCdfBufferDescriptor = new UnkBufferDescriptor
+	(
+		resources->lightCdfBuffer,
+		&descriptorSet,
+		LIGHT_CDF_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		0
+	);
+	descriptors.push_back(lightCdfBufferDescriptor);
+	bindings.push_back(lightCdfBufferDescriptor->getLayoutBinding());
+	flags.push_back(lightCdfBufferDescriptor->bindingFlags);
+
+	UnkDescriptor* reservoirBufferDescriptor = new UnkBufferDescriptor
+	(
+		restir->initialReservoirs,
+		&descriptorSet,
+		RESERVOIR_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
 		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT |
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		0
 	);
-	descriptors.push_back(textureImagesDescriptor);
-	bindings.push_back(textureImagesDescriptor->getLayoutBinding());
-	flags.push_back(textureImagesDescriptor->bindingFlags);
+	descriptors.push_back(reservoirBufferDescriptor);
+	bindings.push_back(reservoirBufferDescriptor->getLayoutBinding());
+	flags.push_back(reservoirBufferDescriptor->bindingFlags);
+
+	vector<UnkImage*> albedoImages{ restir->albedoImage };
+	UnkDescriptor* albedoImageDescriptor = new UnkImageDescriptor
+	(
+		albedoImages,
+		&descriptorSet,
+		ALBEDO_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		0,
+		VK_IMAGE_LAYOUT_GENERAL
+	);
+	descriptors.push_back(albedoImageDescriptor);
+	bindings.push_back(albedoImageDescriptor->getLayoutBinding());
+	flags.push_back(albedoImageDescriptor->bindingFlags);
+
+	UnkDescriptor* positionBufferDescriptor = new UnkBufferDescriptor
+	(
+		resources->positionBuffer,
+		&descriptorSet,
+		POSITION_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
+		0
+	);
+	descriptors.push_back(positionBufferDescriptor);
+	bindings.push_back(positionBufferDescriptor->getLayoutBinding());
+	flags.push_back(positionBufferDescriptor->bindingFlags);
+
+	UnkDescriptor* index16BufferDescriptor = new UnkBufferDescriptor
+	(
+		resources->index16Buffer,
+		&descriptorSet,
+		INDEX16_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
+		0
+	);
+	descriptors.push_back(index16BufferDescriptor);
+	bindings.push_back(index16BufferDescriptor->getLayoutBinding());
+	flags.push_back(index16BufferDescriptor->bindingFlags);
+
+	UnkDescriptor* feedbackBufferDescriptor = new UnkBufferDescriptor
+	(
+		resources->textureFeedbackBuffer,
+		&descriptorSet,
+		FEEDBACK_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
+		0
+	);
+	descriptors.push_back(feedbackBufferDescriptor);
+	bindings.push_back(feedbackBufferDescriptor->getLayoutBinding());
+	flags.push_back(feedbackBufferDescriptor->bindingFlags);
+
+	UnkDescriptor* textureSlotDescriptor = new UnkBufferDescriptor
+	(
+		resources->textures->slotBuffer,
+		&descriptorSet,
+		TEXTURE_SLOT_BINDING,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1,
+		VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR,
+		0
+	);
+	descriptors.push_back(textureSlotDescriptor);
+	bindings.push_back(textureSlotDescriptor->getLayoutBinding());
+	flags.push_back(textureSlotDescriptor->bindingFlags);
+
+	// the array itself is written slot by slot by the registry once the set is allocated
+	bindings.push_back(resources->textures->getLayoutBinding(TEXTURE_BINDING, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR));
+	flags.push_back(resources->textures->getBindingFlags());
 
 	const size_t n = bindings.size();
 	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags
@@ -234,6 +593,7 @@ void RayTracer::createDescriptorSets()
 		};
 		poolSizes.push_back(poolSize);
 	}
+	poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = textureCount });
 
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
 	{
@@ -245,7 +605,7 @@ void RayTracer::createDescriptorSets()
 	};
 	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
 
-	uint32_t counts[] = { maxTextureCount };
+	uint32_t counts[] = { textureCount };
 	VkDescriptorSetVariableDescriptorCountAllocateInfo varCount
 	{
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
@@ -273,105 +633,100 @@ void RayTracer::createDescriptorSets()
 	}
 
 	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+
+	resources->textures->addSet(descriptorSet, TEXTURE_BINDING);
 }
 
 void RayTracer::createPipeline()
 {
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
+		.offset = 0,
+		.size = sizeof(RayPushConstants)
+	};
+
 	VkPipelineLayoutCreateInfo pipelineLayoutCI
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.setLayoutCount = 1,
-		.pSetLayouts = &descriptorSetLayout
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
 	};
 	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
-	VkShaderModule rgenModule = loadShaderModule("shaders/raygen.spv");
-	VkShaderModule missModule = loadShaderModule("shaders/miss.spv");
-	VkShaderModule hitModule = loadShaderModule("shaders/hit.spv");
-	VkShaderModule shadowMissModule = loadShaderModule("shaders/shadow_miss.spv");
-
-	vector<VkPipelineShaderStageCreateInfo> shaderStages;
-	VkPipelineShaderStageCreateInfo rgenStage
+	// shaders of each material class's hit group, indexed by MaterialClass
+	// alpha tested materials may also emit, they add the record's emission which is zero for the rest
+	struct HitGroupShaders
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-		.module = rgenModule,
-		.pName = "main"
+		const char* closestHit;
+		const char* anyHit;
 	};
-	shaderStages.push_back(rgenStage);
 
-	VkPipelineShaderStageCreateInfo missStage
+	const HitGroupShaders hitGroupShaders[MATERIAL_CLASS_COUNT] =
 	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_MISS_BIT_KHR,
-		.module = missModule,
-		.pName = "main"
+		{ "shaders/hit.spv", nullptr },
+		{ "shaders/hit_emissive.spv", "shaders/shadow_hit.spv" },
+		{ "shaders/hit_emissive.spv", nullptr },
+		{ "shaders/hit_unlit.spv", nullptr }
 	};
-	shaderStages.push_back(missStage);
-	
-	VkPipelineShaderStageCreateInfo hitStage
-	{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
-		.module = hitModule,
-		.pName = "main"
-	};
-	shaderStages.push_back(hitStage);
 
-	VkPipelineShaderStageCreateInfo shadowMissStage{
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage = VK_SHADER_STAGE_MISS_BIT_KHR,
-		.module = shadowMissModule,
-		.pName = "main"
-	};
-	shaderStages.push_back(shadowMissStage);
-
-	vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
-	VkRayTracingShaderGroupCreateInfoKHR rgenGroup
-	{
-		.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-		.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
-		.generalShader = 0,
-		.closestHitShader = VK_SHADER_UNUSED_KHR,
-		.anyHitShader = VK_SHADER_UNUSED_KHR,
-		.intersectionShader = VK_SHADER_UNUSED_KHR,
-		.pShaderGroupCaptureReplayHandle = nullptr
-	};
-	groups.push_back(rgenGroup);
+	// groups share stages loaded from the same file
+	vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	unordered_map<string, uint32_t> stageIndices;
+	auto addStage = [&](VkShaderStageFlagBits stage, const char* path) -> uint32_t
+		{
+			if (path == nullptr) return VK_SHADER_UNUSED_KHR;
+
+			auto it = stageIndices.find(path);
+			if (it != stageIndices.end()) return it->second;
+
+			VkPipelineShaderStageCreateInfo stageInfo
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = stage,
+				.module = loadShaderModule(path),
+				.pName = "main"
+			};
+			shaderStages.push_back(stageInfo);
+
+			uint32_t index = static_cast<uint32_t>(shaderStages.size() - 1);
+			stageIndices[path] = index;
+			return index;
+		};
 
-	VkRayTracingShaderGroupCreateInfoKHR missGroup
-	{
-		.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-		.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
-		.generalShader = 1,
-		.closestHitShader = VK_SHADER_UNUSED_KHR,
-		.anyHitShader = VK_SHADER_UNUSED_KHR,
-		.intersectionShader = VK_SHADER_UNUSED_KHR,
-		.pShaderGroupCaptureReplayHandle = nullptr
-	};
-	groups.push_back(missGroup);
+	vector<VkRayTracingShaderGroupCreateInfoKHR> groups(HIT_GROUP_BASE + MATERIAL_CLASS_COUNT);
+	auto setGeneralGroup = [&](uint32_t group, VkShaderStageFlagBits stage, const char* path)
+		{
+			groups[group] =
+			{
+				.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+				.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+				.generalShader = addStage(stage, path),
+				.closestHitShader = VK_SHADER_UNUSED_KHR,
+				.anyHitShader = VK_SHADER_UNUSED_KHR,
+				.intersectionShader = VK_SHADER_UNUSED_KHR,
+				.pShaderGroupCaptureReplayHandle = nullptr
+			};
+		};
+	setGeneralGroup(RAYGEN_GROUP, VK_SHADER_STAGE_RAYGEN_BIT_KHR, "shaders/raygen.spv");
+	setGeneralGroup(MISS_GROUP, VK_SHADER_STAGE_MISS_BIT_KHR, "shaders/miss.spv");
+	setGeneralGroup(SHADOW_MISS_GROUP, VK_SHADER_STAGE_MISS_BIT_KHR, "shaders/shadow_miss.spv");
 
-	VkRayTracingShaderGroupCreateInfoKHR hitGroup
+	for (uint32_t i = 0; i < MATERIAL_CLASS_COUNT; i++)
 	{
-		.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-		.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
-		.generalShader = VK_SHADER_UNUSED_KHR,
-		.closestHitShader = 2,
-		.anyHitShader = VK_SHADER_UNUSED_KHR,
-		.intersectionShader = VK_SHADER_UNUSED_KHR,
-		.pShaderGroupCaptureReplayHandle = nullptr
-	};
-	groups.push_back(hitGroup);
-
-	VkRayTracingShaderGroupCreateInfoKHR shadowMissGroup{
-		.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-		.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
-		.generalShader = 3,
-		.closestHitShader = VK_SHADER_UNUSED_KHR,
-		.anyHitShader = VK_SHADER_UNUSED_KHR,
-		.intersectionShader = VK_SHADER_UNUSED_KHR
-	};
-	groups.push_back(shadowMissGroup);
+		groups[HIT_GROUP_BASE + i] =
+		{
+			.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+			.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
+			.generalShader = VK_SHADER_UNUSED_KHR,
+			.closestHitShader = addStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, hitGroupShaders[i].closestHit),
+			.anyHitShader = addStage(VK_SHADER_STAGE_ANY_HIT_BIT_KHR, hitGroupShaders[i].anyHit),
+			.intersectionShader = VK_SHADER_UNUSED_KHR,
+			.pShaderGroupCaptureReplayHandle = nullptr
+		};
+	}
 
 	VkRayTracingPipelineCreateInfoKHR rayTracingPipelineCI
 	{
@@ -385,119 +740,102 @@ void RayTracer::createPipeline()
 	};
 	VK_CHECK(device->vkCreateRayTracingPipelinesKHR(device->device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayTracingPipelineCI, nullptr, &pipeline));
 
-	vkDestroyShaderModule(device->device, shaderStages[0].module, nullptr);
-	vkDestroyShaderModule(device->device, shaderStages[1].module, nullptr);
-	vkDestroyShaderModule(device->device, shaderStages[2].module, nullptr);
-	vkDestroyShaderModule(device->device, shaderStages[3].module, nullptr);
+	for (auto& stage : shaderStages)
+	{
+		vkDestroyShaderModule(device->device, stage.module, nullptr);
+	}
 }
 
-static inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) 
+/*
+* One hit record per mesh in mesh order, the top level structure uses the mesh index as the sbt offset of its instances
+*/
+void RayTracer::createShaderBindingTable()
 {
-	return (v + a - 1) & ~(a - 1);
+	sbt->clear();
+
+	sbt->addRaygen(RAYGEN_GROUP);
+	sbt->addMiss(MISS_GROUP);
+	sbt->addMiss(SHADOW_MISS_GROUP);
+
+	for (auto& mesh : resources->meshes)
+	{
+		HitRecord record
+		{
+			.emission = mesh.emission,
+			.alphaCutoff = 0.5f
+		};
+		sbt->addHit(HIT_GROUP_BASE + mesh.materialClass, &record, sizeof(HitRecord));
+	}
+
+	sbt->build(pipeline, HIT_GROUP_BASE + MATERIAL_CLASS_COUNT);
 }
 
-void RayTracer::createShaderBindingTable()
+void RayTracer::draw(uint32_t index)
 {
-	VkPhysicalDeviceRayTracingPipelinePropertiesKHR props
-	{
-		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR
-	};
+	UnkCommandBuffer* commandBuffer = swapchain->frames[index].commandBuffer;
+	commandBuffer->beginCommand();
 
-	VkPhysicalDeviceProperties2 props2
-	{
-		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
-		&props
-	};
-	vkGetPhysicalDeviceProperties2(device->gpu, &props2);
+	resources->textures->recordSlots(commandBuffer);
 
-	sbt.handleSize = props.shaderGroupHandleSize;
-	sbt.handleAlign = props.shaderGroupHandleAlignment;
-	sbt.baseAlign = props.shaderGroupBaseAlignment;
+	VkSemaphore buildSemaphore = updateAccelerationStructures(index);
 
-	const uint32_t groupCount = 4;
-	vector<uint8_t> handles(groupCount * sbt.handleSize);
-	device->vkGetRayTracingShaderGroupHandlesKHR(device->device, pipeline, 0, groupCount, handles.size(), handles.data());
+	updateRenderScale(index);
 
-	VkDeviceSize rgenStride = alignUp(sbt.handleSize, sbt.handleAlign);
-	VkDeviceSize missStride = alignUp(sbt.handleSize, sbt.handleAlign);
-	VkDeviceSize hitStride = alignUp(sbt.handleSize, sbt.handleAlign);
+	// a converged image is only resolved again, no rays are traced
+	VkPipelineStageFlags resultStage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
 
-	VkDeviceSize rgenSize = rgenStride * 1;
-	VkDeviceSize missSize = missStride * 2;
-	VkDeviceSize hitSize = hitStride * 1;
+	// reservoirs carry the history in restir mode, every frame is traced as a first sample
+	constants.restir = useRestir ? 1 : 0;
+	if (useRestir)
+	{
+		resetAccumulation();
+	}
 
-	VkDeviceSize rgenOffset = 0;
-	VkDeviceSize missOffset = alignUp(rgenOffset + rgenSize, sbt.baseAlign);
-	VkDeviceSize hitOffset = alignUp(missOffset + missSize, sbt.baseAlign);
-	VkDeviceSize sbtSize = hitOffset + hitSize;
+	if (updateAccumulation())
+	{
+		constants.seed++;
 
-	std::vector<uint8_t> sbtBlob(sbtSize, 0);
-	auto put = [&](uint32_t groupIdx, VkDeviceSize regionOffset, VkDeviceSize recIndex, VkDeviceSize stride)
-		{
-			std::memcpy(sbtBlob.data() + regionOffset + recIndex * stride,
-				handles.data() + groupIdx * sbt.handleSize,
-				sbt.handleSize);
-		};
-	put(0, rgenOffset, 0, rgenStride);
-	put(1, missOffset, 0, missStride);
-	put(3, missOffset, 1, missStride);
-	put(2, hitOffset, 0, hitStride);
+		accumulationBarrier(commandBuffer);
 
-	sbt.sbtBuffer = new UnkBuffer
-	(
-		device,
-		sbtSize,
-		VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		0,
-		0,
-		sbtBlob.data()
-	);
+		vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR, 0, sizeof(RayPushConstants), &constants);
 
-	VkBufferDeviceAddressInfo ai{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, sbt.sbtBuffer->handle };
-	const VkDeviceAddress base = getBufferDeviceAddress(sbt.sbtBuffer->handle);
+		timestamps->begin(commandBuffer, index);
 
-	sbt.sbtRaygen = { base + rgenOffset, rgenStride, rgenSize };
-	sbt.sbtMiss = { base + missOffset, missStride, missSize };
-	sbt.sbtHit = { base + hitOffset , hitStride , hitSize };
-	sbt.sbtCallable = { 0, 0, 0 };
-}
+		device->vkCmdTraceRaysKHR
+		(
+			commandBuffer->handle,
+			&sbt->raygen,
+			&sbt->miss,
+			&sbt->hit,
+			&sbt->callable,
+			renderExtent.width,
+			renderExtent.height,
+			1
+		);
 
-void RayTracer::draw(uint32_t index)
-{
-	UnkCommandBuffer* commandBuffer = swapchain->frames[index].commandBuffer;
-	commandBuffer->beginCommand();
+		timestamps->end(commandBuffer, index, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
 
-	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
-	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		constants.frame++;
 
-	device->vkCmdTraceRaysKHR
-	(
-		commandBuffer->handle,
-		&sbt.sbtRaygen,
-		&sbt.sbtMiss,
-		&sbt.sbtHit,
-		&sbt.sbtCallable,
-		swapchain->extent.width,
-		swapchain->extent.height,
-		1
-	);
+		if (useRestir)
+		{
+			restir->record(commandBuffer, renderExtent, constants.gbufferIndex, constants.seed);
+			resultStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
 
-	swapchain->images[index]->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandBuffer);
+		if (denoise)
+		{
+			denoiser->record(commandBuffer, renderExtent, constants.gbufferIndex);
+			resultStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
 
-	VkImageCopy region
-	{
-	  .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-	  .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-	  .extent = { swapchain->extent.width, swapchain->extent.height, 1 }
-	};
-	vkCmdCopyImage(commandBuffer->handle,
-		resultImage->handle, VK_IMAGE_LAYOUT_GENERAL,
-		swapchain->images[index]->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1, &region);
+		// next frame writes the other gbuffer, this one becomes its history
+		constants.gbufferIndex = 1 - constants.gbufferIndex;
+	}
 
-	swapchain->images[index]->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, commandBuffer);
+	resolver->record(commandBuffer, index, resultStage, renderExtent);
 
 	commandBuffer->endCommand(false);
 
@@ -507,14 +845,21 @@ void RayTracer::draw(uint32_t index)
 		vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &swapchain->frames[index].swapchainReleaseSemaphore);
 	}
 
-	VkPipelineStageFlags waitStage{ VK_PIPELINE_STAGE_TRANSFER_BIT };
+	vector<VkSemaphore> waitSemaphores{ swapchain->frames[index].swapchainAcquireSemaphore };
+	vector<VkPipelineStageFlags> waitStages{ resolver->getWaitStage() };
+
+	if (buildSemaphore != VK_NULL_HANDLE)
+	{
+		waitSemaphores.push_back(buildSemaphore);
+		waitStages.push_back(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
 
 	VkSubmitInfo info
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &swapchain->frames[index].swapchainAcquireSemaphore,
-		.pWaitDstStageMask = &waitStage,
+		.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size()),
+		.pWaitSemaphores = waitSemaphores.data(),
+		.pWaitDstStageMask = waitStages.data(),
 		.commandBufferCount = 1,
 		.pCommandBuffers = &commandBuffer->handle,
 		.signalSemaphoreCount = 1,
@@ -530,16 +875,49 @@ void RayTracer::handleResize()
 		delete resultImage;
 	}
 
+	if (accumulationImage != nullptr)
+	{
+		delete accumulationImage;
+	}
+
+	// the image count may change with the swapchain
+	delete timestamps;
+	timestamps = new UnkTimestamps(device, static_cast<uint32_t>(swapchain->frames.size()));
+	filteredTraceTime = 0.0f;
+
+	updateRenderExtent();
 	createResultImage();
 
-	UnkImageDescriptor* descriptor = static_cast<UnkImageDescriptor*>(descriptors[RESULT_BINDING]);
+	UnkImageDescriptor* resultDescriptor = static_cast<UnkImageDescriptor*>(descriptors[RESULT_BINDING]);
+	resultDescriptor->images = { resultImage };
 
-	vector<UnkImage*> images;
-	images.push_back(resultImage);
-	descriptor->images = images;
+	UnkImageDescriptor* accumulationDescriptor = static_cast<UnkImageDescriptor*>(descriptors[ACCUMULATION_BINDING]);
+	accumulationDescriptor->images = { accumulationImage };
 
-	VkWriteDescriptorSet descriptorWrite = descriptor->getDescriptorWrite();
-	vkUpdateDescriptorSets(device->device, 1, &descriptorWrite, 0, nullptr);
+	denoiser->handleResize(resultImage);
+
+	UnkImageDescriptor* gbufferDescriptor = static_cast<UnkImageDescriptor*>(descriptors[GBUFFER_BINDING]);
+	gbufferDescriptor->images = { denoiser->gbuffer[0], denoiser->gbuffer[1] };
+
+	restir->handleResize(resultImage);
+
+	UnkBufferDescriptor* reservoirDescriptor = static_cast<UnkBufferDescriptor*>(descriptors[RESERVOIR_BINDING]);
+	reservoirDescriptor->buffer = restir->initialReservoirs;
+
+	UnkImageDescriptor* albedoDescriptor = static_cast<UnkImageDescriptor*>(descriptors[ALBEDO_BINDING]);
+	albedoDescriptor->images = { restir->albedoImage };
+
+	vector<VkWriteDescriptorSet> descriptorWrites
+	{
+		resultDescriptor->getDescriptorWrite(),
+		accumulationDescriptor->getDescriptorWrite(),
+		gbufferDescriptor->getDescriptorWrite(),
+		reservoirDescriptor->getDescriptorWrite(),
+		albedoDescriptor->getDescriptorWrite()
+	};
+	vkUpdateDescriptorSets(device->device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+	resolver->handleResize(resultImage);
 }
 
 uint64_t RayTracer::getBufferDeviceAddress(VkBuffer buffer)
@@ -555,18 +933,39 @@ uint64_t RayTracer::getBufferDeviceAddress(VkBuffer buffer)
 
 RayTracer::~RayTracer()
 {
+	delete resolver;
+	delete restir;
+	delete denoiser;
+	delete timestamps;
+
 	if (resultImage != nullptr)
 	{
 		delete resultImage;
 	}
 
-	delete sbt.sbtBuffer;
-	sbt.sbtBuffer = nullptr;
+	if (accumulationImage != nullptr)
+	{
+		delete accumulationImage;
+	}
+
+	delete sbt;
 
-	for (int i = 0; i < blasses.size(); i++)
+	if (pendingBuild != nullptr)
 	{
-		delete blasses[i];
+		UnkTlas* pendingTlas = pendingBuild->tlas;
+		delete pendingBuild;
+		delete pendingTlas;
+	}
+
+	if (acquiredBuild != nullptr)
+	{
+		delete acquiredBuild;
 	}
 
 	delete tlas;
+
+	for (int i = 0; i < blasses.size(); i++)
+	{
+		delete blasses[i];
+	}
 }
\ No newline at end of file
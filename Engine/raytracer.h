@@ -4,6 +4,12 @@
 #include "unk_blas.h"
 #include "unk_tlas.h"
 #include "unk_as_descriptor.h"
+#include "unk_as_build.h"
+#include "unk_sbt.h"
+#include "resolver.h"
+#include "unk_timestamps.h"
+#include "denoiser.h"
+#include "restir.h"
 
 using namespace glm;
 
@@ -19,29 +25,64 @@ enum
 	CAMERA_BINDING,
 	VERTEX_BINDING,
 	INDEX_BINDING,
-	TEXTURE_BINDING
+	ACCUMULATION_BINDING,
+	GBUFFER_BINDING,
+	LIGHT_CDF_BINDING,
+	RESERVOIR_BINDING,
+	ALBEDO_BINDING,
+	POSITION_BINDING,
+	INDEX16_BINDING,
+	FEEDBACK_BINDING,
+	TEXTURE_SLOT_BINDING,
+	TEXTURE_BINDING // variable count, must stay last
 };
 
-struct ShaderBindingTable
+// shader groups, the hit groups follow in MaterialClass order
+enum
 {
-	uint32_t handleSize;
-	uint32_t handleAlign;
-	uint32_t baseAlign;
-
-	UnkBuffer* sbtBuffer;
-	VkDeviceAddress sbtBase = 0;
-	VkStridedDeviceAddressRegionKHR sbtRaygen{}, sbtMiss{}, sbtHit{}, sbtCallable{};
+	RAYGEN_GROUP,
+	MISS_GROUP,
+	SHADOW_MISS_GROUP,
+	HIT_GROUP_BASE
 };
 
 class RayTracer : public Pipeline
 {
 public:
 	UnkImage* resultImage;
+	UnkImage* accumulationImage = nullptr;
+	Resolver* resolver = nullptr;
+
+	Denoiser* denoiser = nullptr;
+	bool denoise = true; // toggled with N
+
+	// resample direct lighting across pixels and frames instead of shading each hit on its own
+	Restir* restir = nullptr;
+	bool useRestir = false; // toggled with R
+
+	// progressive accumulation, restarted when the camera or scene changes
+	RayPushConstants constants{};
+	CameraGPU accumulatedCamera{};
+	uint32_t sampleBudget = 1024;
+
+	// dynamic resolution, rays are traced into the top left renderExtent region of the output images
+	VkExtent2D renderExtent{};
+	float renderScale = 1.0f;
+	float minRenderScale = 0.5f;
+	float targetTraceTime = 12.0f; // milliseconds
+	float filteredTraceTime = 0.0f;
+	UnkTimestamps* timestamps = nullptr;
 
 	vector<UnkBlas*> blasses;
-	UnkTlas* tlas;
+	UnkTlas* tlas = nullptr;
+	uint32_t tlasGeneration = 0; // incremented whenever tlas is swapped
 
-	ShaderBindingTable sbt;
+	UnkAsBuild* pendingBuild = nullptr; // build in flight on the compute queue
+	UnkAsBuild* acquiredBuild = nullptr; // completed build whose semaphore is waited on by a graphics submit
+	uint32_t acquiredFrame = 0;
+	bool rebuildRequested = false;
+
+	UnkSbt* sbt = nullptr;
 
 	RayTracer() = default;
 
@@ -51,6 +92,20 @@ public:
 
 	void createResultImage();
 
+	void resetAccumulation();
+
+	bool updateAccumulation();
+
+	void accumulationBarrier(UnkCommandBuffer* commandBuffer);
+
+	void setRestir(bool enabled);
+
+	void setDenoise(bool enabled);
+
+	void updateRenderExtent();
+
+	void updateRenderScale(uint32_t imageIndex);
+
 	void createDescriptorSets();
 
 	void createPipeline();
@@ -61,8 +116,12 @@ public:
 
 	void draw(uint32_t imageIndex);
 
+	bool isReady();
+
 	void createAccelerationStructures();
 
+	VkSemaphore updateAccelerationStructures(uint32_t imageIndex);
+
 	// util
 	uint64_t getBufferDeviceAddress(VkBuffer buffer);
 
@@ -44,16 +44,6 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
 }
 #endif
 
-namespace std {
-	template<> struct hash<Vertex> {
-		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.position) ^
-				(hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
-		}
-	};
-}
-
 Renderer::Renderer(GLFWwindow* window, uint32_t width, uint32_t height)
 {
 	this->window = window;
@@ -64,6 +54,16 @@ Renderer::Renderer(GLFWwindow* window, uint32_t width, uint32_t height)
 
 	createDevice();
 
+	// the default pipeline could not report what it samples, coarse levels would never be refined
+	if (!device->fragmentStoresAndAtomics)
+	{
+		streamTextures = false;
+	}
+
+	// the sampler is created with the other device resources, before any pipeline writes the texture array
+	deviceResources.textures = new TextureRegistry(device, &deviceResources.sampler);
+	textureStreamer = new TextureStreamer(device, deviceResources.textures);
+
 	this->swapchain = new UnkSwapchain(device, &surface, window);
 }
 
@@ -226,11 +226,18 @@ VkPhysicalDevice Renderer::selectPhysicalDevice(vector<const char*> requiredExte
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_VALIDATION_FEATURES_NV,
 		};
 
-		// accelerationStructure -> validation
+		// rayQuery -> validation
+		VkPhysicalDeviceRayQueryFeaturesKHR rayQueryProbe
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
+			.pNext = &validationProbe,
+		};
+
+		// accelerationStructure -> rayQuery
 		VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureProbe
 		{
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
-			.pNext = &validationProbe,
+			.pNext = &rayQueryProbe,
 		};
 
 		// rayTracingPipeline -> accelerationStructure
@@ -280,7 +287,8 @@ VkPhysicalDevice Renderer::selectPhysicalDevice(vector<const char*> requiredExte
 			descriptorIndexingProbe.shaderSampledImageArrayNonUniformIndexing &&
 			bufferDeviceAddressProbe.bufferDeviceAddress &&
 			rayTracingPipelineProbe.rayTracingPipeline &&
-			accelerationStructureProbe.accelerationStructure;
+			accelerationStructureProbe.accelerationStructure &&
+			rayQueryProbe.rayQuery;
 
 		if (!valid) continue;
 
@@ -301,10 +309,55 @@ void Renderer::createDevice()
 		VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
 		VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
 		VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+		VK_KHR_RAY_QUERY_EXTENSION_NAME,
 	};
 
 	VkPhysicalDevice physicalDevice = selectPhysicalDevice(enabledExtensions);
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+	// mesh shading is optional, the rasterizer keeps its indirect draws without it
+	auto availableExtensions = VK_ENUMERATE<VkExtensionProperties>(vkEnumerateDeviceExtensionProperties, physicalDevice, nullptr);
+	bool meshShaderExtension = VK_VALIDATE({ VK_EXT_MESH_SHADER_EXTENSION_NAME }, availableExtensions, getExtensionName);
+
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderProbe
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT
+	};
+
+	if (meshShaderExtension)
+	{
+		VkPhysicalDeviceFeatures2 probe2
+		{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &meshShaderProbe
+		};
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &probe2);
+	}
+
+	// texture slots are written while frames in flight sample the rest of the array, otherwise the device is idled first
+	VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingSupport
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES
+	};
+	VkPhysicalDeviceFeatures2 indexingProbe2
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &descriptorIndexingSupport
+	};
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &indexingProbe2);
+
+	bool textureUpdateAfterBind =
+		descriptorIndexingSupport.descriptorBindingSampledImageUpdateAfterBind &&
+		descriptorIndexingSupport.descriptorBindingUpdateUnusedWhilePending;
+
+	bool meshShaderSupported = meshShaderExtension && meshShaderProbe.taskShader && meshShaderProbe.meshShader;
+	if (meshShaderSupported)
+	{
+		enabledExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	}
+
 	// end of pNext chain
 	VkPhysicalDeviceRayTracingValidationFeaturesNV validation
 	{
@@ -313,11 +366,19 @@ void Renderer::createDevice()
 		.rayTracingValidation = VK_TRUE
 	};
 
-	// accelerationStructure -> validation
+	// rayQuery -> validation
+	VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
+		.pNext = &validation,
+		.rayQuery = VK_TRUE
+	};
+
+	// accelerationStructure -> rayQuery
 	VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures
 	{
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
-		.pNext = &validation,
+		.pNext = &rayQueryFeatures,
 		.accelerationStructure = VK_TRUE
 	};
 
@@ -341,6 +402,8 @@ void Renderer::createDevice()
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
 		.pNext = &bufferDeviceAddressFeatures,
 		.shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+		.descriptorBindingSampledImageUpdateAfterBind = textureUpdateAfterBind,
+		.descriptorBindingUpdateUnusedWhilePending = textureUpdateAfterBind,
 		.descriptorBindingPartiallyBound = VK_TRUE,
 		.descriptorBindingVariableDescriptorCount = VK_TRUE,
 		.runtimeDescriptorArray = VK_TRUE,
@@ -354,16 +417,28 @@ void Renderer::createDevice()
 		.shaderDrawParameters = VK_TRUE
 	};
 
-	// features2 -> features11
+	// meshShader -> features11
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+		.pNext = &features11,
+		.taskShader = VK_TRUE,
+		.meshShader = VK_TRUE
+	};
+
+	// features2 -> meshShader when supported, otherwise features11
 	VkPhysicalDeviceFeatures2 features2
 	{
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-		.pNext = &features11,
+		.pNext = meshShaderSupported ? static_cast<void*>(&meshShaderFeatures) : static_cast<void*>(&features11),
 		.features = 
 		{
 			.multiDrawIndirect = VK_TRUE,
 			.drawIndirectFirstInstance = VK_TRUE,
 			.samplerAnisotropy = VK_TRUE,
+			.textureCompressionBC = supportedFeatures.textureCompressionBC, // baked textures, uncompressed ones are uploaded otherwise
+			.fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics, // texture feedback from rasterized pipelines
+			.shaderStorageImageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat, // resolve directly into swapchain images
 		}
 	};
 
@@ -376,6 +451,11 @@ void Renderer::createDevice()
 		enabledExtensions, 
 		&features2
 	);
+
+	device->meshShaderSupported = meshShaderSupported;
+	device->textureCompressionBC = supportedFeatures.textureCompressionBC;
+	device->textureUpdateAfterBind = textureUpdateAfterBind;
+	device->fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
 }
 
 /*
@@ -385,8 +465,16 @@ void Renderer::createDevice()
 void Renderer::createPipeline()
 {
 	createDeviceResources();
+	rayTracer = new RayTracer(device, swapchain, &deviceResources);
+
 	pipelines.push_back(new Rasterizer(device, swapchain, &deviceResources));
-	pipelines.push_back(new RayTracer(device, swapchain, &deviceResources));
+	pipelines.push_back(rayTracer);
+
+	// hybrid: rasterized visibility, shadows queried against the ray tracer's acceleration structures
+	pipelines.push_back(new Rasterizer(device, swapchain, &deviceResources, rayTracer));
+
+	pipelines.push_back(new VisBuffer(device, swapchain, &deviceResources));
+	pipelines.push_back(new Deferred(device, swapchain, &deviceResources));
 
 	currPipeline = 0;
 }
@@ -395,7 +483,7 @@ void Renderer::switchPipeline()
 {
 	vkDeviceWaitIdle(device->device);
 
-	currPipeline = (currPipeline + 1) % 2;
+	currPipeline = (currPipeline + 1) % pipelines.size();
 }
 
 void Renderer::createDeviceResources()
@@ -441,6 +529,8 @@ void Renderer::createDeviceResources()
 		deviceResources.dirLights.data()
 	);
 
+	createLightCdf();
+
 
 	deviceResources.cameraBuffer = new UnkBuffer
 	(
@@ -451,14 +541,44 @@ void Renderer::createDeviceResources()
 		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
 	);
 
-	// create indirect command SSBO
+	// create indirect command SSBO, grouped so each run of draws binds one index pool and one culling mode
+	// every group has room for one draw per instance, selectLods rewrites the commands each frame
 	vector<VkDrawIndexedIndirectCommand> drawCommands;
-	for (int i = 0; i < deviceResources.meshes.size(); i++)
+	deviceResources.drawGroups.clear();
+	for (VkIndexType indexType : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 })
+	{
+		for (bool doubleSided : { false, true })
+		{
+			DrawGroup group
+			{
+				.indexType = indexType,
+				.doubleSided = doubleSided,
+				.firstDraw = static_cast<uint32_t>(drawCommands.size())
+			};
+
+			uint32_t capacity = 0;
+			for (uint32_t i = 0; i < deviceResources.meshes.size(); i++)
+			{
+				Mesh& mesh = deviceResources.meshes[i];
+				if (mesh.indexType != indexType || mesh.doubleSided != doubleSided || mesh.instanceCount == 0) continue;
+
+				group.meshes.push_back(i);
+				drawCommands.push_back(mesh.getDrawCommand());
+				capacity += mesh.instanceCount;
+			}
+
+			group.drawCount = static_cast<uint32_t>(drawCommands.size()) - group.firstDraw;
+			drawCommands.resize(group.firstDraw + capacity);
+
+			if (group.drawCount > 0) deviceResources.drawGroups.push_back(group);
+		}
+	}
+
+	// the buffer can not be empty
+	if (drawCommands.empty())
 	{
-		drawCommands.push_back(deviceResources.meshes[i].getDrawCommand());
+		drawCommands.push_back(VkDrawIndexedIndirectCommand{});
 	}
-	VkDeviceSize drawCommandBufferSize = drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
-	VmaAllocationInfo drawCommandInfo;
 
 	deviceResources.drawCommandBuffer = new UnkBuffer
 	(
@@ -470,6 +590,25 @@ void Renderer::createDeviceResources()
 		drawCommands.data()
 	);
 
+	// full detail until the first selection
+	deviceResources.instanceLods.clear();
+	for (const Instance& entry : deviceResources.instances)
+	{
+		deviceResources.instanceLods.push_back(entry.baseIndex);
+	}
+
+	deviceResources.instanceLodBuffer = new UnkBuffer
+	(
+		device,
+		deviceResources.instanceLods.size() * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		deviceResources.instanceLods.data()
+	);
+
+	createMeshletTasks();
+
 	// create and set texture sampler
 	VkPhysicalDeviceProperties properties{};
 	vkGetPhysicalDeviceProperties(device->gpu, &properties);
@@ -488,30 +627,102 @@ void Renderer::createDeviceResources()
 		.compareEnable = VK_FALSE,
 		.compareOp = VK_COMPARE_OP_ALWAYS,
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		.maxLod = VK_LOD_CLAMP_NONE, // textures carry full mip chains
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 		.unnormalizedCoordinates = VK_FALSE
 	};
 	vkCreateSampler(device->device, &samplerInfo, nullptr, &deviceResources.sampler);
 
-	for (auto& textureImage : deviceResources.textureImages)
+	// written by shaders and read by the streamer every frame, so it stays mapped, sized for textures added later
+	deviceResources.textureFeedbackBuffer = new UnkBuffer
+	(
+		device,
+		deviceResources.textures->capacity * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
+	);
+	memset(deviceResources.textureFeedbackBuffer->base.pMappedData, 0, deviceResources.textureFeedbackBuffer->size);
+}
+
+/*
+* Builds the cumulative distribution used to importance sample lights by power
+* Directional lights do not fall off, weight them as a point light at unit distance
+*/
+void Renderer::createLightCdf()
+{
+	vector<float>& cdf = deviceResources.lightCdf;
+	cdf.clear();
+
+	auto luminance = [](const vec3& color) { return dot(color, vec3(0.2126f, 0.7152f, 0.0722f)); };
+
+	float total = 0.0f;
+	for (const auto& light : deviceResources.pointLights)
+	{
+		total += luminance(light.color) / (light.constant + light.linear + light.quadratic);
+		cdf.push_back(total);
+	}
+
+	for (const auto& light : deviceResources.dirLights)
+	{
+		total += luminance(light.color);
+		cdf.push_back(total);
+	}
+
+	for (auto& value : cdf)
+	{
+		value = total > 0.0f ? value / total : 1.0f;
+	}
+
+	// the buffer can not be empty
+	if (cdf.empty())
 	{
-		textureImage->sampler = &deviceResources.sampler;
+		cdf.push_back(1.0f);
 	}
+
+	deviceResources.lightCdfBuffer = new UnkBuffer
+	(
+		device,
+		cdf.size() * sizeof(float),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		0,
+		0,
+		cdf.data()
+	);
 }
 
-void Renderer::createVertexBuffers(vector<Vertex>& vertices, vector<uint32_t>& indices)
+/*
+* Meshes are split between a 32 bit and a 16 bit index pool, both are bound as index and storage buffers
+* Positions and indices are concurrent, acceleration structure builds on the compute queue read them while the graphics queue draws
+*/
+void Renderer::createVertexBuffers(vector<vec3>& positions, vector<VertexAttributes>& attributes, vector<uint32_t>& indices, vector<uint16_t>& indices16)
 {
-	deviceResources.vertexBuffer = new UnkBuffer
+	deviceResources.positionBuffer = new UnkBuffer
 	(
 		device,
-		vertices.size() * sizeof(Vertex),
+		positions.size() * sizeof(vec3),
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		0,
 		0,
-		vertices.data()
+		positions.data(),
+		false,
+		true
+	);
+
+	deviceResources.attributeBuffer = new UnkBuffer
+	(
+		device,
+		attributes.size() * sizeof(VertexAttributes),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		attributes.data()
 	);
 
+	// the buffers can not be empty, and shaders read the 16 bit pool a uint at a time
+	if (indices.empty()) indices.push_back(0);
+	if (indices16.empty() || indices16.size() % 2 != 0) indices16.push_back(0);
+
 	deviceResources.indexBuffer = new UnkBuffer
 	(
 		device,
@@ -519,11 +730,126 @@ void Renderer::createVertexBuffers(vector<Vertex>& vertices, vector<uint32_t>& i
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		0,
 		0,
-		indices.data()
+		indices.data(),
+		false,
+		true
+	);
+
+	deviceResources.index16Buffer = new UnkBuffer
+	(
+		device,
+		indices16.size() * sizeof(uint16_t),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		indices16.data(),
+		false,
+		true
+	);
+}
+
+/*
+* Meshlets of the full detail triangles, read by the task and mesh shaders of the rasterizer
+*/
+void Renderer::createMeshletBuffers(vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles)
+{
+	// the buffers can not be empty
+	if (meshlets.empty()) meshlets.push_back(Meshlet{});
+	if (meshletVertices.empty()) meshletVertices.push_back(0);
+	if (meshletTriangles.empty()) meshletTriangles.push_back(0);
+
+	deviceResources.meshletBuffer = new UnkBuffer
+	(
+		device,
+		meshlets.size() * sizeof(Meshlet),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		meshlets.data()
+	);
+
+	deviceResources.meshletVertexBuffer = new UnkBuffer
+	(
+		device,
+		meshletVertices.size() * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		meshletVertices.data()
+	);
+
+	deviceResources.meshletTriangleBuffer = new UnkBuffer
+	(
+		device,
+		meshletTriangles.size() * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		meshletTriangles.data()
 	);
 }
 
-void Renderer::createTexture(void* data, uint32_t width, uint32_t height)
+/*
+* Every instance's meshlets are cut into tasks of up to MESHLETS_PER_TASK, one task shader workgroup each
+* Each level gets its own tasks, only those of the level in instanceLods draw, coarse levels add few workgroups
+* Tasks of single sided meshes come first so they can be drawn with back face culling in one range
+*/
+void Renderer::createMeshletTasks()
+{
+	vector<MeshletTask>& tasks = deviceResources.meshletTasks;
+	tasks.clear();
+
+	for (bool doubleSided : { false, true })
+	{
+		for (const Mesh& mesh : deviceResources.meshes)
+		{
+			if (mesh.doubleSided != doubleSided) continue;
+
+			uint32_t indexFlag = mesh.indexType == VK_INDEX_TYPE_UINT16 ? INSTANCE_INDEX_16 : 0u;
+
+			for (uint32_t i = mesh.firstInstance; i < mesh.firstInstance + mesh.instanceCount; i++)
+			{
+				for (const MeshLod& lod : mesh.lods)
+				{
+					for (uint32_t first = 0; first < lod.meshletCount; first += MESHLETS_PER_TASK)
+					{
+						tasks.push_back(MeshletTask
+						{
+							.instance = i,
+							.firstMeshlet = lod.firstMeshlet + first,
+							.meshletCount = std::min(MESHLETS_PER_TASK, lod.meshletCount - first),
+							.lodBase = lod.firstIndex | indexFlag
+						});
+					}
+				}
+			}
+		}
+
+		if (!doubleSided)
+		{
+			deviceResources.singleSidedTaskCount = static_cast<uint32_t>(tasks.size());
+		}
+	}
+
+	// the buffer can not be empty, draws never reach past the real tasks
+	vector<MeshletTask> data = tasks;
+	if (data.empty())
+	{
+		data.push_back(MeshletTask{});
+	}
+
+	deviceResources.meshletTaskBuffer = new UnkBuffer
+	(
+		device,
+		data.size() * sizeof(MeshletTask),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		0,
+		0,
+		data.data()
+	);
+}
+
+uint32_t Renderer::createTexture(void* data, uint32_t width, uint32_t height)
 {
 	// create texture image
 	UnkImage* textureImage = new UnkImage
@@ -535,22 +861,91 @@ void Renderer::createTexture(void* data, uint32_t width, uint32_t height)
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		true,
-		data
+		data,
+		true
+	);
+	return deviceResources.textures->add(textureImage);
+}
+
+/*
+* Uploads a baked texture as is, block compressed levels included
+*/
+uint32_t Renderer::createTexture(const BakedTexture& texture)
+{
+	if (streamTextures)
+	{
+		return textureStreamer->add(texture);
+	}
+
+	UnkImage* textureImage = new UnkImage
+	(
+		device,
+		texture.width,
+		texture.height,
+		texture.format,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true,
+		texture.data.data(),
+		texture.data.size(),
+		texture.levelOffsets
+	);
+	return deviceResources.textures->add(textureImage);
+}
+
+/*
+* Reads a container's levels from disk straight into the staging buffer, nothing is decoded
+*/
+uint32_t Renderer::createTexture(const TextureFile& file)
+{
+	if (streamTextures)
+	{
+		return textureStreamer->add(file);
+	}
+
+	UnkImage* textureImage = new UnkImage
+	(
+		device,
+		file.width,
+		file.height,
+		file.format,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true,
+		file.dataSize,
+		file.levelOffsets,
+		[&](void* staging) { TextureContainer::readLevels(file, staging); }
 	);
-	deviceResources.textureImages.push_back(textureImage);
+	return deviceResources.textures->add(textureImage);
 }
 
-void Renderer::updateInstances(Camera camera, float deltaTime)
+void Renderer::updateInstances(Camera camera, float deltaTime, uint32_t imageIndex)
 {
 	static float totalDelta;
 	totalDelta += deltaTime;
 
+	deviceResources.frame++;
+
 	CameraGPU camGPU;
 
 	camGPU.viewInv = camera.transform.getWorldMatrix();
-	mat4 proj = perspective(radians(45.0f), swapchain->extent.width / (float)swapchain->extent.height, 0.1f, 10000.0f);
+	mat4 proj = perspective(radians(FIELD_OF_VIEW), swapchain->extent.width / (float)swapchain->extent.height, NEAR_PLANE, FAR_PLANE);
 	proj[1][1] *= -1;
 	camGPU.projInv = inverse(proj);
+	camGPU.fieldOfView = radians(FIELD_OF_VIEW);
+
+	mat4 viewProj = proj * camera.getViewMatrix();
+	if (!hasPrevCamera)
+	{
+		prevViewProj = viewProj;
+		prevPosition = camera.transform.position;
+		hasPrevCamera = true;
+	}
+
+	camGPU.prevViewProj = prevViewProj;
+	camGPU.prevPosition = vec4(prevPosition, 1.0f);
+	deviceResources.viewChanged = viewProj != prevViewProj;
+
+	prevViewProj = viewProj;
+	prevPosition = camera.transform.position;
 
 	VkDeviceSize size = deviceResources.transforms.size() * sizeof(MVP);
 	uint8_t* base = static_cast<uint8_t*>(deviceResources.transformBuffer->stagingBase.pMappedData);
@@ -570,6 +965,101 @@ void Renderer::updateInstances(Camera camera, float deltaTime)
 	deviceResources.transformBuffer->stage();
 
 	memcpy(deviceResources.cameraBuffer->base.pMappedData, &camGPU, sizeof(CameraGPU));
+
+	selectLods(camera, proj, imageIndex);
+}
+
+/*
+* Picks per instance the coarsest level whose simplification error projects to at most lodErrorThreshold pixels,
+* using the distance to the nearest point of the instance's bounding sphere
+* Consecutive instances of a mesh at the same level share one draw command, ray tracing keeps the full meshes
+* The results go to the acquired image's staging buffers, the frame last drawn with it is done with them
+*/
+void Renderer::selectLods(const Camera& camera, const mat4& proj, uint32_t imageIndex)
+{
+	while (deviceResources.drawCommandStaging.size() < swapchain->frames.size())
+	{
+		deviceResources.drawCommandStaging.push_back(new UnkBuffer
+		(
+			device,
+			deviceResources.drawCommandBuffer->size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
+		));
+
+		deviceResources.instanceLodStaging.push_back(new UnkBuffer
+		(
+			device,
+			deviceResources.instanceLodBuffer->size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
+		));
+	}
+
+	// pixels covered by one unit at unit distance
+	const float pixelScale = 0.5f * swapchain->extent.height * abs(proj[1][1]);
+
+	auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(deviceResources.drawCommandStaging[imageIndex]->base.pMappedData);
+
+	for (DrawGroup& group : deviceResources.drawGroups)
+	{
+		group.drawCount = 0;
+
+		for (uint32_t meshIndex : group.meshes)
+		{
+			Mesh& mesh = deviceResources.meshes[meshIndex];
+			uint32_t indexFlag = mesh.indexType == VK_INDEX_TYPE_UINT16 ? INSTANCE_INDEX_16 : 0u;
+			uint32_t runLod = UINT32_MAX;
+
+			for (uint32_t i = mesh.firstInstance; i < mesh.firstInstance + mesh.instanceCount; i++)
+			{
+				const mat4& model = deviceResources.transforms[deviceResources.instances[i].transformIndex].model;
+				float scale = std::max({ length(vec3(model[0])), length(vec3(model[1])), length(vec3(model[2])) });
+				vec3 center = vec3(model * vec4(mesh.boundsCenter, 1.0f));
+				float viewDistance = std::max(length(center - camera.transform.position) - mesh.boundsRadius * scale, NEAR_PLANE);
+
+				uint32_t lod = 0;
+				while (!fullDetail && lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * scale / viewDistance * pixelScale <= lodErrorThreshold)
+				{
+					lod++;
+				}
+
+				deviceResources.instanceLods[i] = mesh.lods[lod].firstIndex | indexFlag;
+
+				if (lod == runLod)
+				{
+					commands[group.firstDraw + group.drawCount - 1].instanceCount++;
+					continue;
+				}
+
+				commands[group.firstDraw + group.drawCount++] = mesh.getDrawCommand(lod, i, 1);
+				runLod = lod;
+			}
+		}
+	}
+
+	memcpy(deviceResources.instanceLodStaging[imageIndex]->base.pMappedData, deviceResources.instanceLods.data(), deviceResources.instanceLods.size() * sizeof(uint32_t));
+}
+
+/*
+* The fence of the acquired image was just waited, its last frame and every frame submitted before it are done
+* Textures retired up to that frame are released before the streamer replaces more
+*/
+void Renderer::updateTextures(uint32_t imageIndex)
+{
+	if (submittedFrames.size() < swapchain->frames.size())
+	{
+		submittedFrames.resize(swapchain->frames.size(), 0);
+	}
+
+	deviceResources.textures->update(deviceResources.frame, submittedFrames[imageIndex]);
+
+	if (streamTextures)
+	{
+		textureStreamer->update(deviceResources.frame, static_cast<uint32_t*>(deviceResources.textureFeedbackBuffer->base.pMappedData));
+	}
 }
 
 /*
@@ -585,7 +1075,12 @@ void Renderer::render(Camera camera, float deltaTime)
 	if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR)
 	{
 		swapchain->resize();
-		pipelines[currPipeline]->handleResize();
+
+		for (auto& pipeline : pipelines)
+		{
+			pipeline->handleResize();
+		}
+
 		res = swapchain->acquireImage(&index);
 	}
 
@@ -595,9 +1090,20 @@ void Renderer::render(Camera camera, float deltaTime)
 		return;
 	}
 
-	updateInstances(camera, deltaTime);
+	// keep rasterizing while the selected pipeline's acceleration structures build on the compute queue
+	Pipeline* pipeline = pipelines[currPipeline];
+	if (!pipeline->isReady())
+	{
+		pipeline = pipelines[0];
+	}
+	fullDetail = pipeline->needsFullDetail();
+
+	updateInstances(camera, deltaTime, index);
 
-	pipelines[currPipeline]->draw(index);
+	updateTextures(index);
+
+	pipeline->draw(index);
+	submittedFrames[index] = deviceResources.frame;
 	
 	res = swapchain->presentImage(&index);
 
@@ -629,6 +1135,9 @@ Renderer::~Renderer()
 	
 	delete swapchain;
 
+	// images it swapped in are owned by the device resources
+	delete textureStreamer;
+
 	if (surface != VK_NULL_HANDLE)
 	{
 		vkDestroySurfaceKHR(instance, surface, nullptr);
@@ -5,7 +5,12 @@
 
 #include "rasterizer.h"
 #include "raytracer.h"
+#include "visbuffer.h"
+#include "deferred.h"
 #include "structs.h"
+#include "texture_baker.h"
+#include "texture_container.h"
+#include "texture_streamer.h"
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -38,9 +43,28 @@ public:
 
 	vector<Pipeline*> pipelines;
 	uint32_t currPipeline;
+	RayTracer* rayTracer = nullptr; // one of pipelines, its options are toggled from input
 	
 	DeviceResources deviceResources;
 
+	// camera of the last rendered frame
+	mat4 prevViewProj;
+	vec3 prevPosition;
+	bool hasPrevCamera = false;
+
+	float lodErrorThreshold = 1.0f; // pixels of simplification error accepted before a finer level is drawn
+	bool fullDetail = false; // set for pipelines that need level 0 everywhere, see Pipeline::needsFullDetail
+
+	// projection of every pipeline
+	static constexpr float NEAR_PLANE = 0.1f;
+	static constexpr float FAR_PLANE = 10000.0f;
+	static constexpr float FIELD_OF_VIEW = 45.0f; // vertical, degrees
+
+	TextureStreamer* textureStreamer;
+	bool streamTextures = true; // baked and container textures start at their coarse levels, fine ones follow feedback, off without fragment stores
+
+	vector<uint32_t> submittedFrames; // by swapchain image, the frame last submitted with it
+
 	// initialization
 
 	void createInstance();
@@ -57,9 +81,25 @@ public:
 
 	void createDeviceResources();
 
-	void updateInstances(Camera camera, float deltaTime);
+	void createLightCdf();
+
+	void updateInstances(Camera camera, float deltaTime, uint32_t imageIndex);
+
+	void selectLods(const Camera& camera, const mat4& proj, uint32_t imageIndex);
+
+	void updateTextures(uint32_t imageIndex);
+
+	void createVertexBuffers(vector<vec3>& positions, vector<VertexAttributes>& attributes, vector<uint32_t>& indices, vector<uint16_t>& indices16);
+
+	void createMeshletBuffers(vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles);
+
+	void createMeshletTasks();
+
+	// each returns the id of the texture in the registry
+
+	uint32_t createTexture(void* data, uint32_t width, uint32_t height);
 
-	void createVertexBuffers(vector<Vertex>& vertices, vector<uint32_t>& indices);
+	uint32_t createTexture(const BakedTexture& texture);
 
-	void createTexture(void* data, uint32_t width, uint32_t height);
+	uint32_t createTexture(const TextureFile& file);
 };
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "resolver.h"
+#include "pipeline.h"
+
+using namespace std;
+
+Resolver::Resolver(UnkDevice* device, UnkSwapchain* swapchain, UnkImage* source)
+{
+	this->device = device;
+	this->swapchain = swapchain;
+	this->source = source;
+
+	constants =
+	{
+		.tonemap = 1,
+		.encodeSrgb = swapchain->surfaceFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR ? 1u : 0u,
+		.exposure = 1.0f,
+		.sharpness = 0.25f
+	};
+
+	if (!usesStorage()) return;
+
+	createDescriptorSets();
+	createPipeline();
+}
+
+bool Resolver::usesStorage()
+{
+	return swapchain->storageSupported;
+}
+
+void Resolver::createDescriptorSets()
+{
+	enum
+	{
+		SOURCE_BINDING,
+		TARGET_BINDING
+	};
+
+	const uint32_t imageCount = static_cast<uint32_t>(swapchain->images.size());
+	descriptorSets.resize(imageCount);
+
+	vector<VkDescriptorSetLayoutBinding> bindings;
+
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		vector<UnkImage*> sourceImages{ source };
+		UnkDescriptor* sourceDescriptor = new UnkImageDescriptor
+		(
+			sourceImages,
+			&descriptorSets[i],
+			SOURCE_BINDING,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			VK_IMAGE_LAYOUT_GENERAL
+		);
+		descriptors.push_back(sourceDescriptor);
+
+		vector<UnkImage*> targetImages{ swapchain->images[i] };
+		UnkDescriptor* targetDescriptor = new UnkImageDescriptor
+		(
+			targetImages,
+			&descriptorSets[i],
+			TARGET_BINDING,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			VK_IMAGE_LAYOUT_GENERAL
+		);
+		descriptors.push_back(targetDescriptor);
+
+		if (i == 0)
+		{
+			bindings.push_back(sourceDescriptor->getLayoutBinding());
+			bindings.push_back(targetDescriptor->getLayoutBinding());
+		}
+	}
+
+	if (descriptorSetLayout == VK_NULL_HANDLE)
+	{
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()
+		};
+		VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+	}
+
+	VkDescriptorPoolSize poolSize
+	{
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.descriptorCount = 2 * imageCount
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = imageCount,
+		.poolSizeCount = 1,
+		.pPoolSizes = &poolSize,
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	vector<VkDescriptorSetLayout> layouts(imageCount, descriptorSetLayout);
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = imageCount,
+		.pSetLayouts = layouts.data()
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, descriptorSets.data()));
+
+	// link descriptors to image handles
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void Resolver::destroyDescriptorSets()
+{
+	if (descriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(device->device, descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+	}
+
+	for (auto& descriptor : descriptors)
+	{
+		delete descriptor;
+	}
+	descriptors.clear();
+	descriptorSets.clear();
+}
+
+void Resolver::createPipeline()
+{
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(ResolvePushConstants)
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	VkShaderModule shaderModule = Pipeline::loadShaderModule(device, "shaders/resolve.spv");
+
+	VkComputePipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+	vkDestroyShaderModule(device->device, shaderModule, nullptr);
+}
+
+/*
+* Swapchain images and the source image are recreated on resize, rebuild the per image descriptor sets
+*/
+void Resolver::handleResize(UnkImage* source)
+{
+	this->source = source;
+
+	if (!usesStorage()) return;
+
+	destroyDescriptorSets();
+	createDescriptorSets();
+}
+
+VkPipelineStageFlags Resolver::getWaitStage()
+{
+	return usesStorage() ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
+
+/*
+* Records the resolve of the source image region (in GENERAL layout, last written at sourceStage) into the swapchain image
+* and leaves the swapchain image ready for presentation
+*/
+void Resolver::record(UnkCommandBuffer* commandBuffer, uint32_t index, VkPipelineStageFlags sourceStage, VkExtent2D sourceExtent)
+{
+	bool upscale = sourceExtent.width != swapchain->extent.width || sourceExtent.height != swapchain->extent.height;
+
+	UnkImage* target = swapchain->images[index];
+
+	VkMemoryBarrier sourceBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = usesStorage() ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer->handle, sourceStage, getWaitStage(), 0, 1, &sourceBarrier, 0, nullptr, 0, nullptr);
+
+	if (!usesStorage())
+	{
+		target->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandBuffer);
+
+		VkImageBlit region
+		{
+			.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+			.srcOffsets = { { 0, 0, 0 }, { static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height), 1 } },
+			.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+			.dstOffsets = { { 0, 0, 0 }, { static_cast<int32_t>(swapchain->extent.width), static_cast<int32_t>(swapchain->extent.height), 1 } }
+		};
+		vkCmdBlitImage(commandBuffer->handle,
+			source->handle, VK_IMAGE_LAYOUT_GENERAL,
+			target->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &region, upscale ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+		target->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, commandBuffer);
+		return;
+	}
+
+	target->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, commandBuffer);
+
+	constants.sourceWidth = sourceExtent.width;
+	constants.sourceHeight = sourceExtent.height;
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[index], 0, nullptr);
+	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ResolvePushConstants), &constants);
+	vkCmdDispatch(commandBuffer->handle, (swapchain->extent.width + 7) / 8, (swapchain->extent.height + 7) / 8, 1);
+
+	target->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, commandBuffer);
+}
+
+Resolver::~Resolver()
+{
+	destroyDescriptorSets();
+
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(device->device, descriptorSetLayout, nullptr);
+	}
+
+	if (pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, pipeline, nullptr);
+	}
+
+	if (pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device->device, pipelineLayout, nullptr);
+	}
+}
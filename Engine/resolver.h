@@ -0,0 +1,57 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_swapchain.h"
+#include "unk_image.h"
+#include "unk_image_descriptor.h"
+#include "unk_command_buffer.h"
+
+#include <vulkan/vulkan.h>
+#include "structs.h"
+#include "utils.h"
+#include <vector>
+
+using namespace std;
+
+/*
+* Writes a pipeline's HDR output to the acquired swapchain image
+* When the swapchain supports storage a single compute pass tonemaps and converts directly into it,
+* otherwise the output is blitted (which also converts formats, unlike vkCmdCopyImage)
+* Sources rendered below output resolution are upscaled, bicubic with sharpening or a linear blit
+*/
+class Resolver
+{
+public:
+	UnkDevice* device;
+	UnkSwapchain* swapchain;
+	UnkImage* source;
+
+	ResolvePushConstants constants{};
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	vector<UnkDescriptor*> descriptors;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	vector<VkDescriptorSet> descriptorSets; // one per swapchain image
+
+	Resolver(UnkDevice* device, UnkSwapchain* swapchain, UnkImage* source);
+
+	~Resolver();
+
+	void createDescriptorSets();
+
+	void destroyDescriptorSets();
+
+	void createPipeline();
+
+	void handleResize(UnkImage* source);
+
+	void record(UnkCommandBuffer* commandBuffer, uint32_t imageIndex, VkPipelineStageFlags sourceStage, VkExtent2D sourceExtent);
+
+	VkPipelineStageFlags getWaitStage();
+
+	bool usesStorage();
+};
@@ -0,0 +1,344 @@
+#include "restir.h"
+#include "pipeline.h"
+
+using namespace std;
+
+enum
+{
+	RESTIR_CAMERA_BINDING,
+	RESTIR_POINT_LIGHT_BINDING,
+	RESTIR_DIR_LIGHT_BINDING,
+	RESTIR_LIGHT_CDF_BINDING,
+	RESTIR_AS_BINDING,
+	RESTIR_GBUFFER_BINDING,
+	RESTIR_PREVIOUS_GBUFFER_BINDING,
+	RESTIR_INITIAL_RESERVOIR_BINDING,
+	RESTIR_TEMPORAL_RESERVOIR_BINDING,
+	RESTIR_RESERVOIR_BINDING,
+	RESTIR_ALBEDO_BINDING,
+	RESTIR_RESULT_BINDING
+};
+
+Restir::Restir(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, UnkImage* target, UnkImage** gbuffer, UnkTlas* tlas)
+{
+	this->device = device;
+	this->swapchain = swapchain;
+	this->resources = resources;
+	this->target = target;
+	this->gbuffer = gbuffer;
+	this->tlas = tlas;
+
+	constants =
+	{
+		.pointLightCount = static_cast<uint32_t>(resources->pointLights.size()),
+		.dirLightCount = static_cast<uint32_t>(resources->dirLights.size()),
+		.spatialRadius = 30.0f
+	};
+
+	createResources();
+	createDescriptorSets();
+	createPipeline();
+}
+
+void Restir::createResources()
+{
+	VkDeviceSize reservoirSize = static_cast<VkDeviceSize>(swapchain->extent.width) * swapchain->extent.height * sizeof(Reservoir);
+
+	initialReservoirs = new UnkBuffer(device, reservoirSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+	temporalReservoirs = new UnkBuffer(device, reservoirSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+	reservoirs = new UnkBuffer(device, reservoirSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+
+	albedoImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT,
+		true
+	);
+	albedoImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	reset();
+}
+
+void Restir::destroyResources()
+{
+	delete initialReservoirs;
+	delete temporalReservoirs;
+	delete reservoirs;
+	delete albedoImage;
+
+	initialReservoirs = nullptr;
+	temporalReservoirs = nullptr;
+	reservoirs = nullptr;
+	albedoImage = nullptr;
+}
+
+void Restir::createDescriptorSets()
+{
+	vector<VkDescriptorSetLayoutBinding> bindings;
+
+	for (uint32_t p = 0; p < 2; p++)
+	{
+		VkDescriptorSet* descriptorSet = &descriptorSets[p];
+
+		vector<UnkDescriptor*> setDescriptors;
+
+		setDescriptors.push_back(new UnkBufferDescriptor(resources->cameraBuffer, descriptorSet, RESTIR_CAMERA_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkBufferDescriptor(resources->pointLightBuffer, descriptorSet, RESTIR_POINT_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkBufferDescriptor(resources->dirLightBuffer, descriptorSet, RESTIR_DIR_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkBufferDescriptor(resources->lightCdfBuffer, descriptorSet, RESTIR_LIGHT_CDF_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkAsDescriptor(tlas, descriptorSet, RESTIR_AS_BINDING, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+		vector<UnkImage*> gbufferImages{ gbuffer[p] };
+		vector<UnkImage*> previousGbufferImages{ gbuffer[1 - p] };
+		setDescriptors.push_back(new UnkImageDescriptor(gbufferImages, descriptorSet, RESTIR_GBUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+		setDescriptors.push_back(new UnkImageDescriptor(previousGbufferImages, descriptorSet, RESTIR_PREVIOUS_GBUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+
+		setDescriptors.push_back(new UnkBufferDescriptor(initialReservoirs, descriptorSet, RESTIR_INITIAL_RESERVOIR_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkBufferDescriptor(temporalReservoirs, descriptorSet, RESTIR_TEMPORAL_RESERVOIR_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+		setDescriptors.push_back(new UnkBufferDescriptor(reservoirs, descriptorSet, RESTIR_RESERVOIR_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+		vector<UnkImage*> albedoImages{ albedoImage };
+		vector<UnkImage*> resultImages{ target };
+		setDescriptors.push_back(new UnkImageDescriptor(albedoImages, descriptorSet, RESTIR_ALBEDO_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+		setDescriptors.push_back(new UnkImageDescriptor(resultImages, descriptorSet, RESTIR_RESULT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+
+		if (p == 0)
+		{
+			for (auto& descriptor : setDescriptors)
+			{
+				bindings.push_back(descriptor->getLayoutBinding());
+			}
+		}
+
+		descriptors.insert(descriptors.end(), setDescriptors.begin(), setDescriptors.end());
+	}
+
+	if (descriptorSetLayout == VK_NULL_HANDLE)
+	{
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+		{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()
+		};
+		VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+	}
+
+	vector<VkDescriptorPoolSize> poolSizes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		VkDescriptorPoolSize poolSize
+		{
+			.type = descriptors[i]->descriptorType,
+			.descriptorCount = descriptors[i]->count
+		};
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = 2,
+		.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+		.pPoolSizes = poolSizes.data(),
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	VkDescriptorSetLayout layouts[] = { descriptorSetLayout, descriptorSetLayout };
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = 2,
+		.pSetLayouts = layouts
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, descriptorSets));
+
+	// link descriptors to buffer and image handles
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void Restir::destroyDescriptorSets()
+{
+	if (descriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(device->device, descriptorPool, nullptr);
+		descriptorPool = VK_NULL_HANDLE;
+	}
+
+	for (auto& descriptor : descriptors)
+	{
+		delete descriptor;
+	}
+	descriptors.clear();
+}
+
+void Restir::createPipeline()
+{
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(RestirPushConstants)
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	temporalPipeline = createComputePipeline("shaders/restir_temporal.spv");
+	spatialPipeline = createComputePipeline("shaders/restir_spatial.spv");
+}
+
+VkPipeline Restir::createComputePipeline(const char* path)
+{
+	VkShaderModule shaderModule = Pipeline::loadShaderModule(device, path);
+
+	VkComputePipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+
+	VkPipeline computePipeline;
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &computePipeline));
+
+	vkDestroyShaderModule(device->device, shaderModule, nullptr);
+
+	return computePipeline;
+}
+
+/*
+* The gbuffer images are recreated by the denoiser before this is called
+*/
+void Restir::handleResize(UnkImage* target)
+{
+	this->target = target;
+
+	destroyDescriptorSets();
+	destroyResources();
+
+	createResources();
+	createDescriptorSets();
+}
+
+void Restir::setTlas(UnkTlas* tlas)
+{
+	this->tlas = tlas;
+
+	vector<VkWriteDescriptorSet> writes;
+	for (auto& descriptor : descriptors)
+	{
+		if (descriptor->binding != RESTIR_AS_BINDING) continue;
+
+		static_cast<UnkAsDescriptor*>(descriptor)->tlas = tlas;
+		writes.push_back(descriptor->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+
+	reset();
+}
+
+/*
+* Drops the reservoirs of the last frame
+*/
+void Restir::reset()
+{
+	resetHistory = true;
+}
+
+void Restir::barrier(UnkCommandBuffer* commandBuffer, VkPipelineStageFlags sourceStage)
+{
+	VkMemoryBarrier memoryBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer->handle, sourceStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/*
+* Records temporal and spatial reuse after the trace, direct light is added to the target image
+* The gbuffer written this frame is gbuffer[current]
+*/
+void Restir::record(UnkCommandBuffer* commandBuffer, VkExtent2D extent, uint32_t current, uint32_t seed)
+{
+	// reservoirs are indexed by the traced extent
+	if (extent.width != historyExtent.width || extent.height != historyExtent.height)
+	{
+		historyExtent = extent;
+		resetHistory = true;
+	}
+
+	constants.width = extent.width;
+	constants.height = extent.height;
+	constants.seed = seed;
+	constants.reset = resetHistory ? 1 : 0;
+
+	uint32_t groupsX = (extent.width + 7) / 8;
+	uint32_t groupsY = (extent.height + 7) / 8;
+
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[current], 0, nullptr);
+	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RestirPushConstants), &constants);
+
+	barrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, temporalPipeline);
+	vkCmdDispatch(commandBuffer->handle, groupsX, groupsY, 1);
+
+	barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, spatialPipeline);
+	vkCmdDispatch(commandBuffer->handle, groupsX, groupsY, 1);
+
+	resetHistory = false;
+}
+
+Restir::~Restir()
+{
+	destroyDescriptorSets();
+	destroyResources();
+
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(device->device, descriptorSetLayout, nullptr);
+	}
+
+	if (temporalPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, temporalPipeline, nullptr);
+	}
+
+	if (spatialPipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, spatialPipeline, nullptr);
+	}
+
+	if (pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(device->device, pipelineLayout, nullptr);
+	}
+}
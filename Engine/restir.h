@@ -0,0 +1,83 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_swapchain.h"
+#include "unk_buffer.h"
+#include "unk_image.h"
+#include "unk_tlas.h"
+#include "unk_image_descriptor.h"
+#include "unk_buffer_descriptor.h"
+#include "unk_as_descriptor.h"
+#include "unk_command_buffer.h"
+
+#include <vulkan/vulkan.h>
+#include "structs.h"
+#include "utils.h"
+#include <vector>
+
+using namespace std;
+
+/*
+* Reservoir based spatiotemporal light resampling for direct lighting
+* The closest hit shader writes one initial reservoir per pixel, a temporal pass merges it with the reprojected
+* reservoir of the last frame, and a spatial pass merges neighbours, traces the single visibility ray and shades
+*/
+class Restir
+{
+public:
+	static const uint32_t SPATIAL_NEIGHBOURS = 4;
+
+	UnkDevice* device;
+	UnkSwapchain* swapchain;
+	DeviceResources* resources;
+	UnkImage* target;
+	UnkImage** gbuffer;
+	UnkTlas* tlas;
+
+	UnkBuffer* initialReservoirs = nullptr; // written by the closest hit shader
+	UnkBuffer* temporalReservoirs = nullptr;
+	UnkBuffer* reservoirs = nullptr; // final reservoirs, reused by the next frame
+	UnkImage* albedoImage = nullptr;
+
+	VkExtent2D historyExtent{};
+	bool resetHistory = true;
+
+	RestirPushConstants constants{};
+
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline temporalPipeline = VK_NULL_HANDLE;
+	VkPipeline spatialPipeline = VK_NULL_HANDLE;
+
+	vector<UnkDescriptor*> descriptors;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSets[2]{}; // by gbuffer parity
+
+	Restir(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources, UnkImage* target, UnkImage** gbuffer, UnkTlas* tlas);
+
+	~Restir();
+
+	void createResources();
+
+	void destroyResources();
+
+	void createDescriptorSets();
+
+	void destroyDescriptorSets();
+
+	void createPipeline();
+
+	void handleResize(UnkImage* target);
+
+	void setTlas(UnkTlas* tlas);
+
+	void reset();
+
+	void record(UnkCommandBuffer* commandBuffer, VkExtent2D extent, uint32_t current, uint32_t seed);
+
+private:
+	VkPipeline createComputePipeline(const char* path);
+
+	void barrier(UnkCommandBuffer* commandBuffer, VkPipelineStageFlags sourceStage);
+};
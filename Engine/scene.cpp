@@ -2,6 +2,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "scene.h"
+#include "mesh_optimizer.h"
 
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
@@ -10,6 +11,8 @@
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/packing.hpp>
+#include <iomanip>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <assimp/Importer.hpp>
@@ -19,6 +22,9 @@
 #include <vector>
 #include <algorithm>
 #include <array>
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <chrono>
 #include <unordered_map>
@@ -41,6 +47,24 @@ static mat4 convertAIMatrix(const aiMatrix4x4& m)
 	return mat;
 }
 
+/*
+* Interleaves the bits of a point in the unit cube, 10 per axis, nearby points get nearby codes
+*/
+static uint32_t mortonCode(vec3 p)
+{
+	uint32_t code = 0;
+	uvec3 cell = uvec3(glm::clamp(p, vec3(0.0f), vec3(1.0f)) * 1023.0f);
+
+	for (uint32_t bit = 0; bit < 10; bit++)
+	{
+		code |= ((cell.x >> bit) & 1u) << (3 * bit + 2);
+		code |= ((cell.y >> bit) & 1u) << (3 * bit + 1);
+		code |= ((cell.z >> bit) & 1u) << (3 * bit);
+	}
+
+	return code;
+}
+
 void SceneManager::loadScene(const char* path)
 {
 	// load scene
@@ -58,57 +82,123 @@ void SceneManager::loadScene(const char* path)
 	// create empty texture
 	const uint32_t pixel = 0xFFFFFFFFu;
 	renderer->createTexture((void*)&pixel, 1, 1);
+	textureAlpha.push_back(false);
 
 	// load mesh vertex and index buffers
-	vector<Vertex> vertices;
+	vector<vec3> positions;
+	vector<VertexAttributes> attributes;
 	vector<uint32_t> indices;
+	vector<uint16_t> indices16;
+
+	vector<Meshlet> meshlets;
+	vector<uint32_t> meshletVertices;
+	vector<uint32_t> meshletTriangles;
 
+	// read every mesh and where the nodes place them, static meshes may be merged before anything is optimized
+	vector<ImportedMesh> importedMeshes;
 	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 	{
-		const aiMesh* currMesh = scene->mMeshes[i];
+		importedMeshes.push_back(readMesh(scene->mMeshes[i]));
+	}
+
+	placements.clear();
+	visit(scene->mRootNode, mat4(1.0f), scene);
+
+	if (mergeStatic)
+	{
+		mergeStaticMeshes(importedMeshes);
+	}
+
+	for (ImportedMesh& imported : importedMeshes)
+	{
+		const aiMesh* currMesh = imported.source;
+		const char* name = imported.name.c_str();
 
 		Mesh mesh;
 
-		mesh.vertexOffset = static_cast<uint32_t>(vertices.size()); // first vertex corrseponding to this mesh
-		mesh.vertexCount = static_cast<uint32_t>(currMesh->mNumVertices);
+		mesh.vertexOffset = static_cast<uint32_t>(positions.size()); // first vertex corrseponding to this mesh
+		mesh.vertexCount = static_cast<uint32_t>(imported.positions.size());
 
-		// find vertices
-		for (unsigned int j = 0; j < currMesh->mNumVertices; j++)
+		vector<vec3>& meshPositions = imported.positions;
+		vector<VertexAttributes> meshAttributes;
+		vector<uint32_t>& meshIndices = imported.indices;
+
+		for (size_t j = 0; j < imported.positions.size(); j++)
 		{
-			Vertex vertex;
-			vertex.position = vec3(currMesh->mVertices[j].x, currMesh->mVertices[j].y, currMesh->mVertices[j].z);
-			vertex.normal = currMesh->HasNormals() ? vec3(currMesh->mNormals[j].x, currMesh->mNormals[j].y, currMesh->mNormals[j].z) : vec3(0.0f);
-			vertex.texCoord = currMesh->HasTextureCoords(0) ? vec2(currMesh->mTextureCoords[0][j].x, currMesh->mTextureCoords[0][j].y) : vec2(0.0f);
+			VertexAttributes vertex
+			{
+				.normal = encodeNormal(imported.normals[j]),
+				.texCoord = encodeTexCoord(imported.texCoords[j])
+			};
+
+			meshAttributes.push_back(vertex);
+		}
 
-			vertices.push_back(vertex);
+		// point and line meshes are left in file order
+		if (currMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		{
+			optimizeMesh(name, meshIndices, meshPositions, meshAttributes);
 		}
 
-		// find indices
-		mesh.firstIndex = static_cast<uint32_t>(indices.size()); // set first index of the mesh to the size of the index buffer
+		mesh.indexCount = static_cast<uint32_t>(meshIndices.size());
+		mesh.lods.push_back(MeshLod{ .firstIndex = 0, .indexCount = mesh.indexCount });
 
-		uint32_t indexCount = 0;
-		for (unsigned int j = 0; j < currMesh->mNumFaces; j++)
+		// bounding sphere around the box centre, projects level of detail errors to the screen
+		vec3 boundsMin(FLT_MAX);
+		vec3 boundsMax(-FLT_MAX);
+		for (const vec3& position : meshPositions)
 		{
-			const aiFace* face = &currMesh->mFaces[j];
+			boundsMin = min(boundsMin, position);
+			boundsMax = max(boundsMax, position);
+		}
 
-			for (unsigned int k = 0; k < face->mNumIndices; k++)
-			{
-				indices.push_back(face->mIndices[k]);
-				indexCount++;
-			}
+		mesh.boundsCenter = 0.5f * (boundsMin + boundsMax);
+		for (const vec3& position : meshPositions)
+		{
+			mesh.boundsRadius = std::max(mesh.boundsRadius, distance(position, mesh.boundsCenter));
+		}
+
+		if (currMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		{
+			generateLods(name, mesh, meshIndices, meshPositions);
+			buildMeshlets(name, mesh, meshIndices, meshPositions, meshlets, meshletVertices, meshletTriangles);
+		}
+
+		positions.insert(positions.end(), meshPositions.begin(), meshPositions.end());
+		attributes.insert(attributes.end(), meshAttributes.begin(), meshAttributes.end());
+
+		// indices stay local to the mesh, so any mesh whose vertices fit in 16 bits goes to the smaller pool
+		if (mesh.vertexCount <= UINT16_MAX + 1u)
+		{
+			mesh.indexType = VK_INDEX_TYPE_UINT16;
+			mesh.firstIndex = static_cast<uint32_t>(indices16.size());
+			indices16.insert(indices16.end(), meshIndices.begin(), meshIndices.end());
+		}
+		else
+		{
+			mesh.firstIndex = static_cast<uint32_t>(indices.size());
+			indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+		}
+
+		// levels follow the full mesh in the same pool
+		for (MeshLod& lod : mesh.lods)
+		{
+			lod.firstIndex += mesh.firstIndex;
 		}
-		
-		mesh.indexCount = indexCount;
 
 		renderer->deviceResources.meshes.push_back(mesh);
+
+		// the vertices now live in the shared pools
+		imported = ImportedMesh{ .source = imported.source };
 	}
 
 	// create vertex buffer
-	renderer->createVertexBuffers(vertices, indices);
+	renderer->createVertexBuffers(positions, attributes, indices, indices16);
+	renderer->createMeshletBuffers(meshlets, meshletVertices, meshletTriangles);
 
 
 	// load instance data
-	visit(scene->mRootNode, mat4(1.0f), scene);
+	createInstances(scene, importedMeshes);
 
 	// load light data
 	for (unsigned int i = 0; i < scene->mNumLights; i++)
@@ -158,6 +248,42 @@ void SceneManager::loadScene(const char* path)
 	}
 }
 
+/*
+* Copies a mesh out of the importer, attributes are encoded only once meshes have been merged
+*/
+ImportedMesh SceneManager::readMesh(const aiMesh* currMesh)
+{
+	ImportedMesh imported
+	{
+		.name = currMesh->mName.C_Str(),
+		.source = currMesh
+	};
+
+	// find vertices
+	for (unsigned int j = 0; j < currMesh->mNumVertices; j++)
+	{
+		imported.positions.push_back(vec3(currMesh->mVertices[j].x, currMesh->mVertices[j].y, currMesh->mVertices[j].z));
+		imported.normals.push_back(currMesh->HasNormals() ? vec3(currMesh->mNormals[j].x, currMesh->mNormals[j].y, currMesh->mNormals[j].z) : vec3(0.0f));
+		imported.texCoords.push_back(currMesh->HasTextureCoords(0) ? vec2(currMesh->mTextureCoords[0][j].x, currMesh->mTextureCoords[0][j].y) : vec2(0.0f));
+	}
+
+	// find indices
+	for (unsigned int j = 0; j < currMesh->mNumFaces; j++)
+	{
+		const aiFace* face = &currMesh->mFaces[j];
+
+		for (unsigned int k = 0; k < face->mNumIndices; k++)
+		{
+			imported.indices.push_back(face->mIndices[k]);
+		}
+	}
+
+	return imported;
+}
+
+/*
+* Records where the nodes place meshes, instances are created from the placements once meshes are final
+*/
 void SceneManager::visit(const aiNode* node, const mat4& parentTransform, const aiScene* scene)
 {
 	// determine world matrix based on parent world and local transforms
@@ -167,26 +293,212 @@ void SceneManager::visit(const aiNode* node, const mat4& parentTransform, const
 
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
-		// determine which of the scene's meshes this mesh refers to
-		unsigned meshIndex = node->mMeshes[i];
-		const aiMesh* currMesh = scene->mMeshes[meshIndex];
-		Mesh* mesh = &renderer->deviceResources.meshes[meshIndex];
+		placements.push_back(MeshPlacement{ .mesh = node->mMeshes[i], .world = world });
+	}
+
+	for (unsigned i = 0; i < node->mNumChildren; i++)
+	{
+		visit(node->mChildren[i], world, scene);
+	}
+}
+
+/*
+* Pre-transforms meshes placed exactly once and merges those that share a material, so they become one instance
+* with one transform, one acceleration structure instance and one draw
+* Meshes placed more than once keep their instances, merged meshes are capped at MAX_MERGED_VERTICES so they
+* stay in the 16 bit index pool and small enough to simplify
+* Scene nodes are never moved after import, so every placement counts as static
+*/
+void SceneManager::mergeStaticMeshes(vector<ImportedMesh>& meshes)
+{
+	vector<uint32_t> placementCounts(meshes.size(), 0);
+	for (const MeshPlacement& placement : placements)
+	{
+		placementCounts[placement.mesh]++;
+	}
+
+	// candidates by material
+	map<unsigned int, vector<uint32_t>> candidates;
+	for (uint32_t i = 0; i < placements.size(); i++)
+	{
+		const ImportedMesh& mesh = meshes[placements[i].mesh];
+		if (placementCounts[placements[i].mesh] != 1 || mesh.source->mPrimitiveTypes != aiPrimitiveType_TRIANGLE) continue;
+
+		candidates[mesh.source->mMaterialIndex].push_back(i);
+	}
+
+	// chunks of at least two placements become one merged mesh each
+	// members are ordered along a Morton curve over their world space centres first, so a chunk stays compact
+	vector<vector<uint32_t>> chunks;
+	for (auto& [material, members] : candidates)
+	{
+		vector<vec3> centres;
+		vec3 sceneMin(FLT_MAX);
+		vec3 sceneMax(-FLT_MAX);
+
+		for (uint32_t placement : members)
+		{
+			const vector<vec3>& positions = meshes[placements[placement].mesh].positions;
+
+			vec3 meshMin(FLT_MAX);
+			vec3 meshMax(-FLT_MAX);
+			for (const vec3& position : positions)
+			{
+				meshMin = glm::min(meshMin, position);
+				meshMax = glm::max(meshMax, position);
+			}
+
+			vec3 centre = positions.empty() ? vec3(0.0f) : vec3(placements[placement].world * vec4(0.5f * (meshMin + meshMax), 1.0f));
+			centres.push_back(centre);
+			sceneMin = glm::min(sceneMin, centre);
+			sceneMax = glm::max(sceneMax, centre);
+		}
+
+		vec3 extent = glm::max(sceneMax - sceneMin, vec3(1e-6f));
+		vector<pair<uint32_t, uint32_t>> ordered; // code, placement
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			ordered.push_back({ mortonCode((centres[i] - sceneMin) / extent), members[i] });
+		}
+		sort(ordered.begin(), ordered.end());
+
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			members[i] = ordered[i].second;
+		}
+
+		vector<uint32_t> chunk;
+		size_t chunkVertices = 0;
+
+		for (uint32_t placement : members)
+		{
+			size_t vertexCount = meshes[placements[placement].mesh].positions.size();
+			if (!chunk.empty() && chunkVertices + vertexCount > MAX_MERGED_VERTICES)
+			{
+				if (chunk.size() > 1) chunks.push_back(chunk);
+				chunk.clear();
+				chunkVertices = 0;
+			}
+
+			chunk.push_back(placement);
+			chunkVertices += vertexCount;
+		}
+
+		if (chunk.size() > 1) chunks.push_back(chunk);
+	}
+
+	if (chunks.empty()) return;
+
+	vector<int32_t> chunkOfPlacement(placements.size(), -1);
+	for (uint32_t c = 0; c < chunks.size(); c++)
+	{
+		for (uint32_t placement : chunks[c])
+		{
+			chunkOfPlacement[placement] = static_cast<int32_t>(c);
+		}
+	}
+
+	vector<ImportedMesh> result;
+	vector<MeshPlacement> resultPlacements;
+	vector<uint32_t> remap(meshes.size(), UINT32_MAX);
+	uint32_t mergedMeshes = 0;
+
+	for (uint32_t i = 0; i < placements.size(); i++)
+	{
+		const MeshPlacement& placement = placements[i];
+		int32_t c = chunkOfPlacement[i];
+
+		if (c < 0)
+		{
+			if (remap[placement.mesh] == UINT32_MAX)
+			{
+				remap[placement.mesh] = static_cast<uint32_t>(result.size());
+				result.push_back(move(meshes[placement.mesh]));
+			}
+
+			resultPlacements.push_back(MeshPlacement{ .mesh = remap[placement.mesh], .world = placement.world });
+			continue;
+		}
+
+		// the chunk is emitted at the placement that comes first in its spatial order
+		if (chunks[c].front() != i) continue;
+
+		ImportedMesh merged
+		{
+			.name = "merged " + to_string(c) + " (" + to_string(chunks[c].size()) + " meshes)",
+			.source = meshes[placement.mesh].source
+		};
+
+		for (uint32_t member : chunks[c])
+		{
+			const mat4& world = placements[member].world;
+			const ImportedMesh& mesh = meshes[placements[member].mesh];
+
+			mat3 normalMatrix = transpose(inverse(mat3(world)));
+			bool mirrored = determinant(mat3(world)) < 0.0f;
+			uint32_t baseVertex = static_cast<uint32_t>(merged.positions.size());
+
+			for (size_t j = 0; j < mesh.positions.size(); j++)
+			{
+				merged.positions.push_back(vec3(world * vec4(mesh.positions[j], 1.0f)));
+
+				vec3 normal = normalMatrix * mesh.normals[j];
+				merged.normals.push_back(length(normal) > 0.0f ? normalize(normal) : vec3(0.0f));
+				merged.texCoords.push_back(mesh.texCoords[j]);
+			}
+
+			// a mirroring transform turns the winding around, swap it back so front faces stay front faces
+			for (size_t j = 0; j + 2 < mesh.indices.size(); j += 3)
+			{
+				merged.indices.push_back(baseVertex + mesh.indices[j]);
+				merged.indices.push_back(baseVertex + mesh.indices[j + (mirrored ? 2 : 1)]);
+				merged.indices.push_back(baseVertex + mesh.indices[j + (mirrored ? 1 : 2)]);
+			}
+		}
+
+		resultPlacements.push_back(MeshPlacement{ .mesh = static_cast<uint32_t>(result.size()), .world = mat4(1.0f) });
+		result.push_back(move(merged));
+		mergedMeshes += static_cast<uint32_t>(chunks[c].size());
+	}
+
+	if (reportOptimization)
+	{
+		cout << "merged " << mergedMeshes << " static meshes into " << chunks.size() << ", "
+			<< meshes.size() << " meshes and " << placements.size() << " instances -> "
+			<< result.size() << " meshes and " << resultPlacements.size() << " instances\n";
+	}
+
+	// meshes no node places are dropped
+	meshes = move(result);
+	placements = move(resultPlacements);
+}
+
+/*
+* One instance and transform per placement, instances of a mesh are kept contiguous for instanced draws
+*/
+void SceneManager::createInstances(const aiScene* scene, const vector<ImportedMesh>& meshes)
+{
+	for (const MeshPlacement& placement : placements)
+	{
+		const aiMesh* currMesh = meshes[placement.mesh].source;
+		Mesh* mesh = &renderer->deviceResources.meshes[placement.mesh];
 
 		// record current index of transform buffers and create transform buffer
 		uint32_t transformIndex = static_cast<uint32_t>(renderer->deviceResources.transforms.size());
 
 		MVP mvp;
-		mvp.model = world;
+		mvp.model = placement.world;
 
 		renderer->deviceResources.transforms.push_back(mvp);
 		
 		uint32_t textureIndex = getTextureIndexForMesh(scene, currMesh);
+		readMaterial(scene, currMesh, textureIndex, mesh);
 
 		Instance instance
 		{
 			.transformIndex = transformIndex,
 			.textureIndex = textureIndex,
-			.baseIndex = mesh->firstIndex,
+			.baseIndex = mesh->firstIndex | (mesh->indexType == VK_INDEX_TYPE_UINT16 ? INSTANCE_INDEX_16 : 0u),
 			.baseVertex = static_cast<uint32_t>(mesh->vertexOffset),
 		};
 
@@ -199,11 +511,6 @@ void SceneManager::visit(const aiNode* node, const mat4& parentTransform, const
 
 		mesh->instanceCount += 1; // increment mesh's count as we have found the mesh
 	}
-
-	for (unsigned i = 0; i < node->mNumChildren; i++)
-	{
-		visit(node->mChildren[i], world, scene);
-	}
 }
 
 uint32_t SceneManager::getTextureIndexForMesh(const aiScene* scene, const aiMesh* mesh)
@@ -224,8 +531,7 @@ uint32_t SceneManager::getTextureIndexForMesh(const aiScene* scene, const aiMesh
 		}
 		else
 		{
-			index = static_cast<uint32_t>(renderer->deviceResources.textureImages.size());
-			readTexture(path.C_Str());
+			index = readTexture(path.C_Str());
 			textureMap[key] = index;
 		}
 	}
@@ -233,20 +539,279 @@ uint32_t SceneManager::getTextureIndexForMesh(const aiScene* scene, const aiMesh
 	return index;
 }
 
-void SceneManager::readTexture(const char* path)
+/*
+* Classifies the material of a mesh, picking the hit group it is shaded with
+* Alpha testing takes precedence over emission, the alpha tested hit group adds the emission as well
+*/
+void SceneManager::readMaterial(const aiScene* scene, const aiMesh* currMesh, uint32_t textureIndex, Mesh* mesh)
 {
+	const aiMaterial* mat = scene->mMaterials[currMesh->mMaterialIndex];
+
+	int shadingModel = aiShadingMode_Gouraud;
+	mat->Get(AI_MATKEY_SHADING_MODEL, shadingModel);
+
+	aiColor3D emissive(0.0f, 0.0f, 0.0f);
+	mat->Get(AI_MATKEY_COLOR_EMISSIVE, emissive);
+
+	mesh->emission = vec3(emissive.r, emissive.g, emissive.b);
+
+	if (shadingModel == aiShadingMode_Unlit || shadingModel == aiShadingMode_NoShading)
+	{
+		mesh->materialClass = MATERIAL_UNLIT;
+	}
+	else if (textureAlpha[textureIndex])
+	{
+		mesh->materialClass = MATERIAL_ALPHA_TESTED;
+	}
+	else if (emissive.r > 0.0f || emissive.g > 0.0f || emissive.b > 0.0f)
+	{
+		mesh->materialClass = MATERIAL_EMISSIVE;
+	}
+	else
+	{
+		mesh->materialClass = MATERIAL_OPAQUE;
+	}
+
+	// cut out materials are usually thin cards seen from both sides
+	int twoSided = mesh->isAlphaTested() ? 1 : 0;
+	mat->Get(AI_MATKEY_TWOSIDED, twoSided);
+
+	mesh->doubleSided = twoSided != 0;
+}
+
+uint32_t SceneManager::readTexture(const char* path)
+{
+	// baked containers are uploaded as they are stored
+	TextureFile file;
+	if (findTextureFile(path, file))
+	{
+		textureAlpha.push_back(file.alpha);
+		uint32_t index = renderer->createTexture(file);
+
+		if (reportOptimization)
+		{
+			cout << "texture " << path << " loaded from " << file.path << " (" << file.width << "x" << file.height << ", "
+				<< file.levelOffsets.size() << " levels, " << file.dataSize / 1024 << " KB)\n";
+		}
+		return index;
+	}
+
 	// read image data
 	int texWidth, texHeight, texChannels;
 	stbi_uc* pixels = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
 	if (!pixels) throw runtime_error("failed to load mesh texture");
 
-	renderer->createTexture(pixels, static_cast<uint32_t>(texHeight), static_cast<uint32_t>(texWidth));
+	bool alpha = hasAlpha(pixels, texWidth, texHeight);
+	textureAlpha.push_back(alpha);
+
+	if (!bakeTextures || !renderer->device->textureCompressionBC)
+	{
+		uint32_t index;
+
+		// streamed textures need their levels on the cpu, the chain is built here rather than by blits
+		if (renderer->streamTextures)
+		{
+			BakedTexture levels = TextureBaker::bake(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), TEXTURE_CODEC_NONE, true, alpha);
+			index = renderer->createTexture(levels);
+		}
+		else
+		{
+			index = renderer->createTexture(pixels, static_cast<uint32_t>(texHeight), static_cast<uint32_t>(texWidth));
+		}
+
+		stbi_image_free(pixels);
+		return index;
+	}
+
+	// colour textures, opaque ones drop to 4 bits a texel unless BC7 is preferred
+	TextureCodec codec = bakeHighQuality ? TEXTURE_CODEC_BC7 : (alpha ? TEXTURE_CODEC_BC3 : TEXTURE_CODEC_BC1);
+	BakedTexture baked = TextureBaker::bake(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), codec, true, alpha);
 
 	stbi_image_free(pixels);
+
+	if (writeBakedTextures)
+	{
+		TextureBaker::writeKtx2(filesystem::path(path).replace_extension(".ktx2").string().c_str(), baked);
+	}
+
+	if (reportOptimization)
+	{
+		cout << "texture " << path << " (" << texWidth << "x" << texHeight << ", " << baked.levelOffsets.size() << " levels): "
+			<< static_cast<size_t>(texWidth) * texHeight * 4 / 1024 << " KB -> " << baked.data.size() / 1024 << " KB\n";
+	}
+
+	return renderer->createTexture(baked);
+}
+
+/*
+* Looks for a KTX2 or DDS file at the path, or next to it with the same name
+* A container older than the image beside it is skipped so edited sources are baked again
+*/
+bool SceneManager::findTextureFile(const char* path, TextureFile& file)
+{
+	filesystem::path source(path);
+	error_code error;
+
+	for (const char* extension : { ".ktx2", ".dds" })
+	{
+		filesystem::path candidate = source;
+		candidate.replace_extension(extension);
+
+		if (!filesystem::exists(candidate, error)) continue;
+
+		if (candidate != source && filesystem::exists(source, error) &&
+			filesystem::last_write_time(source, error) > filesystem::last_write_time(candidate, error)) continue;
+
+		string candidatePath = candidate.string();
+		bool read = strcmp(extension, ".ktx2") == 0 ?
+			TextureContainer::readKtx2(candidatePath.c_str(), file) :
+			TextureContainer::readDds(candidatePath.c_str(), file);
+
+		if (!read) continue;
+
+		// compressed formats the device can not sample fall back to the source image
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(renderer->device->gpu, file.format, &properties);
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) return true;
+	}
+
+	return false;
+}
+
+/*
+* Reorders triangles for the post-transform cache and overdraw, then vertices for fetch locality
+* Reports the simulated cache miss ratios before and after so the gain can be checked per mesh
+*/
+void SceneManager::optimizeMesh(const char* name, vector<uint32_t>& indices, vector<vec3>& positions, vector<VertexAttributes>& attributes)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+	VertexCacheStats before = MeshOptimizer::analyzeVertexCache(indices, vertexCount);
+
+	vector<uint32_t> clusters;
+	MeshOptimizer::optimizeVertexCache(indices, vertexCount, &clusters);
+	MeshOptimizer::optimizeOverdraw(indices, positions, clusters);
+	MeshOptimizer::optimizeVertexFetch(indices, positions, attributes);
+
+	VertexCacheStats after = MeshOptimizer::analyzeVertexCache(indices, vertexCount);
+
+	if (!reportOptimization) return;
+
+	cout << fixed << setprecision(3)
+		<< "mesh " << name << " (" << indices.size() / 3 << " triangles, " << clusters.size() << " clusters): "
+		<< "ACMR " << before.acmr << " -> " << after.acmr << ", "
+		<< "ATVR " << before.atvr << " -> " << after.atvr << "\n";
+}
+
+/*
+* Appends simplified levels after the full mesh, each aiming at half the triangles of the one before
+* Every level is simplified from the full mesh so its error is measured against the original surface
+* The chain ends early once a level stops removing a useful share of triangles, which happens when locked
+* borders and seams make up most of what is left
+*/
+void SceneManager::generateLods(const char* name, Mesh& mesh, vector<uint32_t>& indices, const vector<vec3>& positions)
+{
+	const vector<uint32_t> source(indices.begin(), indices.begin() + mesh.indexCount);
+	size_t previousCount = source.size();
+	float previousError = 0.0f;
+
+	for (uint32_t level = 1; level < MAX_LODS; level++)
+	{
+		size_t targetCount = previousCount / 6 * 3;
+		if (targetCount < MIN_LOD_TRIANGLES * 3) break;
+
+		float error = 0.0f;
+		vector<uint32_t> lodIndices = MeshOptimizer::simplify(source, positions, targetCount, &error);
+		if (lodIndices.size() * 4 > previousCount * 3) break;
+
+		MeshOptimizer::optimizeVertexCache(lodIndices, static_cast<uint32_t>(positions.size()));
+
+		// coarser levels never report less error, selection relies on it
+		previousError = std::max(previousError, error);
+		mesh.lods.push_back(MeshLod
+		{
+			.firstIndex = static_cast<uint32_t>(indices.size()),
+			.indexCount = static_cast<uint32_t>(lodIndices.size()),
+			.error = previousError
+		});
+
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+		previousCount = lodIndices.size();
+	}
+
+	if (!reportOptimization) return;
+
+	cout << "mesh " << name << " lods:";
+	for (const MeshLod& lod : mesh.lods)
+	{
+		cout << " " << lod.indexCount / 3 << " (" << lod.error << ")";
+	}
+	cout << "\n";
+}
+
+/*
+* Partitions the triangles of every level, the task shader draws the meshlets of the level selectLods picked
+*/
+void SceneManager::buildMeshlets(const char* name, Mesh& mesh, const vector<uint32_t>& indices, const vector<vec3>& positions, vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles)
+{
+	for (MeshLod& lod : mesh.lods)
+	{
+		const vector<uint32_t> source(indices.begin() + lod.firstIndex, indices.begin() + lod.firstIndex + lod.indexCount);
+
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		size_t firstVertex = meshletVertices.size();
+
+		MeshOptimizer::buildMeshlets(source, positions, meshlets, meshletVertices, meshletTriangles);
+
+		lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+
+		if (!reportOptimization || lod.meshletCount == 0) continue;
+
+		cout << "mesh " << name << " level " << &lod - mesh.lods.data() << " meshlets: " << lod.meshletCount << ", "
+			<< static_cast<float>(meshletVertices.size() - firstVertex) / lod.meshletCount << " vertices and "
+			<< static_cast<float>(lod.indexCount / 3) / lod.meshletCount << " triangles on average\n";
+	}
+}
+
+bool SceneManager::hasAlpha(const unsigned char* pixels, int width, int height)
+{
+	// pixels are always expanded to rgba
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+	{
+		if (pixels[i * 4 + 3] < 255) return true;
+	}
+
+	return false;
 }
 
 SceneManager::~SceneManager()
 {
 
+}
+
+/*
+* Octahedral encoding, the unit sphere is projected onto an octahedron which is unfolded into the [-1, 1] square
+* Decoded by decodeOctahedral in octahedral.glsl
+*/
+uint32_t SceneManager::encodeNormal(vec3 normal)
+{
+	float l1 = abs(normal.x) + abs(normal.y) + abs(normal.z);
+	if (l1 == 0.0f) return packSnorm2x16(vec2(0.0f)); // no normal, decodes to +z
+
+	normal /= l1;
+
+	vec2 encoded = vec2(normal.x, normal.y);
+	if (normal.z < 0.0f)
+	{
+		encoded.x = (1.0f - abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+		encoded.y = (1.0f - abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return packSnorm2x16(encoded);
+}
+
+uint32_t SceneManager::encodeTexCoord(vec2 texCoord)
+{
+	return packHalf2x16(texCoord);
 }
\ No newline at end of file
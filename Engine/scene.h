@@ -8,16 +8,49 @@
 #include <assimp/postprocess.h>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <string>
 #include <iostream>
 
 using namespace std;
 
+// a mesh as read from the file, or several merged ones, before it is optimized and moved into the shared pools
+struct ImportedMesh
+{
+	string name;
+	const aiMesh* source = nullptr; // material and primitive types, the first mesh of a merged one
+
+	vector<vec3> positions;
+	vector<vec3> normals;
+	vector<vec2> texCoords;
+	vector<uint32_t> indices;
+};
+
+// a node's use of a mesh, becomes an instance
+struct MeshPlacement
+{
+	uint32_t mesh; // into the imported meshes
+	mat4 world;
+};
+
 class SceneManager
 {
 public:
 	Renderer* renderer;
 	unordered_map<string, uint32_t> textureMap;
 	unordered_map<string, mat4> nodeWorldMap;
+	vector<bool> textureAlpha; // by texture id, texture has texels below full opacity
+	bool reportOptimization = true; // print per mesh vertex cache and level of detail statistics at import
+	bool mergeStatic = true; // merge meshes placed once that share a material, see mergeStaticMeshes
+	bool bakeTextures = true; // block compress textures at import when the device samples BC formats
+	bool bakeHighQuality = false; // BC7 for every texture instead of BC1 and BC3
+	bool writeBakedTextures = true; // keep the baked textures next to their sources as .ktx2
+
+	vector<MeshPlacement> placements;
+
+	static const uint32_t MAX_LODS = 5; // including the full mesh
+	static const uint32_t MIN_LOD_TRIANGLES = 32; // no level is simplified below this
+	static const uint32_t MAX_MERGED_VERTICES = UINT16_MAX + 1; // merged meshes still fit the 16 bit index pool
 
 	SceneManager(Renderer* renderer);
 
@@ -25,9 +58,32 @@ public:
 
 	void loadScene(const char* path);
 
+	ImportedMesh readMesh(const aiMesh* currMesh);
+
 	void visit(const aiNode* node, const mat4& parentTransform, const aiScene* scene);
 
+	void mergeStaticMeshes(vector<ImportedMesh>& meshes);
+
+	void createInstances(const aiScene* scene, const vector<ImportedMesh>& meshes);
+
 	uint32_t getTextureIndexForMesh(const aiScene* scene, const aiMesh* mesh);
 
-	void readTexture(const char* path);
+	void readMaterial(const aiScene* scene, const aiMesh* currMesh, uint32_t textureIndex, Mesh* mesh);
+
+	// returns the texture id
+	uint32_t readTexture(const char* path);
+
+	bool findTextureFile(const char* path, TextureFile& file);
+
+	void optimizeMesh(const char* name, vector<uint32_t>& indices, vector<vec3>& positions, vector<VertexAttributes>& attributes);
+
+	void generateLods(const char* name, Mesh& mesh, vector<uint32_t>& indices, const vector<vec3>& positions);
+
+	void buildMeshlets(const char* name, Mesh& mesh, const vector<uint32_t>& indices, const vector<vec3>& positions, vector<Meshlet>& meshlets, vector<uint32_t>& meshletVertices, vector<uint32_t>& meshletTriangles);
+
+	bool hasAlpha(const unsigned char* pixels, int width, int height);
+
+	uint32_t encodeNormal(vec3 normal);
+
+	uint32_t encodeTexCoord(vec2 texCoord);
 };
\ No newline at end of file
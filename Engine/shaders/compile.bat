@@ -1,8 +1,29 @@
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" shader.vert -o vert.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" depth.vert -o depth_vert.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" shader.frag -o frag.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 -DRAY_QUERY_SHADOWS shader.frag -o frag_shadows.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" -DNO_FEEDBACK shader.frag -o frag_nofeedback.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 -DRAY_QUERY_SHADOWS -DNO_FEEDBACK shader.frag -o frag_shadows_nofeedback.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 raygen.rgen  -o raygen.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 miss.rmiss   -o miss.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 hit.rchit    -o hit.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 -DEMISSIVE hit.rchit -o hit_emissive.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 -DUNLIT hit.rchit -o hit_unlit.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 shadow_hit.rahit -o shadow_hit.spv
 "C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 shadow_miss.rmiss -o shadow_miss.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" resolve.comp -o resolve.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" denoise_temporal.comp -o denoise_temporal.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" denoise_atrous.comp -o denoise_atrous.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 restir_temporal.comp -o restir_temporal.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 restir_spatial.comp -o restir_spatial.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" visbuffer.vert -o visbuffer_vert.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" visbuffer.frag -o visbuffer_frag.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" visbuffer_shade.comp -o visbuffer_shade.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" gbuffer.frag -o gbuffer_frag.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" -DNO_FEEDBACK gbuffer.frag -o gbuffer_frag_nofeedback.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" deferred_lighting.comp -o deferred_lighting.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 meshlet.task -o meshlet_task.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 meshlet.mesh -o meshlet_mesh.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" --target-env=vulkan1.2 --target-spv=spv1.4 -DDEPTH_ONLY meshlet.mesh -o meshlet_depth_mesh.spv
+"C:\VulkanSDK\1.4.313.2\Bin\glslc.exe" hiz.comp -o hiz.spv
 pause
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 460
+
+struct MVP
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { uvec4 instances[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Transforms { MVP transforms[]; };
+
+layout(location = 0) in vec3 inPos;
+
+// must match shader.vert bit for bit, the colour pass tests depth for equality
+invariant gl_Position;
+
+void main() {
+
+uint transformIndex = instances[gl_InstanceIndex].x;
+MVP mvp = transforms[transformIndex];
+
+vec4 worldPos = mvp.model * vec4(inPos, 1.0);
+vec4 viewPos = mvp.view * worldPos;
+
+gl_Position = mvp.proj * viewPos;
+}
@@ -0,0 +1,32 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "octahedral.glsl"
+
+#define FEEDBACK_BINDING 10
+#define TEXTURE_SLOT_BINDING 11
+#define TEXTURE_BINDING 12
+#include "texture_feedback.glsl"
+#include "textures.glsl"
+
+layout(location = 0) in vec3 inWorldPos;
+layout(location = 1) in vec3 inWorldNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) flat in uint texIndex;
+
+// world position is rebuilt from depth by the lighting pass
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec2 outNormal;
+
+void main()
+{
+    if (isFeedbackPixel(uvec2(gl_FragCoord.xy)))
+    {
+        float lod = textureQueryLod(getTexture(texIndex), inUV).y;
+        recordTextureFeedback(texIndex, float(textureSize(getTexture(texIndex), 0).x) * exp2(-lod));
+    }
+
+    outAlbedo = vec4(texture(getTexture(texIndex), inUV).rgb, 1.0);
+    outNormal = encodeOctahedral(normalize(inWorldNormal));
+}
@@ -0,0 +1,24 @@
+// triangle fetch from the 32 bit or 16 bit index pool, define INDEX_BINDING and INDEX16_BINDING before including
+
+// set on an instance's base index when its mesh lives in the 16 bit pool, see INSTANCE_INDEX_16
+const uint INSTANCE_INDEX_16 = 0x80000000u;
+
+layout(std430, set = 0, binding = INDEX_BINDING) readonly buffer Indices { uint indices[]; };
+layout(std430, set = 0, binding = INDEX16_BINDING) readonly buffer Indices16 { uint indices16[]; }; // two per uint, low half first
+
+uint getIndex16(uint i)
+{
+	return (indices16[i >> 1] >> ((i & 1u) * 16u)) & 0xFFFFu;
+}
+
+uvec3 getTriangle(uint baseIndex, uint primitive)
+{
+	uint triFirst = (baseIndex & ~INSTANCE_INDEX_16) + 3u * primitive;
+
+	if ((baseIndex & INSTANCE_INDEX_16) != 0u)
+	{
+		return uvec3(getIndex16(triFirst + 0), getIndex16(triFirst + 1), getIndex16(triFirst + 2));
+	}
+
+	return uvec3(indices[triFirst + 0], indices[triFirst + 1], indices[triFirst + 2]);
+}
@@ -0,0 +1,97 @@
+// light structures, buffers and sampling shared by ray tracing shaders
+// the includer defines POINT_LIGHT_BINDING, DIR_LIGHT_BINDING and LIGHT_CDF_BINDING in set 0
+
+struct PointLight
+{
+	vec3 position; float _pad0;
+	vec3 direction; float _pad1;
+	vec3 color; float _pad2;
+
+	float constant;
+	float linear;
+	float quadratic;
+	float _pad3;
+};
+
+struct DirLight
+{
+	vec3 direction; float _pad1;
+	vec3 color; float _pad2;
+};
+
+layout(std430, set = 0, binding = POINT_LIGHT_BINDING) readonly buffer PointLights { PointLight pointLights[]; };
+layout(std430, set = 0, binding = DIR_LIGHT_BINDING) readonly buffer DirLights { DirLight dirLights[]; };
+layout(std430, set = 0, binding = LIGHT_CDF_BINDING) readonly buffer LightCdf { float lightCdf[]; };
+
+// incident light from one light, unshadowed
+struct LightSample
+{
+	vec3 direction;
+	float distance;
+	vec3 radiance;
+};
+
+uint pcgHash(uint v)
+{
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float rand(inout uint seed)
+{
+	seed = pcgHash(seed);
+	return float(seed) / 4294967295.0;
+}
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// point lights come first in the cdf, directional lights after them
+uint sampleLightCdf(float u, uint lightCount, out float pdf)
+{
+	uint low = 0;
+	uint high = lightCount - 1;
+	while (low < high)
+	{
+		uint mid = (low + high) / 2;
+		if (u < lightCdf[mid])
+		{
+			high = mid;
+		}
+		else
+		{
+			low = mid + 1;
+		}
+	}
+
+	pdf = lightCdf[low] - (low > 0 ? lightCdf[low - 1] : 0.0);
+	return low;
+}
+
+LightSample getLightSample(uint light, uint pointLightCount, vec3 position)
+{
+	LightSample s;
+
+	if (light < pointLightCount)
+	{
+		PointLight pointLight = pointLights[light];
+		vec3 toLight = pointLight.position - position;
+
+		s.distance = length(toLight);
+		s.direction = toLight / s.distance;
+		s.radiance = pointLight.color / (pointLight.constant + pointLight.linear * s.distance + pointLight.quadratic * s.distance * s.distance);
+	}
+	else
+	{
+		DirLight dirLight = dirLights[light - pointLightCount];
+
+		s.distance = 10000.0;
+		s.direction = normalize(-dirLight.direction);
+		s.radiance = dirLight.color;
+	}
+
+	return s;
+}
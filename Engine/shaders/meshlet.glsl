@@ -0,0 +1,35 @@
+// meshlet data shared by meshlet.task and meshlet.mesh, see Meshlet and MeshletTask
+
+const uint MESHLET_MAX_VERTICES = 64;
+const uint MESHLET_MAX_TRIANGLES = 124;
+const uint MESHLETS_PER_TASK = 32;
+
+struct MVP
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+};
+
+struct Meshlet
+{
+	vec3 center; // object space bounding sphere
+	float radius;
+	vec3 coneAxis;
+	float coneCutoff;
+	uint vertexOffset;
+	uint triangleOffset; // three 8 bit meshlet vertex indices per entry
+	uint vertexCount;
+	uint triangleCount;
+};
+
+// handed from a task shader workgroup to the mesh shader workgroups it launches
+struct TaskPayload
+{
+	uint instance;
+	uint meshlets[MESHLETS_PER_TASK];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { uvec4 instances[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Transforms { MVP transforms[]; };
+layout(std430, set = 0, binding = 8) readonly buffer Meshlets { Meshlet meshlets[]; };
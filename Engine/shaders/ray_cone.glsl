@@ -0,0 +1,34 @@
+// texture footprint of a pixel's ray cone at a hit, define POSITION_BINDING and CAMERA_BINDING before including
+// the including shader declares vertices, the uvs are read from there
+
+layout(std430, set = 0, binding = POSITION_BINDING) readonly buffer Positions { float positions[]; }; // tightly packed vec3
+layout(set = 0, binding = CAMERA_BINDING) uniform Camera
+{
+	mat4 viewInv;
+	mat4 projInv;
+	mat4 prevViewProj;
+	vec4 prevPosition;
+	float fieldOfView; // vertical, radians
+} camera;
+
+// texels across a texture that the cone covers at gl_HitTEXT, the spread is that of the camera
+float getFootprintTexels(uvec3 idx)
+{
+	mat3 toWorld = mat3(gl_ObjectToWorldEXT);
+	vec3 p0 = vec3(positions[3 * idx.x], positions[3 * idx.x + 1], positions[3 * idx.x + 2]);
+	vec3 p1 = vec3(positions[3 * idx.y], positions[3 * idx.y + 1], positions[3 * idx.y + 2]);
+	vec3 p2 = vec3(positions[3 * idx.z], positions[3 * idx.z + 1], positions[3 * idx.z + 2]);
+	float worldArea = length(cross(toWorld * (p1 - p0), toWorld * (p2 - p0)));
+
+	vec2 uv0 = unpackHalf2x16(vertices[idx.x].uv);
+	vec2 uv1 = unpackHalf2x16(vertices[idx.y].uv);
+	vec2 uv2 = unpackHalf2x16(vertices[idx.z].uv);
+	vec2 e1 = uv1 - uv0;
+	vec2 e2 = uv2 - uv0;
+	float uvArea = abs(e1.x * e2.y - e1.y * e2.x);
+
+	float spread = 2.0 * tan(0.5 * camera.fieldOfView) / float(gl_LaunchSizeEXT.y);
+	float footprint = gl_HitTEXT * spread * sqrt(uvArea / max(worldArea, 1e-12));
+
+	return 1.0 / max(footprint, 1e-6);
+}
@@ -0,0 +1,34 @@
+// reservoir helpers shared by the closest hit shader and the resampling passes
+
+struct Reservoir
+{
+	uint light;
+	float weightSum;
+	float sampleCount;
+	float weight; // unbiased contribution weight of the selected light
+};
+
+Reservoir emptyReservoir()
+{
+	return Reservoir(0, 0.0, 0.0, 0.0);
+}
+
+// streams a candidate with the given resampling weight into the reservoir
+bool updateReservoir(inout Reservoir r, uint light, float weight, float sampleCount, float u)
+{
+	r.weightSum += weight;
+	r.sampleCount += sampleCount;
+
+	if (u * r.weightSum < weight)
+	{
+		r.light = light;
+		return true;
+	}
+
+	return false;
+}
+
+void finalizeReservoir(inout Reservoir r, float targetPdf)
+{
+	r.weight = targetPdf > 0.0 && r.sampleCount > 0.0 ? r.weightSum / (r.sampleCount * targetPdf) : 0.0;
+}
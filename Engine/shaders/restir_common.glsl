@@ -0,0 +1,72 @@
+// bindings and surface reconstruction shared by the resampling compute passes
+
+#define POINT_LIGHT_BINDING 1
+#define DIR_LIGHT_BINDING 2
+#define LIGHT_CDF_BINDING 3
+#include "lights.glsl"
+#include "restir.glsl"
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform Camera
+{
+	mat4 viewInv;
+	mat4 projInv;
+	mat4 prevViewProj;
+	vec4 prevPosition;
+} camera;
+
+layout(set = 0, binding = 4) uniform accelerationStructureEXT topLevelAS;
+layout(set = 0, binding = 5, rgba32f) uniform readonly image2D gbuffer;
+layout(set = 0, binding = 6, rgba32f) uniform readonly image2D prevGbuffer;
+layout(std430, set = 0, binding = 7) buffer InitialReservoirs { Reservoir initialReservoirs[]; };
+layout(std430, set = 0, binding = 8) buffer TemporalReservoirs { Reservoir temporalReservoirs[]; };
+layout(std430, set = 0, binding = 9) buffer Reservoirs { Reservoir reservoirs[]; };
+layout(set = 0, binding = 10, rgba8) uniform readonly image2D albedoImage;
+layout(set = 0, binding = 11, rgba16f) uniform image2D resultImage;
+
+layout(push_constant) uniform PushConstants
+{
+	uvec2 extent;
+	uint pointLightCount;
+	uint dirLightCount;
+
+	uint seed;
+	uint reset;
+	float spatialRadius;
+	float _pad0;
+} constants;
+
+uint getPixelIndex(ivec2 pixel)
+{
+	return uint(pixel.y) * constants.extent.x + uint(pixel.x);
+}
+
+bool isInside(ivec2 pixel)
+{
+	return all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, ivec2(constants.extent)));
+}
+
+// reconstruct the world position of the primary hit, matching the ray generated in raygen
+vec3 getWorldPosition(ivec2 pixel, float hitT)
+{
+	vec2 d = (vec2(pixel) + 0.5) / vec2(constants.extent) * 2.0 - 1.0;
+
+	vec4 origin = camera.viewInv * vec4(0, 0, 0, 1);
+	vec4 target = camera.projInv * vec4(d.x, d.y, 1, 1);
+	vec4 direction = camera.viewInv * vec4(normalize(target.xyz), 0);
+
+	return origin.xyz + direction.xyz * hitT;
+}
+
+// unshadowed luminance reaching the surface from a light, the resampling target
+float getTargetPdf(uint light, vec3 position, vec3 normal)
+{
+	LightSample s = getLightSample(light, constants.pointLightCount, position);
+	return luminance(s.radiance) * max(dot(normal, s.direction), 0.0);
+}
+
+bool isSimilar(vec4 a, vec4 b)
+{
+	return b.w >= 0.0 && dot(a.xyz, b.xyz) > 0.9 && abs(a.w - b.w) < 0.1 * a.w;
+}
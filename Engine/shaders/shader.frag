@@ -1,5 +1,9 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : enable
+#ifdef RAY_QUERY_SHADOWS
+#extension GL_EXT_ray_query : require
+#endif
 
 struct PointLight
 {
@@ -26,7 +30,21 @@ layout(set = 0, binding = 4) uniform Camera
     mat4 viewInv;
     mat4 projInv;
 } camera;
-layout(set = 0, binding = 5) uniform sampler2D textures[];
+
+// after the mesh shading bindings, see Rasterizer::createDescriptorSets
+#define FEEDBACK_BINDING 14
+#define TEXTURE_SLOT_BINDING 15
+#define TEXTURE_BINDING 16
+#include "texture_feedback.glsl"
+#include "textures.glsl"
+
+#ifdef RAY_QUERY_SHADOWS
+// acceleration structures of the ray tracer, only shadow rays are traced
+layout(set = 0, binding = 5) uniform accelerationStructureEXT topLevelAS;
+
+// instance mask bits of shadow casters, see InstanceMask
+const uint INSTANCE_MASK_CASTER = 0x02 | 0x04;
+#endif
 
 layout( push_constant ) uniform PushConstants
 {
@@ -58,6 +76,25 @@ float getDiffuse(int i, vec3 L)
     return diff;
 }
 
+// 1 if nothing lies between the surface and the light, alpha tested casters are treated as opaque
+float getVisibility(vec3 L, float dist)
+{
+#ifdef RAY_QUERY_SHADOWS
+    vec3 origin = inWorldPos + normalize(inWorldNormal) * 0.001;
+
+    rayQueryEXT rayQuery;
+    rayQueryInitializeEXT(rayQuery, topLevelAS, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT, INSTANCE_MASK_CASTER, origin, 0.001, L, dist - 0.01);
+
+    while (rayQueryProceedEXT(rayQuery))
+    {
+    }
+
+    return rayQueryGetIntersectionTypeEXT(rayQuery, true) == gl_RayQueryCommittedIntersectionNoneEXT ? 1.0 : 0.0;
+#else
+    return 1.0;
+#endif
+}
+
 float getSpecular(int i, vec3 L)
 {
     vec3 N = normalize(inWorldNormal);
@@ -73,7 +110,7 @@ float getSpecular(int i, vec3 L)
 
 vec3 getPointLight(int i)
 {
-    vec3 colorDiff = texture(textures[texIndex], inUV).rgb;
+    vec3 colorDiff = texture(getTexture(texIndex), inUV).rgb;
     vec3 L = normalize(pointLights[i].position - inWorldPos);
 
     vec3 ambient = getAmbient(i) * colorDiff * pointLights[i].color.rgb;
@@ -82,27 +119,39 @@ vec3 getPointLight(int i)
 
     float dist = length(pointLights[i].position - inWorldPos);
     float attenuation = 1.0 / (pointLights[i].constant + pointLights[i].linear * dist + pointLights[i].quadratic * (dist * dist));
+    float visibility = getVisibility(L, dist);
     ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    diffuse *= attenuation * visibility;
+    specular *= attenuation * visibility;
 
     return (ambient + diffuse + specular);
 }
 
 vec3 getDirLight(int i)
 {
-    vec3 colorDiff = texture(textures[texIndex], inUV).rgb;
+    vec3 colorDiff = texture(getTexture(texIndex), inUV).rgb;
     vec3 L = normalize(-dirLights[i].direction);
 
     vec3 ambient = getAmbient(i) * colorDiff * dirLights[i].color.rgb;
     vec3 diffuse = getDiffuse(i, L) * colorDiff * dirLights[i].color.rgb;
     vec3 specular = getSpecular(i, L) * dirLights[i].color.rgb;
 
+    float visibility = getVisibility(L, 10000.0);
+    diffuse *= visibility;
+    specular *= visibility;
+
     return (ambient + diffuse + specular);
 }
 
 void main() 
 {
+    // the lod is relative to the resident top level, which may be coarser than the texture
+    if (isFeedbackPixel(uvec2(gl_FragCoord.xy)))
+    {
+        float lod = textureQueryLod(getTexture(texIndex), inUV).y;
+        recordTextureFeedback(texIndex, float(textureSize(getTexture(texIndex), 0).x) * exp2(-lod));
+    }
+
     vec3 lighting = vec3(0.0);
 
     for (int i = 0; i < int(constants.numDirLights); i++)
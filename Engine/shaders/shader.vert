@@ -1,5 +1,8 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "octahedral.glsl"
 
 struct MVP
 {
@@ -12,7 +15,7 @@ layout(std430, set = 0, binding = 0) readonly buffer Instances { uvec4 instances
 layout(std430, set = 0, binding = 1) readonly buffer Transforms { MVP transforms[]; };
 
 layout(location = 0) in vec3 inPos;
-layout(location = 1) in vec3 inNormal;
+layout(location = 1) in vec2 inNormal; // octahedral
 layout(location = 2) in vec2 inUV;
 
 layout(location = 0) out vec3 outWorldPos;
@@ -20,6 +23,9 @@ layout(location = 1) out vec3 outWorldNormal;
 layout(location = 2) out vec2 outUV;
 layout(location = 3) flat out uint outTexIndex;
 
+// shared with depth.vert, the pre-pass depth is compared for equality
+invariant gl_Position;
+
 void main() {
 
 // get instance data
@@ -36,7 +42,7 @@ outWorldPos = worldPos.xyz;
 
 // transform normal to world space
 mat3 normalMat = mat3(transpose(inverse(mvp.model)));
-vec3 worldNormal = normalize(normalMat * inNormal);
+vec3 worldNormal = normalize(normalMat * decodeOctahedral(inNormal));
 outWorldNormal = worldNormal;
 
 outUV = inUV;
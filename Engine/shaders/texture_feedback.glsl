@@ -0,0 +1,31 @@
+// texture streaming feedback, define FEEDBACK_BINDING before including
+// each texture keeps the most texels across it was sampled at since the streamer last read it, see TextureStreamer
+
+// NO_FEEDBACK builds fragment shaders for devices without fragmentStoresAndAtomics, nothing is written
+#ifndef NO_FEEDBACK
+layout(std430, set = 0, binding = FEEDBACK_BINDING) buffer TextureFeedback { uint textureFeedback[]; };
+#endif
+
+// a resolution of 65535 asks for the full texture
+void recordTextureFeedback(uint texIndex, float texels)
+{
+#ifndef NO_FEEDBACK
+    uint resolution = uint(clamp(texels, 1.0, 65535.0));
+
+    // the value is usually there already, reading first keeps the atomics rare
+    if (textureFeedback[texIndex] < resolution)
+    {
+        atomicMax(textureFeedback[texIndex], resolution);
+    }
+#endif
+}
+
+// one pixel in 16 records, enough for any surface larger than a few pixels
+bool isFeedbackPixel(uvec2 pixel)
+{
+#ifdef NO_FEEDBACK
+    return false;
+#else
+    return (pixel.x & 3u) == 0u && (pixel.y & 3u) == 0u;
+#endif
+}
@@ -0,0 +1,8 @@
+// bindless textures by id, define TEXTURE_SLOT_BINDING and TEXTURE_BINDING before including
+// the slot table maps an id to its element of the array, which changes as the registry replaces the image, see TextureRegistry
+
+layout(std430, set = 0, binding = TEXTURE_SLOT_BINDING) readonly buffer TextureSlots { uint textureSlots[]; };
+layout(set = 0, binding = TEXTURE_BINDING) uniform sampler2D textures[];
+
+// samplers can not be returned from functions
+#define getTexture(id) textures[nonuniformEXT(textureSlots[id])]
@@ -0,0 +1,11 @@
+#version 460
+
+layout(location = 0) flat in uint inInstance;
+
+// instance record and triangle within the draw, resolved to attributes by visbuffer_shade
+layout(location = 0) out uvec2 outVisibility;
+
+void main()
+{
+    outVisibility = uvec2(inInstance, gl_PrimitiveID);
+}
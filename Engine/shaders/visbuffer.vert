@@ -0,0 +1,23 @@
+#version 460
+
+struct MVP
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { uvec4 instances[]; };
+layout(std430, set = 0, binding = 1) readonly buffer Transforms { MVP transforms[]; };
+
+layout(location = 0) in vec3 inPos;
+
+layout(location = 0) flat out uint outInstance;
+
+void main()
+{
+    MVP mvp = transforms[instances[gl_InstanceIndex].x];
+    outInstance = gl_InstanceIndex;
+
+    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPos, 1.0);
+}
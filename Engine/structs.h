@@ -10,6 +10,7 @@
 
 #include "unk_buffer.h"
 #include "unk_image.h"
+#include "texture_registry.h"
 
 using namespace glm;
 using namespace std;
@@ -18,21 +19,111 @@ struct Instance
 {
 	uint32_t transformIndex;
 	uint32_t textureIndex;
-	uint32_t baseIndex;
+	uint32_t baseIndex; // INSTANCE_INDEX_16 is set when the mesh's indices live in the 16 bit pool
 	uint32_t baseVertex;
 };
 
+const uint32_t INSTANCE_INDEX_16 = 0x80000000u;
+
+// top level instance mask bits, rays only traverse instances that share a bit with their cull mask
+enum InstanceMask : uint8_t
+{
+	INSTANCE_MASK_PRIMARY = 0x01,
+	INSTANCE_MASK_OPAQUE_CASTER = 0x02,
+	INSTANCE_MASK_ALPHA_CASTER = 0x04
+};
+
+// selects the hit group of a mesh
+enum MaterialClass : uint32_t
+{
+	MATERIAL_OPAQUE,
+	MATERIAL_ALPHA_TESTED, // diffuse texture has cut out texels, shadow rays run the any-hit alpha test, keeps its emission
+	MATERIAL_EMISSIVE,
+	MATERIAL_UNLIT, // albedo only, no light sampling
+	MATERIAL_CLASS_COUNT
+};
+
+// inline data following the group handle of a hit record, read through shaderRecordEXT
+struct HitRecord
+{
+	vec3 emission;
+	float alphaCutoff;
+};
+
+// a simplified index range of a mesh, drawn with the mesh's own vertices
+struct MeshLod
+{
+	uint32_t firstIndex = 0; // into the pool of the mesh's indexType
+	uint32_t indexCount = 0;
+	float error = 0.0f; // object space distance to the full detail surface
+
+	uint32_t firstMeshlet = 0; // partition of the level's triangles, see Meshlet
+	uint32_t meshletCount = 0;
+};
+
+// meshlet limits, 124 triangles keeps the packed primitive indices of a meshlet within 128 entries
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+const uint32_t MESHLETS_PER_TASK = 32; // one task shader workgroup culls this many meshlets of one instance
+
+// a small cluster of a mesh's triangles, culled as a whole by the task shader
+struct Meshlet
+{
+	vec3 center; // object space bounding sphere
+	float radius;
+
+	vec3 coneAxis; // average facing of the triangles
+	float coneCutoff; // cosine of 90 degrees less the normal cone half angle, 1 when the triangles face too many ways to cull
+
+	uint32_t vertexOffset; // into the meshlet vertex pool, which holds vertex indices local to the mesh
+	uint32_t triangleOffset; // into the meshlet triangle pool, three 8 bit meshlet vertex indices per entry
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+// meshlets of one instance handed to a task shader workgroup
+struct MeshletTask
+{
+	uint32_t instance;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount; // at most MESHLETS_PER_TASK
+	uint32_t lodBase; // the level's entry in instanceLods, tasks of levels the instance is not drawn with emit nothing
+};
+
 struct Mesh
 {
 	int32_t vertexOffset = 0; // first vertex corrseponding to this mesh
 	uint32_t vertexCount = 0;
 
 	uint32_t indexCount = 0;
-	uint32_t firstIndex = 0;
+	uint32_t firstIndex = 0; // into the pool of indexType
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32; // 16 bit when every vertex of the mesh can be addressed with it
+
+	vector<MeshLod> lods; // coarser with every level, the first is the full mesh above
+	vec3 boundsCenter = vec3(0.0f); // object space bounding sphere
+	float boundsRadius = 0.0f;
 
 	uint32_t instanceCount = 0;
 	uint32_t firstInstance = -1;
 
+	MaterialClass materialClass = MATERIAL_OPAQUE;
+	vec3 emission = vec3(0.0f);
+	bool castsShadows = true;
+	bool doubleSided = true; // back faces are visible, raster passes may not cull them
+
+	bool isAlphaTested() const { return materialClass == MATERIAL_ALPHA_TESTED; }
+
+	uint8_t getInstanceMask() const
+	{
+		uint8_t mask = INSTANCE_MASK_PRIMARY;
+		if (castsShadows)
+		{
+			mask |= isAlphaTested() ? INSTANCE_MASK_ALPHA_CASTER : INSTANCE_MASK_OPAQUE_CASTER;
+		}
+
+		return mask;
+	}
+
 	VkDrawIndexedIndirectCommand getDrawCommand()
 	{
 		VkDrawIndexedIndirectCommand drawCommand
@@ -46,6 +137,21 @@ struct Mesh
 
 		return drawCommand;
 	}
+
+	// a run of this mesh's instances drawn at one level of detail
+	VkDrawIndexedIndirectCommand getDrawCommand(uint32_t lod, uint32_t firstInstance, uint32_t instanceCount)
+	{
+		VkDrawIndexedIndirectCommand drawCommand
+		{
+			.indexCount = lods[lod].indexCount,
+			.instanceCount = instanceCount,
+			.firstIndex = lods[lod].firstIndex,
+			.vertexOffset = this->vertexOffset,
+			.firstInstance = firstInstance
+		};
+
+		return drawCommand;
+	}
 };
 
 struct PushConstants
@@ -55,6 +161,88 @@ struct PushConstants
 	float _pad0[2];
 };
 
+// task stage range following PushConstants in the mesh shading layout
+struct MeshletPushConstants
+{
+	uint32_t firstTask; // draws are split at the task workgroup count limit
+	uint32_t coneCulling; // the draw's meshes are single sided, meshlets facing away are dropped
+	uint32_t pyramidWidth; // level 0 of the depth pyramid
+	uint32_t pyramidHeight;
+
+	uint32_t pyramidLevels; // zero when the pyramid does not hold the previous frame
+	uint32_t _pad0[3];
+};
+
+struct DepthPyramidPushConstants
+{
+	uint32_t sourceWidth;
+	uint32_t sourceHeight;
+	uint32_t width; // level 0
+	uint32_t height;
+
+	uint32_t level; // written by this dispatch, level 0 reads the depth image and the rest the level before
+	uint32_t _pad0[3];
+};
+
+struct RayPushConstants
+{
+	uint32_t frame; // samples accumulated before this one
+	uint32_t gbufferIndex; // denoiser guide images written this frame
+	uint32_t pointLightCount;
+	uint32_t dirLightCount;
+
+	uint32_t seed; // changes every traced frame
+	uint32_t restir; // write reservoirs instead of shading direct light
+	uint32_t alphaShadows; // some shadow casters need the any-hit alpha test
+	uint32_t _pad0;
+};
+
+struct DenoisePushConstants
+{
+	uint32_t width;
+	uint32_t height;
+	int32_t stepSize;
+	uint32_t reset; // discard history
+
+	float sigmaLuminance;
+	float sigmaNormal;
+	float sigmaDepth;
+	float _pad0;
+};
+
+struct RestirPushConstants
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t pointLightCount;
+	uint32_t dirLightCount;
+
+	uint32_t seed;
+	uint32_t reset; // discard history
+	float spatialRadius; // pixels
+	float _pad0;
+};
+
+struct Reservoir
+{
+	uint32_t light;
+	float weightSum;
+	float sampleCount;
+	float weight; // unbiased contribution weight of the selected light
+};
+
+struct ResolvePushConstants
+{
+	uint32_t tonemap;
+	uint32_t encodeSrgb; // storage writes bypass srgb encoding
+	float exposure;
+	float sharpness; // applied when upscaling
+
+	uint32_t sourceWidth;
+	uint32_t sourceHeight;
+	float _pad0[2];
+};
+
 struct DirectionalLight
 {
 	vec3 direction; float _pad0;
@@ -80,25 +268,32 @@ struct MVP
 	mat4 proj;
 };
 
-struct Vertex
+// a contiguous range of draw commands that share an index pool and face culling
+struct DrawGroup
 {
-	vec3 position; float _pad0;
-	vec3 normal; float _pad1;
-	vec2 texCoord; vec2 _pad2;
+	VkIndexType indexType;
+	bool doubleSided;
+	uint32_t firstDraw;
+	uint32_t drawCount; // changes every frame with level of detail selection
+	vector<uint32_t> meshes; // in draw order, room is reserved for a draw per instance
+};
 
-	bool operator==(const Vertex& other) const
-	{
-		return position == other.position && normal == other.normal && texCoord == other.texCoord;
-	}
+// shading attributes of a vertex, positions are kept in their own tightly packed stream
+struct VertexAttributes
+{
+	uint32_t normal; // octahedral, snorm 2x16
+	uint32_t texCoord; // half 2x16
 };
 
 struct DeviceResources
 {
 	vector<Mesh> meshes;
 
-	UnkBuffer* vertexBuffer;
+	UnkBuffer* positionBuffer; // vec3 per vertex, the only stream read by depth passes and acceleration structure builds
+	UnkBuffer* attributeBuffer; // VertexAttributes per vertex
 
-	UnkBuffer* indexBuffer;
+	UnkBuffer* indexBuffer; // 32 bit pool
+	UnkBuffer* index16Buffer; // 16 bit pool, read as pairs packed into a uint by shaders
 
 	vector<Instance> instances;
 	UnkBuffer* instanceBuffer;
@@ -111,33 +306,68 @@ struct DeviceResources
 	UnkBuffer* pointLightBuffer;
 	UnkBuffer* dirLightBuffer;
 
+	vector<float> lightCdf; // over point lights followed by directional lights, by emitted power
+	UnkBuffer* lightCdfBuffer;
+
 	UnkBuffer* cameraBuffer;
 
 	VkSampler sampler;
-	vector<UnkImage*> textureImages;
+	TextureRegistry* textures; // bindless array of every pipeline, instances hold texture ids into it
+	UnkBuffer* textureFeedbackBuffer; // uint per texture id, the most texels across it was sampled at, read back by the streamer
 
 	UnkBuffer* drawCommandBuffer;
+	vector<uint32_t> instanceLods; // by instance, first index of the level drawn this frame flagged like Instance::baseIndex
+	UnkBuffer* instanceLodBuffer;
+
+	// by swapchain image, selectLods fills those of the frame it prepares and the frame's command buffer copies them
+	vector<UnkBuffer*> drawCommandStaging;
+	vector<UnkBuffer*> instanceLodStaging;
+	vector<DrawGroup> drawGroups; // draw commands are sorted by index type, then single sided before double sided
+
+	UnkBuffer* meshletBuffer;
+	UnkBuffer* meshletVertexBuffer;
+	UnkBuffer* meshletTriangleBuffer;
+
+	vector<MeshletTask> meshletTasks; // single sided meshes first
+	uint32_t singleSidedTaskCount = 0;
+	UnkBuffer* meshletTaskBuffer;
+
+	uint32_t frame = 0; // frames rendered, history kept by a pipeline is only valid if it drew the previous one
+	bool viewChanged = false; // the camera moved or turned since the previous frame, whose depth then misses what came into view
 
 	void destroy(UnkDevice* device)
 	{
-		delete vertexBuffer;
+		delete positionBuffer;
+		delete attributeBuffer;
 		delete indexBuffer;
+		delete index16Buffer;
 		delete instanceBuffer;
 		delete transformBuffer;
 		delete pointLightBuffer;
 		delete dirLightBuffer;
+		delete lightCdfBuffer;
 		delete cameraBuffer;
 		delete drawCommandBuffer;
+		delete instanceLodBuffer;
+
+		for (UnkBuffer* buffer : drawCommandStaging) delete buffer;
+		for (UnkBuffer* buffer : instanceLodStaging) delete buffer;
+		delete meshletBuffer;
+		delete meshletVertexBuffer;
+		delete meshletTriangleBuffer;
+		delete meshletTaskBuffer;
+		delete textureFeedbackBuffer;
+		delete textures;
 
 		if (sampler != VK_NULL_HANDLE)
 		{
 			vkDestroySampler(device->device, sampler, nullptr);
 		}
+	}
 
-		for (auto& image : textureImages)
-		{
-			delete image;
-		}
+	UnkBuffer* getIndexBuffer(VkIndexType indexType)
+	{
+		return indexType == VK_INDEX_TYPE_UINT16 ? index16Buffer : indexBuffer;
 	}
 };
 
@@ -160,6 +390,13 @@ struct CameraGPU
 {
 	mat4 viewInv;
 	mat4 projInv;
+
+	// previous frame, used for temporal reprojection
+	mat4 prevViewProj;
+	vec4 prevPosition;
+
+	float fieldOfView; // vertical, radians
+	float _pad0[3];
 };
 
 struct Camera
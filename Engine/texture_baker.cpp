@@ -0,0 +1,531 @@
+#include "texture_baker.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+/*
+* Little endian bit stream over one 128 bit block
+*/
+struct BlockWriter
+{
+	uint8_t* out;
+	uint32_t position = 0;
+
+	void write(uint32_t value, uint32_t bits)
+	{
+		for (uint32_t i = 0; i < bits; i++, position++)
+		{
+			if (value & (1u << i)) out[position / 8] |= static_cast<uint8_t>(1u << (position % 8));
+		}
+	}
+};
+
+/*
+* Direction of greatest variance of the points, the box diagonal if they are all the same colour
+*/
+template <typename T>
+static T principalAxis(const T* points, uint32_t count)
+{
+	T mean(0.0f);
+	T low(FLT_MAX);
+	T high(-FLT_MAX);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mean += points[i];
+		low = min(low, points[i]);
+		high = max(high, points[i]);
+	}
+	mean /= static_cast<float>(count);
+
+	// power iteration on the covariance, applied point by point
+	T axis = high - low;
+	for (uint32_t iteration = 0; iteration < 8; iteration++)
+	{
+		T next(0.0f);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			T d = points[i] - mean;
+			next += d * dot(d, axis);
+		}
+
+		float len = length(next);
+		if (len < 1e-6f) break;
+		axis = next / len;
+	}
+
+	return axis;
+}
+
+static uint16_t packRgb565(const vec3& color)
+{
+	uint32_t r = static_cast<uint32_t>(std::clamp(color.r, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	uint32_t g = static_cast<uint32_t>(std::clamp(color.g, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+	uint32_t b = static_cast<uint32_t>(std::clamp(color.b, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static vec3 unpackRgb565(uint16_t color)
+{
+	uint32_t r = (color >> 11) & 31;
+	uint32_t g = (color >> 5) & 63;
+	uint32_t b = color & 31;
+	return vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+BakedTexture TextureBaker::bake(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCodec codec, bool srgb, bool alpha)
+{
+	BakedTexture texture
+	{
+		.codec = codec,
+		.format = getFormat(codec, srgb),
+		.width = width,
+		.height = height,
+		.alpha = alpha
+	};
+
+	uint32_t blockSize = getBlockSize(codec);
+	uint32_t levelCount = UnkImage::getMipLevelCount(width, height);
+
+	vector<uint8_t> level(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	vector<uint8_t> next;
+	uint32_t levelWidth = width;
+	uint32_t levelHeight = height;
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		if (i > 0)
+		{
+			uint32_t nextWidth = std::max(levelWidth / 2, 1u);
+			uint32_t nextHeight = std::max(levelHeight / 2, 1u);
+
+			next.resize(static_cast<size_t>(nextWidth) * nextHeight * 4);
+			UnkImage::downsample(level.data(), levelWidth, levelHeight, next.data(), srgb);
+			swap(level, next);
+
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+		}
+
+		size_t offset = texture.data.size();
+		texture.levelOffsets.push_back(offset);
+
+		if (codec == TEXTURE_CODEC_NONE)
+		{
+			texture.data.insert(texture.data.end(), level.begin(), level.end());
+			continue;
+		}
+
+		size_t blocks = static_cast<size_t>((levelWidth + 3) / 4) * ((levelHeight + 3) / 4);
+		texture.data.resize(offset + blocks * blockSize);
+		encodeLevel(level.data(), levelWidth, levelHeight, codec, texture.data.data() + offset);
+	}
+
+	return texture;
+}
+
+/*
+* Rows of blocks are dealt out to the hardware threads, blocks over the edge repeat the last texel
+*/
+void TextureBaker::encodeLevel(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCodec codec, uint8_t* out)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t blockSize = getBlockSize(codec);
+
+	auto encodeRows = [&](uint32_t first, uint32_t step)
+	{
+		uint8_t block[16 * 4];
+
+		for (uint32_t by = first; by < blocksY; by += step)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				for (uint32_t y = 0; y < 4; y++)
+				{
+					for (uint32_t x = 0; x < 4; x++)
+					{
+						uint32_t px = std::min(bx * 4 + x, width - 1);
+						uint32_t py = std::min(by * 4 + y, height - 1);
+						memcpy(block + (y * 4 + x) * 4, pixels + (static_cast<size_t>(py) * width + px) * 4, 4);
+					}
+				}
+
+				uint8_t* target = out + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+				memset(target, 0, blockSize);
+
+				switch (codec)
+				{
+				case TEXTURE_CODEC_BC1: encodeBC1(block, target); break;
+				case TEXTURE_CODEC_BC3: encodeBC3(block, target); break;
+				case TEXTURE_CODEC_BC5: encodeBC5(block, target); break;
+				case TEXTURE_CODEC_BC7: encodeBC7(block, target); break;
+				}
+			}
+		}
+	};
+
+	uint32_t threadCount = std::min(std::max(thread::hardware_concurrency(), 1u), blocksY);
+
+	// small levels are not worth the threads
+	if (threadCount <= 1 || static_cast<size_t>(blocksX) * blocksY < 256)
+	{
+		encodeRows(0, 1);
+		return;
+	}
+
+	vector<thread> threads;
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back(encodeRows, i, threadCount);
+	}
+
+	for (thread& worker : threads)
+	{
+		worker.join();
+	}
+}
+
+/*
+* Always in four colour mode, so the colour block can be shared with BC3
+*/
+void TextureBaker::encodeBC1(const uint8_t* block, uint8_t* out)
+{
+	vec3 colors[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		colors[i] = vec3(block[i * 4 + 0], block[i * 4 + 1], block[i * 4 + 2]);
+	}
+
+	vec3 axis = principalAxis(colors, 16);
+
+	vec3 low = colors[0];
+	vec3 high = colors[0];
+	float lowDot = FLT_MAX;
+	float highDot = -FLT_MAX;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float d = dot(colors[i], axis);
+		if (d < lowDot) { lowDot = d; low = colors[i]; }
+		if (d > highDot) { highDot = d; high = colors[i]; }
+	}
+
+	// inset the endpoints a little, the extremes are rarely worth representing exactly
+	vec3 inset = (high - low) / 16.0f;
+	uint16_t c0 = packRgb565(high - inset);
+	uint16_t c1 = packRgb565(low + inset);
+	if (c0 < c1) swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		vec3 e0 = unpackRgb565(c0);
+		vec3 e1 = unpackRgb565(c1);
+		vec3 palette[4] = { e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f };
+
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t best = 0;
+			float bestError = FLT_MAX;
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				vec3 d = colors[i] - palette[j];
+				float error = dot(d, d);
+				if (error < bestError) { bestError = error; best = j; }
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(c0 & 0xFF);
+	out[1] = static_cast<uint8_t>(c0 >> 8);
+	out[2] = static_cast<uint8_t>(c1 & 0xFF);
+	out[3] = static_cast<uint8_t>(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+
+/*
+* Eight value mode between the channel's minimum and maximum
+*/
+void TextureBaker::encodeBC4(const uint8_t* block, uint32_t channel, uint8_t* out)
+{
+	uint8_t low = 255;
+	uint8_t high = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		low = std::min(low, block[i * 4 + channel]);
+		high = std::max(high, block[i * 4 + channel]);
+	}
+
+	out[0] = high;
+	out[1] = low;
+	if (high == low) return;
+
+	// palette entries 2 to 7 step from high towards low
+	float palette[8] = { static_cast<float>(high), static_cast<float>(low) };
+	for (uint32_t j = 1; j < 7; j++)
+	{
+		palette[j + 1] = ((7 - j) * high + j * low) / 7.0f;
+	}
+
+	BlockWriter writer{ .out = out, .position = 16 };
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t best = 0;
+		float bestError = FLT_MAX;
+		for (uint32_t j = 0; j < 8; j++)
+		{
+			float error = abs(block[i * 4 + channel] - palette[j]);
+			if (error < bestError) { bestError = error; best = j; }
+		}
+		writer.write(best, 3);
+	}
+}
+
+void TextureBaker::encodeBC3(const uint8_t* block, uint8_t* out)
+{
+	encodeBC4(block, 3, out);
+	encodeBC1(block, out + 8);
+}
+
+void TextureBaker::encodeBC5(const uint8_t* block, uint8_t* out)
+{
+	encodeBC4(block, 0, out);
+	encodeBC4(block, 1, out + 8);
+}
+
+/*
+* Mode 6, one subset with 7 bit rgba endpoints, a shared low bit per endpoint and 4 bit indices
+*/
+void TextureBaker::encodeBC7(const uint8_t* block, uint8_t* out)
+{
+	static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	vec4 texels[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		texels[i] = vec4(block[i * 4 + 0], block[i * 4 + 1], block[i * 4 + 2], block[i * 4 + 3]);
+	}
+
+	vec4 axis = principalAxis(texels, 16);
+
+	vec4 endpoints[2] = { texels[0], texels[0] };
+	float lowDot = FLT_MAX;
+	float highDot = -FLT_MAX;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float d = dot(texels[i], axis);
+		if (d < lowDot) { lowDot = d; endpoints[0] = texels[i]; }
+		if (d > highDot) { highDot = d; endpoints[1] = texels[i]; }
+	}
+
+	// each endpoint keeps whichever low bit reconstructs it best
+	uint32_t quantized[2][4];
+	uint32_t pbits[2];
+	uvec4 decoded[2];
+	for (uint32_t e = 0; e < 2; e++)
+	{
+		float bestError = FLT_MAX;
+		for (uint32_t p = 0; p < 2; p++)
+		{
+			float error = 0.0f;
+			uint32_t q[4];
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				q[c] = static_cast<uint32_t>(std::clamp(roundf((endpoints[e][c] - p) / 2.0f), 0.0f, 127.0f));
+				float d = static_cast<float>(q[c] * 2 + p) - endpoints[e][c];
+				error += d * d;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				pbits[e] = p;
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					quantized[e][c] = q[c];
+					decoded[e][c] = q[c] * 2 + p;
+				}
+			}
+		}
+	}
+
+	uvec4 palette[16];
+	for (uint32_t j = 0; j < 16; j++)
+	{
+		palette[j] = ((64u - weights[j]) * decoded[0] + weights[j] * decoded[1] + 32u) >> 6u;
+	}
+
+	uint32_t indices[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float bestError = FLT_MAX;
+		for (uint32_t j = 0; j < 16; j++)
+		{
+			vec4 d = texels[i] - vec4(palette[j]);
+			float error = dot(d, d);
+			if (error < bestError) { bestError = error; indices[i] = j; }
+		}
+	}
+
+	// the first index is stored without its top bit, swap the endpoints when it is set
+	if (indices[0] & 8)
+	{
+		for (uint32_t c = 0; c < 4; c++) swap(quantized[0][c], quantized[1][c]);
+		swap(pbits[0], pbits[1]);
+		for (uint32_t i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+	}
+
+	BlockWriter writer{ .out = out };
+	writer.write(1u << 6, 7);
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		writer.write(quantized[0][c], 7);
+		writer.write(quantized[1][c], 7);
+	}
+	writer.write(pbits[0], 1);
+	writer.write(pbits[1], 1);
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		writer.write(indices[i], i == 0 ? 3 : 4);
+	}
+}
+
+VkFormat TextureBaker::getFormat(TextureCodec codec, bool srgb)
+{
+	switch (codec)
+	{
+	case TEXTURE_CODEC_BC1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case TEXTURE_CODEC_BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	case TEXTURE_CODEC_BC5: return VK_FORMAT_BC5_UNORM_BLOCK; // no srgb variant, the channels are data
+	case TEXTURE_CODEC_BC7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+	case TEXTURE_CODEC_NONE: return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+uint32_t TextureBaker::getBlockSize(TextureCodec codec)
+{
+	return codec == TEXTURE_CODEC_BC1 ? 8 : 16;
+}
+
+void TextureBaker::writeKtx2(const char* path, const BakedTexture& texture)
+{
+	if (texture.codec == TEXTURE_CODEC_NONE) throw runtime_error("only block compressed textures are written");
+
+	ofstream file(path, ios::binary);
+	if (!file) throw runtime_error("failed to open baked texture for writing");
+
+	auto put = [&](auto value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+	uint32_t levelCount = static_cast<uint32_t>(texture.levelOffsets.size());
+	uint32_t blockSize = getBlockSize(texture.codec);
+	bool srgb = texture.format != getFormat(texture.codec, false);
+
+	// data format descriptor samples, bit offset and length, channel
+	struct Sample { uint16_t offset; uint8_t length; uint8_t channel; };
+	vector<Sample> samples;
+	uint8_t colorModel = 0;
+	switch (texture.codec)
+	{
+	case TEXTURE_CODEC_BC1: colorModel = 128; samples = { { 0, 63, 0 } }; break;
+	case TEXTURE_CODEC_BC3: colorModel = 130; samples = { { 0, 63, 15 | 0x10 }, { 64, 63, 0 } }; break; // alpha is linear
+	case TEXTURE_CODEC_BC5: colorModel = 132; samples = { { 0, 63, 0 }, { 64, 63, 1 } }; break;
+	case TEXTURE_CODEC_BC7: colorModel = 134; samples = { { 0, 127, 0 } }; break;
+	}
+
+	const uint32_t headerSize = 80;
+	uint32_t dfdOffset = headerSize + levelCount * 24;
+	uint32_t dfdSize = 4 + 24 + static_cast<uint32_t>(samples.size()) * 16;
+
+	// one key value pair, whether the texture needs alpha testing, padded to 4 bytes
+	const char alphaKey[] = "UnkAlpha";
+	uint32_t kvdOffset = dfdOffset + dfdSize;
+	uint32_t kvdEntrySize = sizeof(alphaKey) + 1;
+	uint32_t kvdSize = (4 + kvdEntrySize + 3) & ~3u;
+
+	// levels are aligned to the block size, smallest first
+	vector<uint64_t> fileOffsets(levelCount);
+	uint64_t end = kvdOffset + kvdSize;
+	for (uint32_t i = levelCount; i-- > 0;)
+	{
+		end = (end + 15) & ~15ull;
+		fileOffsets[i] = end;
+
+		size_t levelEnd = i + 1 < levelCount ? texture.levelOffsets[i + 1] : texture.data.size();
+		end += levelEnd - texture.levelOffsets[i];
+	}
+
+	const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(identifier), sizeof(identifier));
+
+	put(static_cast<uint32_t>(texture.format));
+	put(1u); // type size
+	put(texture.width);
+	put(texture.height);
+	put(0u); // depth
+	put(0u); // layers
+	put(1u); // faces
+	put(levelCount);
+	put(0u); // no supercompression
+
+	put(dfdOffset);
+	put(dfdSize);
+	put(kvdOffset);
+	put(kvdSize);
+	put(0ull); // no supercompression global data
+	put(0ull);
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		size_t levelEnd = i + 1 < levelCount ? texture.levelOffsets[i + 1] : texture.data.size();
+		uint64_t levelSize = levelEnd - texture.levelOffsets[i];
+
+		put(fileOffsets[i]);
+		put(levelSize);
+		put(levelSize);
+	}
+
+	// basic descriptor block
+	put(dfdSize);
+	put(0u); // khronos vendor, basic type
+	put(static_cast<uint16_t>(2)); // version
+	put(static_cast<uint16_t>(24 + samples.size() * 16));
+	put(colorModel);
+	put(static_cast<uint8_t>(1)); // bt709 primaries
+	put(static_cast<uint8_t>(srgb ? 2 : 1));
+	put(static_cast<uint8_t>(0)); // straight alpha
+	put(static_cast<uint32_t>(0x00000303)); // 4x4 texel blocks, stored as size - 1
+	put(static_cast<uint64_t>(blockSize)); // bytes in plane 0
+	for (const Sample& sample : samples)
+	{
+		put(sample.offset);
+		put(sample.length);
+		put(sample.channel);
+		put(0u); // sample position
+		put(0u); // lower
+		put(0xFFFFFFFFu); // upper
+	}
+
+	put(kvdEntrySize);
+	file.write(alphaKey, sizeof(alphaKey));
+	put(static_cast<uint8_t>(texture.alpha ? 1 : 0));
+	for (uint32_t i = 4 + kvdEntrySize; i < kvdSize; i++) put(static_cast<uint8_t>(0));
+
+	uint64_t written = kvdOffset + kvdSize;
+	for (uint32_t i = levelCount; i-- > 0;)
+	{
+		for (; written < fileOffsets[i]; written++) put(static_cast<uint8_t>(0));
+
+		size_t levelEnd = i + 1 < levelCount ? texture.levelOffsets[i + 1] : texture.data.size();
+		file.write(reinterpret_cast<const char*>(texture.data.data() + texture.levelOffsets[i]), levelEnd - texture.levelOffsets[i]);
+		written += levelEnd - texture.levelOffsets[i];
+	}
+
+	if (!file) throw runtime_error("failed to write baked texture");
+}
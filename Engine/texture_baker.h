@@ -0,0 +1,64 @@
+#pragma once
+
+#include "structs.h"
+
+#include <vector>
+
+using namespace std;
+
+// block compressed formats the baker encodes to, every block covers 4x4 texels
+enum TextureCodec
+{
+	TEXTURE_CODEC_BC1, // rgb, 8 bytes a block
+	TEXTURE_CODEC_BC3, // rgba, bc1 colour with an interpolated alpha block, 16 bytes
+	TEXTURE_CODEC_BC5, // two independent channels for normal maps, 16 bytes
+	TEXTURE_CODEC_BC7, // rgba in mode 6, 16 bytes
+	TEXTURE_CODEC_NONE // rgba8 as is, only the mip chain is built
+};
+
+// an encoded texture and its mip chain, levels are packed from the full size down
+struct BakedTexture
+{
+	TextureCodec codec;
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	bool alpha; // has texels below full opacity, stored with the texture so loading it needs no decode
+
+	vector<uint8_t> data;
+	vector<VkDeviceSize> levelOffsets;
+};
+
+/*
+* Import time encoding of rgba8 textures into BC blocks with a full mip chain
+* Levels are box filtered on the cpu and encoded a row of blocks at a time across hardware threads
+* Colour endpoints are the extremes along the principal axis of the block, indices pick the nearest palette entry
+*/
+class TextureBaker
+{
+public:
+	static BakedTexture bake(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCodec codec, bool srgb, bool alpha);
+
+	// KTX2 with a basic data format descriptor and an UnkAlpha key, levels are stored smallest first as the container requires
+	// Block compressed codecs only
+	static void writeKtx2(const char* path, const BakedTexture& texture);
+
+	static VkFormat getFormat(TextureCodec codec, bool srgb);
+
+	static uint32_t getBlockSize(TextureCodec codec);
+
+	// blocks are 16 rgba8 texels in rows
+	static void encodeBC1(const uint8_t* block, uint8_t* out);
+
+	static void encodeBC3(const uint8_t* block, uint8_t* out);
+
+	static void encodeBC5(const uint8_t* block, uint8_t* out);
+
+	static void encodeBC7(const uint8_t* block, uint8_t* out);
+
+private:
+	// one channel into 8 bytes, as used for BC3 alpha and each BC5 channel
+	static void encodeBC4(const uint8_t* block, uint32_t channel, uint8_t* out);
+
+	static void encodeLevel(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCodec codec, uint8_t* out);
+};
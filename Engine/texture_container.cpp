@@ -0,0 +1,269 @@
+#include "texture_container.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+template <typename T>
+static T readValue(const uint8_t* data, size_t offset)
+{
+	T value;
+	memcpy(&value, data + offset, sizeof(T));
+	return value;
+}
+
+/*
+* Header, level index and key value data are read, the data format descriptor is not needed as vkFormat is set
+*/
+bool TextureContainer::readKtx2(const char* path, TextureFile& file)
+{
+	ifstream stream(path, ios::binary);
+	if (!stream) return false;
+
+	const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	uint8_t header[80];
+	if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)) || memcmp(header, identifier, sizeof(identifier)) != 0) return false;
+
+	VkFormat format = static_cast<VkFormat>(readValue<uint32_t>(header, 12));
+	uint32_t width = readValue<uint32_t>(header, 20);
+	uint32_t height = readValue<uint32_t>(header, 24);
+	uint32_t depth = readValue<uint32_t>(header, 28);
+	uint32_t layerCount = readValue<uint32_t>(header, 32);
+	uint32_t faceCount = readValue<uint32_t>(header, 36);
+	uint32_t levelCount = std::max(readValue<uint32_t>(header, 40), 1u);
+	uint32_t supercompression = readValue<uint32_t>(header, 44);
+	uint32_t kvdOffset = readValue<uint32_t>(header, 56);
+	uint32_t kvdSize = readValue<uint32_t>(header, 60);
+
+	// basis and zstd payloads would need decoding
+	if (format == VK_FORMAT_UNDEFINED || height == 0 || depth > 0 || layerCount > 0 || faceCount != 1 || supercompression != 0) return false;
+
+	vector<uint64_t> fileOffsets(levelCount);
+	vector<uint64_t> levelSizes(levelCount);
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		uint8_t level[24];
+		if (!stream.read(reinterpret_cast<char*>(level), sizeof(level))) return false;
+
+		fileOffsets[i] = readValue<uint64_t>(level, 0);
+		levelSizes[i] = readValue<uint64_t>(level, 8);
+	}
+
+	// the key written at bake time can only rule alpha out, files from other tools go by their format
+	bool alpha = hasAlpha(format);
+	if (kvdSize > 0)
+	{
+		vector<uint8_t> kvd(kvdSize);
+		stream.seekg(kvdOffset);
+		if (!stream.read(reinterpret_cast<char*>(kvd.data()), kvdSize)) return false;
+
+		// entries are a length, a null terminated key and the value, each padded to 4 bytes
+		for (size_t offset = 0; offset + 4 <= kvd.size();)
+		{
+			uint32_t entrySize = readValue<uint32_t>(kvd.data(), offset);
+			if (offset + 4 + entrySize > kvd.size()) break;
+
+			// a key without its null runs to the end of the entry and matches nothing
+			const char name[] = "UnkAlpha";
+			const char* key = reinterpret_cast<const char*>(kvd.data() + offset + 4);
+			size_t keySize = strnlen(key, entrySize) + 1;
+			if (keySize == sizeof(name) && keySize < entrySize && memcmp(key, name, sizeof(name)) == 0)
+			{
+				alpha = alpha && kvd[offset + 4 + keySize] != 0;
+			}
+
+			offset += (4 + entrySize + 3) & ~size_t(3);
+		}
+	}
+
+	// levels are usually stored smallest first, the data is read as one span and placed by offset
+	uint64_t first = *min_element(fileOffsets.begin(), fileOffsets.end());
+	uint64_t last = 0;
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		last = std::max(last, fileOffsets[i] + levelSizes[i]);
+	}
+
+	file = TextureFile
+	{
+		.path = path,
+		.format = format,
+		.width = width,
+		.height = height,
+		.alpha = alpha,
+		.dataOffset = first,
+		.dataSize = last - first
+	};
+
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		file.levelOffsets.push_back(fileOffsets[i] - first);
+		file.levelSizes.push_back(levelSizes[i]);
+	}
+
+	return true;
+}
+
+/*
+* Legacy headers name BC1, BC3 and BC5 with a four character code, newer ones carry a DXGI format in the DX10 header
+* Legacy headers have no colour space, colour formats are taken as sRGB since only albedo textures are loaded
+*/
+bool TextureContainer::readDds(const char* path, TextureFile& file)
+{
+	ifstream stream(path, ios::binary);
+	if (!stream) return false;
+
+	uint8_t header[4 + 124];
+	if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)) || memcmp(header, "DDS ", 4) != 0) return false;
+
+	uint32_t height = readValue<uint32_t>(header, 12);
+	uint32_t width = readValue<uint32_t>(header, 16);
+	uint32_t levelCount = std::max(readValue<uint32_t>(header, 28), 1u);
+	uint32_t pixelFlags = readValue<uint32_t>(header, 80);
+	uint32_t fourCC = readValue<uint32_t>(header, 84);
+	uint32_t bitCount = readValue<uint32_t>(header, 88);
+	uint32_t redMask = readValue<uint32_t>(header, 92);
+	uint32_t caps2 = readValue<uint32_t>(header, 112);
+
+	auto code = [](const char* name) { return readValue<uint32_t>(reinterpret_cast<const uint8_t*>(name), 0); };
+
+	// cube maps and volumes are not textures the scene uses
+	if (caps2 != 0) return false;
+
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint64_t dataOffset = sizeof(header);
+	bool alpha = true;
+
+	if ((pixelFlags & 0x4) && fourCC == code("DX10"))
+	{
+		uint8_t dx10[20];
+		if (!stream.read(reinterpret_cast<char*>(dx10), sizeof(dx10))) return false;
+		dataOffset += sizeof(dx10);
+
+		if (readValue<uint32_t>(dx10, 4) != 3 || readValue<uint32_t>(dx10, 12) != 1) return false; // 2D, one layer
+
+		switch (readValue<uint32_t>(dx10, 0))
+		{
+		case 28: format = VK_FORMAT_R8G8B8A8_UNORM; break;
+		case 29: format = VK_FORMAT_R8G8B8A8_SRGB; break;
+		case 71: format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK; break;
+		case 72: format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK; break;
+		case 77: format = VK_FORMAT_BC3_UNORM_BLOCK; break;
+		case 78: format = VK_FORMAT_BC3_SRGB_BLOCK; break;
+		case 83: format = VK_FORMAT_BC5_UNORM_BLOCK; break;
+		case 98: format = VK_FORMAT_BC7_UNORM_BLOCK; break;
+		case 99: format = VK_FORMAT_BC7_SRGB_BLOCK; break;
+		}
+	}
+	else if (pixelFlags & 0x4)
+	{
+		if (fourCC == code("DXT1")) format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		if (fourCC == code("DXT5")) format = VK_FORMAT_BC3_SRGB_BLOCK;
+		if (fourCC == code("ATI2") || fourCC == code("BC5U")) format = VK_FORMAT_BC5_UNORM_BLOCK;
+	}
+	else if ((pixelFlags & 0x40) && bitCount == 32 && redMask == 0x000000FF)
+	{
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+		alpha = (pixelFlags & 0x1) != 0;
+	}
+
+	if (format == VK_FORMAT_UNDEFINED || width == 0 || height == 0) return false;
+
+	file = TextureFile
+	{
+		.path = path,
+		.format = format,
+		.width = width,
+		.height = height,
+		.alpha = alpha && hasAlpha(format),
+		.dataOffset = dataOffset
+	};
+
+	// levels follow each other from the full size down
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		file.levelOffsets.push_back(file.dataSize);
+		file.levelSizes.push_back(getLevelSize(format, std::max(width >> i, 1u), std::max(height >> i, 1u)));
+		file.dataSize += file.levelSizes.back();
+	}
+
+	return true;
+}
+
+void TextureContainer::readLevels(const TextureFile& file, void* target)
+{
+	ifstream stream(file.path, ios::binary);
+	stream.seekg(static_cast<streamoff>(file.dataOffset));
+
+	if (!stream.read(static_cast<char*>(target), static_cast<streamsize>(file.dataSize)))
+	{
+		throw runtime_error("failed to read texture levels");
+	}
+}
+
+void TextureContainer::readLevels(const TextureFile& file, uint32_t firstLevel, void* target)
+{
+	ifstream stream(file.path, ios::binary);
+	char* out = static_cast<char*>(target);
+
+	for (uint32_t i = firstLevel; i < file.levelOffsets.size(); i++)
+	{
+		stream.seekg(static_cast<streamoff>(file.dataOffset + file.levelOffsets[i]));
+		if (!stream.read(out, static_cast<streamsize>(file.levelSizes[i])))
+		{
+			throw runtime_error("failed to read texture levels");
+		}
+		out += file.levelSizes[i];
+	}
+}
+
+bool TextureContainer::hasAlpha(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SRGB:
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SRGB:
+	case VK_FORMAT_R8G8B8_UNORM:
+	case VK_FORMAT_R8G8B8_SRGB:
+	case VK_FORMAT_B8G8R8_UNORM:
+	case VK_FORMAT_B8G8R8_SRGB:
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		return false;
+	default:
+		return true;
+	}
+}
+
+VkDeviceSize TextureContainer::getLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	VkDeviceSize blocks = static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4);
+
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return static_cast<VkDeviceSize>(width) * height * 4;
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		return blocks * 8;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return blocks * 16;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "structs.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// a GPU ready texture on disk, its levels are read as they are stored, straight into the upload's staging buffer
+struct TextureFile
+{
+	string path;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	bool alpha = true; // unless the container says otherwise, textures are alpha tested
+
+	VkDeviceSize dataOffset = 0; // in the file, first byte of the level data
+	VkDeviceSize dataSize = 0;
+	vector<VkDeviceSize> levelOffsets; // by level, relative to dataOffset
+	vector<VkDeviceSize> levelSizes;
+};
+
+/*
+* Reads the headers of KTX2 and DDS files, level data is left on disk until readLevels
+* Only 2D textures without supercompression, arrays or faces are recognised, anything else is left to the image decoder
+*/
+class TextureContainer
+{
+public:
+	static bool readKtx2(const char* path, TextureFile& file);
+
+	static bool readDds(const char* path, TextureFile& file);
+
+	// copies the level data of the file into target, which holds dataSize bytes
+	static void readLevels(const TextureFile& file, void* target);
+
+	// copies the levels from firstLevel down into target, packed in level order
+	static void readLevels(const TextureFile& file, uint32_t firstLevel, void* target);
+
+private:
+	// false for formats without an alpha channel, their texels can not be cut out
+	static bool hasAlpha(VkFormat format);
+
+	// bytes in a level, 0 for formats the loaders do not know
+	static VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height);
+};
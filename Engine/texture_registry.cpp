@@ -0,0 +1,321 @@
+#include "texture_registry.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/*
+* Capacity is the smaller of MAX_CAPACITY and what one stage may bind, combined samplers count as a sampler and an image
+*/
+TextureRegistry::TextureRegistry(UnkDevice* device, VkSampler* sampler)
+{
+	this->device = device;
+	this->sampler = sampler;
+
+	VkPhysicalDeviceDescriptorIndexingProperties indexingProperties
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES
+	};
+	VkPhysicalDeviceProperties2 properties
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &indexingProperties
+	};
+	vkGetPhysicalDeviceProperties2(device->gpu, &properties);
+
+	const VkPhysicalDeviceLimits& limits = properties.properties.limits;
+	uint32_t limit = device->textureUpdateAfterBind ?
+		std::min({
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+			indexingProperties.maxDescriptorSetUpdateAfterBindSamplers }) :
+		std::min({
+			limits.maxPerStageDescriptorSampledImages,
+			limits.maxPerStageDescriptorSamplers,
+			limits.maxDescriptorSetSampledImages,
+			limits.maxDescriptorSetSamplers });
+
+	capacity = std::min(MAX_CAPACITY, limit > RESERVED_SAMPLED_IMAGES ? limit - RESERVED_SAMPLED_IMAGES : 1u);
+	swapSlots = std::min(MAX_SWAP_SLOTS, capacity / 2);
+
+	// capacity * 4 stays within the 65536 bytes vkCmdUpdateBuffer takes
+	slotBuffer = new UnkBuffer
+	(
+		device,
+		capacity * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		0
+	);
+}
+
+TextureRegistry::~TextureRegistry()
+{
+	for (UnkImage* image : slots)
+	{
+		delete image;
+	}
+
+	for (Retired& entry : retired)
+	{
+		delete entry.image;
+	}
+
+	delete slotBuffer;
+}
+
+/*
+* Slots still retired count as used, so the swap slots are only handed out by replace
+*/
+uint32_t TextureRegistry::add(UnkImage* image)
+{
+	if (slots.size() - freeSlots.size() + swapSlots >= capacity)
+	{
+		throw runtime_error("texture registry is full");
+	}
+
+	uint32_t id;
+	if (!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<uint32_t>(textureSlots.size());
+		textureSlots.push_back(UINT32_MAX);
+	}
+
+	setSlot(id, allocateSlot(image));
+
+	return id;
+}
+
+void TextureRegistry::replace(uint32_t id, UnkImage* image)
+{
+	uint32_t previous = textureSlots[id];
+
+	setSlot(id, allocateSlot(image));
+
+	retired.push_back(Retired{ .frame = frame, .slot = previous, .id = UINT32_MAX, .image = slots[previous] });
+}
+
+bool TextureRegistry::canReplace()
+{
+	return !freeSlots.empty() || slots.size() < capacity;
+}
+
+void TextureRegistry::remove(uint32_t id)
+{
+	uint32_t previous = textureSlots[id];
+
+	retired.push_back(Retired{ .frame = frame, .slot = previous, .id = id, .image = slots[previous] });
+}
+
+UnkImage* TextureRegistry::getImage(uint32_t id)
+{
+	return slots[textureSlots[id]];
+}
+
+uint32_t TextureRegistry::getTextureCount()
+{
+	return static_cast<uint32_t>(textureSlots.size());
+}
+
+/*
+* Retired entries are in frame order, the first one still in flight ends the walk
+*/
+void TextureRegistry::update(uint32_t frame, uint32_t completedFrame)
+{
+	this->frame = frame;
+
+	while (!retired.empty() && retired.front().frame <= completedFrame)
+	{
+		Retired& entry = retired.front();
+
+		// partially bound arrays may hold descriptors of destroyed images as long as they are not used
+		delete entry.image;
+		slots[entry.slot] = nullptr;
+		freeSlots.push_back(entry.slot);
+
+		if (entry.id != UINT32_MAX)
+		{
+			textureSlots[entry.id] = UINT32_MAX;
+			freeIds.push_back(entry.id);
+		}
+
+		retired.pop_front();
+	}
+}
+
+/*
+* Frames on the queue execute in order, so each one reads the table as it was when it was recorded
+* The first barrier keeps the copy behind the previous frame's reads, the second makes it visible to this frame's
+*/
+void TextureRegistry::recordSlots(UnkCommandBuffer* commandBuffer)
+{
+	if (!slotsChanged || textureSlots.empty()) return;
+
+	VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+
+	vkCmdPipelineBarrier(commandBuffer->handle, readStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdUpdateBuffer(commandBuffer->handle, slotBuffer->handle, 0, textureSlots.size() * sizeof(uint32_t), textureSlots.data());
+
+	VkBufferMemoryBarrier barrier
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = slotBuffer->handle,
+		.size = VK_WHOLE_SIZE
+	};
+
+	vkCmdPipelineBarrier
+	(
+		commandBuffer->handle,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		readStages,
+		0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr
+	);
+
+	slotsChanged = false;
+}
+
+void TextureRegistry::addSet(VkDescriptorSet set, uint32_t binding)
+{
+	sets.push_back(Set{ .set = set, .binding = binding });
+
+	vector<VkDescriptorImageInfo> infos;
+	vector<VkWriteDescriptorSet> writes;
+	infos.reserve(slots.size());
+
+	for (uint32_t slot = 0; slot < slots.size(); slot++)
+	{
+		if (slots[slot] == nullptr) continue;
+
+		infos.push_back(VkDescriptorImageInfo
+		{
+			.sampler = *slots[slot]->sampler,
+			.imageView = slots[slot]->view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		});
+
+		writes.push_back(VkWriteDescriptorSet
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = set,
+			.dstBinding = binding,
+			.dstArrayElement = slot,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.pImageInfo = &infos.back()
+		});
+	}
+
+	vkUpdateDescriptorSets(device->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+VkDescriptorSetLayoutBinding TextureRegistry::getLayoutBinding(uint32_t binding, VkShaderStageFlags stages)
+{
+	return VkDescriptorSetLayoutBinding
+	{
+		.binding = binding,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = capacity,
+		.stageFlags = stages
+	};
+}
+
+VkDescriptorBindingFlags TextureRegistry::getBindingFlags()
+{
+	VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+	if (device->textureUpdateAfterBind)
+	{
+		flags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	}
+
+	return flags;
+}
+
+uint32_t TextureRegistry::allocateSlot(UnkImage* image)
+{
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (slots.size() < capacity)
+	{
+		slot = static_cast<uint32_t>(slots.size());
+		slots.push_back(nullptr);
+	}
+	else
+	{
+		throw runtime_error("texture registry is full");
+	}
+
+	if (image->sampler == nullptr)
+	{
+		image->sampler = sampler;
+	}
+
+	slots[slot] = image;
+	write(slot);
+
+	return slot;
+}
+
+/*
+* The descriptor is written before the id is pointed at it, the next frame recorded is the first to read the new slot
+*/
+void TextureRegistry::setSlot(uint32_t id, uint32_t slot)
+{
+	textureSlots[id] = slot;
+	slotsChanged = true;
+}
+
+/*
+* A free slot is not used by any pending command buffer, which is what update unused while pending allows
+* Without it a bound set may not be written at all, so the device is idled first
+*/
+void TextureRegistry::write(uint32_t slot)
+{
+	if (sets.empty()) return;
+
+	if (!device->textureUpdateAfterBind)
+	{
+		vkDeviceWaitIdle(device->device);
+	}
+
+	VkDescriptorImageInfo info
+	{
+		.sampler = *slots[slot]->sampler,
+		.imageView = slots[slot]->view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	};
+
+	vector<VkWriteDescriptorSet> writes;
+	for (const Set& set : sets)
+	{
+		writes.push_back(VkWriteDescriptorSet
+		{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = set.set,
+			.dstBinding = set.binding,
+			.dstArrayElement = slot,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.pImageInfo = &info
+		});
+	}
+
+	vkUpdateDescriptorSets(device->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
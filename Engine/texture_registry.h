@@ -0,0 +1,101 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_buffer.h"
+#include "unk_image.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+/*
+* The scene's textures as one bindless array, shared by the descriptor sets of every pipeline
+* Instances refer to a texture by a stable id, the slot table maps it to the element of the array holding its image
+* A new image is written to a free slot and the id pointed at it, the table is copied into the command buffer of the frame
+* being recorded, so frames in flight never see a slot change under them
+* Slots and images that are given up are retired with the current frame and reused once that frame has completed
+*/
+class TextureRegistry
+{
+public:
+	UnkDevice* device;
+	VkSampler* sampler; // set on every image added
+
+	uint32_t capacity; // slots in the array, texture ids share the bound
+	uint32_t swapSlots; // held back from add, so a replacement finds a slot once the retired ones are released
+	UnkBuffer* slotBuffer; // slot by texture id, device local and updated from each frame's command buffer
+
+	static const uint32_t MAX_CAPACITY = 16384;
+	static const uint32_t RESERVED_SAMPLED_IMAGES = 16; // left to the other image bindings of the sets
+	static const uint32_t MAX_SWAP_SLOTS = 16;
+
+	TextureRegistry(UnkDevice* device, VkSampler* sampler);
+
+	~TextureRegistry();
+
+	// takes ownership of the image and returns the id of the texture
+	uint32_t add(UnkImage* image);
+
+	// the texture keeps its id, the previous image is destroyed once no frame in flight can sample it
+	// only valid while canReplace holds
+	void replace(uint32_t id, UnkImage* image);
+
+	// false while every slot is in use or retired, a later frame releases some
+	bool canReplace();
+
+	// the id is free for reuse with the slot, instances still referring to it must be gone by then
+	void remove(uint32_t id);
+
+	UnkImage* getImage(uint32_t id);
+
+	// ids in use are below this, the feedback and slot tables only need that many entries read
+	uint32_t getTextureCount();
+
+	// frame is the one being recorded, everything retired up to completedFrame is released
+	void update(uint32_t frame, uint32_t completedFrame);
+
+	// copies the slot table into the frame's command buffer when it changed, before anything samples a texture
+	void recordSlots(UnkCommandBuffer* commandBuffer);
+
+	// the array binding of a pipeline's set, written with every texture now and with every change after
+	void addSet(VkDescriptorSet set, uint32_t binding);
+
+	VkDescriptorSetLayoutBinding getLayoutBinding(uint32_t binding, VkShaderStageFlags stages);
+
+	VkDescriptorBindingFlags getBindingFlags();
+
+private:
+	struct Retired
+	{
+		uint32_t frame;
+		uint32_t slot;
+		uint32_t id; // UINT32_MAX when the texture lives on in another slot
+		UnkImage* image;
+	};
+
+	struct Set
+	{
+		VkDescriptorSet set;
+		uint32_t binding;
+	};
+
+	vector<UnkImage*> slots; // nullptr when free
+	vector<uint32_t> freeSlots;
+
+	vector<uint32_t> textureSlots; // by id, UINT32_MAX when free, the source of slotBuffer
+	vector<uint32_t> freeIds;
+
+	deque<Retired> retired;
+	vector<Set> sets;
+
+	uint32_t frame = 0;
+	bool slotsChanged = false; // since the table was last recorded
+
+	uint32_t allocateSlot(UnkImage* image);
+
+	void setSlot(uint32_t id, uint32_t slot);
+
+	void write(uint32_t slot);
+};
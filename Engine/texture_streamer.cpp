@@ -0,0 +1,286 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+TextureStreamer::TextureStreamer(UnkDevice* device, TextureRegistry* registry)
+{
+	this->device = device;
+	this->registry = registry;
+
+	worker = thread(&TextureStreamer::run, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+
+	worker.join();
+}
+
+uint32_t TextureStreamer::add(const BakedTexture& baked)
+{
+	Texture texture
+	{
+		.format = baked.format,
+		.width = baked.width,
+		.height = baked.height,
+		.data = baked.data,
+		.levelOffsets = baked.levelOffsets
+	};
+
+	for (size_t i = 0; i < baked.levelOffsets.size(); i++)
+	{
+		size_t levelEnd = i + 1 < baked.levelOffsets.size() ? baked.levelOffsets[i + 1] : baked.data.size();
+		texture.levelSizes.push_back(levelEnd - baked.levelOffsets[i]);
+	}
+
+	return add(texture);
+}
+
+uint32_t TextureStreamer::add(const TextureFile& file)
+{
+	Texture texture
+	{
+		.format = file.format,
+		.width = file.width,
+		.height = file.height,
+		.levelSizes = file.levelSizes,
+		.file = file
+	};
+
+	return add(texture);
+}
+
+uint32_t TextureStreamer::add(Texture& added)
+{
+	uint32_t levelCount = static_cast<uint32_t>(added.levelSizes.size());
+
+	added.minLevel = 0;
+	while (added.minLevel + 1 < levelCount && std::max(added.width >> added.minLevel, added.height >> added.minLevel) > MIN_RESIDENT_SIZE)
+	{
+		added.minLevel++;
+	}
+
+	added.residentLevel = added.minLevel;
+	added.targetLevel = added.minLevel;
+	added.wantedLevel = added.minLevel;
+
+	// the worker only reads textures already queued, adding is safe while it runs
+	textures.push_back(move(added));
+	Texture& texture = textures.back();
+
+	Load load{ .texture = &texture, .level = texture.minLevel };
+	readLevels(texture, load);
+
+	committedBytes += getResidentSize(texture, texture.minLevel);
+
+	texture.index = registry->add(createImage(texture, load));
+
+	return texture.index;
+}
+
+/*
+* Frames in flight may still add to the feedback as it is cleared, a sample lost that way is recorded again next frame
+*/
+void TextureStreamer::update(uint32_t frame, uint32_t* feedback)
+{
+	// feedback holds the most texels across each texture was sampled at, 0 if it was not sampled
+	for (Texture& texture : textures)
+	{
+		uint32_t resolution = feedback[texture.index];
+		if (resolution == 0) continue;
+
+		feedback[texture.index] = 0;
+
+		uint32_t level = 0;
+		while (level < texture.minLevel && (texture.width >> (level + 1)) >= resolution)
+		{
+			level++;
+		}
+
+		texture.wantedLevel = level;
+		texture.lastUsed = frame;
+	}
+
+	// only textures sampled since the last update, an evicted texture does not come back until it is seen again
+	vector<Texture*> upgrades;
+	for (Texture& texture : textures)
+	{
+		if (texture.lastUsed == frame && texture.targetLevel == texture.residentLevel && texture.wantedLevel < texture.residentLevel)
+		{
+			upgrades.push_back(&texture);
+		}
+	}
+
+	// coarsest first, a texture far from its wanted level gains the most from the budget
+	sort(upgrades.begin(), upgrades.end(), [](const Texture* a, const Texture* b) { return a->residentLevel - a->wantedLevel > b->residentLevel - b->wantedLevel; });
+
+	for (Texture* texture : upgrades)
+	{
+		// only textures sampled less recently may be evicted for this one, least recent first
+		vector<Texture*> victims;
+		VkDeviceSize evictable = 0;
+		for (Texture& other : textures)
+		{
+			if (other.lastUsed < texture->lastUsed && other.targetLevel == other.residentLevel && other.residentLevel < other.minLevel)
+			{
+				victims.push_back(&other);
+				evictable += getResidentSize(other, other.residentLevel) - getResidentSize(other, other.minLevel);
+			}
+		}
+		sort(victims.begin(), victims.end(), [](const Texture* a, const Texture* b) { return a->lastUsed < b->lastUsed; });
+
+		VkDeviceSize available = budget > committedBytes ? budget - committedBytes : 0;
+		VkDeviceSize residentSize = getResidentSize(*texture, texture->residentLevel);
+
+		// the finest level that fits, a coarser one is better than none
+		for (uint32_t level = texture->wantedLevel; level < texture->residentLevel; level++)
+		{
+			VkDeviceSize extra = getResidentSize(*texture, level) - residentSize;
+			if (extra > available + evictable) continue;
+
+			for (size_t i = 0; i < victims.size() && committedBytes + extra > budget; i++)
+			{
+				request(*victims[i], victims[i]->minLevel);
+			}
+
+			request(*texture, level);
+			break;
+		}
+	}
+
+	vector<Load> finished;
+	{
+		lock_guard<mutex> lock(queueMutex);
+		while (!completedLoads.empty() && finished.size() < MAX_SWAPS_PER_FRAME)
+		{
+			finished.push_back(move(completedLoads.front()));
+			completedLoads.pop_front();
+		}
+	}
+
+	for (size_t i = 0; i < finished.size(); i++)
+	{
+		Load& load = finished[i];
+		Texture& texture = *load.texture;
+
+		// the slots of earlier swaps are still retired, the rest of the loads wait for frames in flight to release them
+		if (!registry->canReplace())
+		{
+			lock_guard<mutex> lock(queueMutex);
+			completedLoads.insert(completedLoads.begin(), make_move_iterator(finished.begin() + i), make_move_iterator(finished.end()));
+			break;
+		}
+
+		if (load.failed)
+		{
+			committedBytes -= getResidentSize(texture, texture.targetLevel);
+			committedBytes += getResidentSize(texture, texture.residentLevel);
+			texture.targetLevel = texture.residentLevel;
+			continue;
+		}
+
+		registry->replace(texture.index, createImage(texture, load));
+		texture.residentLevel = load.level;
+	}
+}
+
+/*
+* Committed bytes count the size a texture will have once its load is swapped in
+*/
+void TextureStreamer::request(Texture& texture, uint32_t level)
+{
+	committedBytes -= getResidentSize(texture, texture.targetLevel);
+	committedBytes += getResidentSize(texture, level);
+	texture.targetLevel = level;
+
+	{
+		lock_guard<mutex> lock(queueMutex);
+		pendingLoads.push_back(Load{ .texture = &texture, .level = level });
+	}
+	queueCondition.notify_one();
+}
+
+void TextureStreamer::run()
+{
+	while (true)
+	{
+		Load load;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			queueCondition.wait(lock, [&]() { return stopping || !pendingLoads.empty(); });
+
+			if (stopping) return;
+
+			load = move(pendingLoads.front());
+			pendingLoads.pop_front();
+		}
+
+		// a file that went missing leaves the texture as it is
+		try
+		{
+			readLevels(*load.texture, load);
+		}
+		catch (const exception&)
+		{
+			load.failed = true;
+		}
+
+		lock_guard<mutex> lock(queueMutex);
+		completedLoads.push_back(move(load));
+	}
+}
+
+void TextureStreamer::readLevels(const Texture& texture, Load& load)
+{
+	VkDeviceSize size = 0;
+	for (size_t i = load.level; i < texture.levelSizes.size(); i++)
+	{
+		load.levelOffsets.push_back(size);
+		size += texture.levelSizes[i];
+	}
+
+	load.data.resize(size);
+
+	// baked levels are already packed in level order
+	if (texture.data.empty())
+	{
+		TextureContainer::readLevels(texture.file, load.level, load.data.data());
+	}
+	else
+	{
+		memcpy(load.data.data(), texture.data.data() + texture.levelOffsets[load.level], size);
+	}
+}
+
+UnkImage* TextureStreamer::createImage(const Texture& texture, const Load& load)
+{
+	return new UnkImage
+	(
+		device,
+		std::max(texture.width >> load.level, 1u),
+		std::max(texture.height >> load.level, 1u),
+		texture.format,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		true,
+		load.data.data(),
+		load.data.size(),
+		load.levelOffsets
+	);
+}
+
+VkDeviceSize TextureStreamer::getResidentSize(const Texture& texture, uint32_t level)
+{
+	VkDeviceSize size = 0;
+	for (size_t i = level; i < texture.levelSizes.size(); i++)
+	{
+		size += texture.levelSizes[i];
+	}
+	return size;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_image.h"
+#include "texture_baker.h"
+#include "texture_container.h"
+#include "texture_registry.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+* Keeps the fine mip levels of textures resident only while they are sampled at that resolution
+* Shaders record the resolution each texture is sampled at in the feedback buffer, which update reads once a frame
+* A streamed image holds its chain from residentLevel down to 1x1 and is recreated whenever that level changes
+* Recreated images replace the previous one in the registry, which keeps that alive until frames in flight are done with it
+* Level data is gathered on a background thread, from the baked texture in memory or from the container on disk
+* Fine levels stay until the budget is needed for another texture, the least recently sampled ones are evicted first
+*/
+class TextureStreamer
+{
+public:
+	struct Texture
+	{
+		uint32_t index; // texture id in the registry
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+		vector<VkDeviceSize> levelSizes;
+
+		// levels come from one or the other
+		vector<uint8_t> data;
+		vector<VkDeviceSize> levelOffsets; // into data
+		TextureFile file;
+
+		uint32_t minLevel; // coarsest residency, the first level no larger than MIN_RESIDENT_SIZE
+		uint32_t residentLevel;
+		uint32_t targetLevel; // of the load in flight, residentLevel when there is none
+		uint32_t wantedLevel;
+		uint32_t lastUsed = 0; // frame the texture was last sampled in
+	};
+
+	// levels from level down, packed in level order
+	struct Load
+	{
+		Texture* texture;
+		uint32_t level;
+		vector<uint8_t> data;
+		vector<VkDeviceSize> levelOffsets;
+		bool failed = false;
+	};
+
+	UnkDevice* device;
+	TextureRegistry* registry;
+
+	deque<Texture> textures; // a deque so the worker's pointers stay valid as textures are added
+
+	VkDeviceSize budget = 512ull << 20; // bytes of streamed images, coarse levels always stay and count towards it
+	VkDeviceSize committedBytes = 0; // resident, or about to be once loads in flight finish
+
+	static const uint32_t MIN_RESIDENT_SIZE = 64;
+	static const uint32_t MAX_SWAPS_PER_FRAME = 4; // images are uploaded synchronously, this bounds the stall
+
+	TextureStreamer(UnkDevice* device, TextureRegistry* registry);
+
+	~TextureStreamer();
+
+	// adds the texture to the registry with only its coarse levels and returns its id
+	uint32_t add(const BakedTexture& texture);
+
+	uint32_t add(const TextureFile& file);
+
+	// reads and clears the feedback of streamed textures, queues loads and replaces the images of finished ones
+	void update(uint32_t frame, uint32_t* feedback);
+
+private:
+	thread worker;
+	mutex queueMutex;
+	condition_variable queueCondition;
+	deque<Load> pendingLoads;
+	deque<Load> completedLoads;
+	bool stopping = false;
+
+	uint32_t add(Texture& texture);
+
+	void run();
+
+	void readLevels(const Texture& texture, Load& load);
+
+	void request(Texture& texture, uint32_t level);
+
+	UnkImage* createImage(const Texture& texture, const Load& load);
+
+	VkDeviceSize getResidentSize(const Texture& texture, uint32_t level);
+};
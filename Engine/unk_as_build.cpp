@@ -0,0 +1,104 @@
+#include "unk_as_build.h"
+
+UnkAsBuild::UnkAsBuild(UnkDevice* device)
+{
+	this->device = device;
+
+	commandBuffer = new UnkCommandBuffer(device, UnkCommandBuffer::COMPUTE, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+	VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	VK_CHECK(vkCreateFence(device->device, &fenceInfo, nullptr, &fence));
+
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	VK_CHECK(vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &semaphore));
+}
+
+void UnkAsBuild::addBlas(UnkBlas* blas)
+{
+	blasses.push_back(blas);
+}
+
+void UnkAsBuild::setTlas(UnkTlas* tlas)
+{
+	this->tlas = tlas;
+}
+
+/*
+* Makes bottom level builds visible to the top level build recorded after it
+*/
+void UnkAsBuild::barrier()
+{
+	VkMemoryBarrier memoryBarrier
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR
+	};
+
+	vkCmdPipelineBarrier
+	(
+		commandBuffer->handle,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		0,
+		1, &memoryBarrier,
+		0, nullptr,
+		0, nullptr
+	);
+}
+
+/*
+* Submits without waiting, the geometry and acceleration structure buffers are concurrent so no ownership is transferred
+* The graphics submit that first traces against the build waits on the semaphore, which also makes the build visible to it
+*/
+void UnkAsBuild::submit()
+{
+	commandBuffer->submit(semaphore, fence);
+	submitted = true;
+}
+
+/*
+* Non-blocking completion check, frees scratch memory once the compute queue is done with it
+*/
+bool UnkAsBuild::isComplete()
+{
+	if (!submitted) return false;
+
+	if (vkGetFenceStatus(device->device, fence) != VK_SUCCESS) return false;
+
+	for (auto& blas : blasses)
+	{
+		blas->releaseScratch();
+	}
+
+	if (tlas != nullptr)
+	{
+		tlas->releaseScratch();
+	}
+
+	return true;
+}
+
+void UnkAsBuild::wait()
+{
+	if (!submitted) return;
+
+	VK_CHECK(vkWaitForFences(device->device, 1, &fence, VK_TRUE, UINT64_MAX));
+}
+
+UnkAsBuild::~UnkAsBuild()
+{
+	wait();
+
+	delete commandBuffer;
+
+	if (semaphore != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(device->device, semaphore, nullptr);
+	}
+
+	if (fence != VK_NULL_HANDLE)
+	{
+		vkDestroyFence(device->device, fence, nullptr);
+	}
+}
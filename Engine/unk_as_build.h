@@ -0,0 +1,45 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_buffer.h"
+#include "unk_command_buffer.h"
+#include "unk_blas.h"
+#include "unk_tlas.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/*
+* A batch of acceleration structure builds recorded on the compute queue
+* Completion is polled through the fence, the graphics queue waits on the semaphore before tracing against the built structures
+*/
+class UnkAsBuild
+{
+public:
+	UnkDevice* device;
+	UnkCommandBuffer* commandBuffer = nullptr;
+
+	VkFence fence = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	vector<UnkBlas*> blasses;
+	UnkTlas* tlas = nullptr;
+
+	bool submitted = false;
+
+	UnkAsBuild(UnkDevice* device);
+
+	~UnkAsBuild();
+
+	void addBlas(UnkBlas* blas);
+
+	void setTlas(UnkTlas* tlas);
+
+	void barrier();
+
+	void submit();
+
+	bool isComplete();
+
+	void wait();
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "unk_descriptor.h"
 #include "unk_tlas.h"
 #include <vulkan/vulkan.h>
@@ -2,11 +2,17 @@
 
 #include "unk_blas.h"
 
-UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress, VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress)
+/*
+* Records the build into the given command buffer, scratch memory is kept alive until releaseScratch is called
+* once the command buffer has finished executing
+* The index address is the start of the pool matching the mesh's index type
+*/
+UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR positionBufferDeviceAddress, VkDeviceOrHostAddressConstKHR indexPoolDeviceAddress, UnkCommandBuffer* commandBuffer)
 {
 	this->device = device;
 
 	const uint32_t primitiveCount = mesh.indexCount / 3;
+	const VkDeviceSize indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
 
 	// describe bottom level acceleration structure geometry
 	VkAccelerationStructureGeometryKHR accelerationStructureGeometry
@@ -19,18 +25,19 @@ UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR ve
 			{
 				.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
 				.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
-				.vertexData = vertexBufferDeviceAddress.deviceAddress + offsetof(Vertex, position) + VkDeviceSize(mesh.vertexOffset) * sizeof(Vertex),
-				.vertexStride = sizeof(Vertex),
+				.vertexData = positionBufferDeviceAddress.deviceAddress + VkDeviceSize(mesh.vertexOffset) * sizeof(vec3),
+				.vertexStride = sizeof(vec3),
 				.maxVertex = mesh.vertexCount - 1,
-				.indexType = VK_INDEX_TYPE_UINT32,
-				.indexData = indexBufferDeviceAddress.deviceAddress + VkDeviceSize(mesh.firstIndex) * sizeof(uint32_t),
+				.indexType = mesh.indexType,
+				.indexData = indexPoolDeviceAddress.deviceAddress + VkDeviceSize(mesh.firstIndex) * indexSize,
 				.transformData =
 				{
 					.deviceAddress = 0,
 				},
 			}
 		},
-		.flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+		// any-hit shaders are only invoked for geometry that is not opaque
+		.flags = mesh.isAlphaTested() ? VkGeometryFlagsKHR(0) : VK_GEOMETRY_OPAQUE_BIT_KHR,
 	};
 
 	VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo
@@ -62,7 +69,7 @@ UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR ve
 	);
 
 	// create scratch buffer
-	UnkBuffer* scratchBuffer = new UnkBuffer
+	scratchBuffer = new UnkBuffer
 	(
 		device,
 		accelerationStructureBuildSizesInfo.buildScratchSize,
@@ -79,14 +86,15 @@ UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR ve
 	};
 	VkDeviceAddress scratchAddress = device->vkGetBufferDeviceAddressKHR(device->device, &bufferDeviceAI);
 
-	// create bottom level acceleration structure buffer
+	// create bottom level acceleration structure buffer, built on the compute queue and traced on the graphics queue
 	blasBuffer = new UnkBuffer
 	(
 		device,
 		accelerationStructureBuildSizesInfo.accelerationStructureSize,
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		0
+		0,
+		true
 	);
 
 	VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo
@@ -116,25 +124,29 @@ UnkBlas::UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR ve
 
 	vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
 
-	UnkCommandBuffer* commandBuffer = new UnkCommandBuffer(device, UnkCommandBuffer::GRAPHICS, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 	device->vkCmdBuildAccelerationStructuresKHR(commandBuffer->handle, 1, &buildInfo, accelerationBuildStructureRangeInfos.data());
 
-	commandBuffer->endCommand(true);
-
 	VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo
 	{
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
 		.accelerationStructure = this->handle
 	};
 	this->deviceAddress = device->vkGetAccelerationStructureDeviceAddressKHR(device->device, &accelerationDeviceAddressInfo);
+}
 
-	delete scratchBuffer;
-	delete commandBuffer;
+void UnkBlas::releaseScratch()
+{
+	if (scratchBuffer != nullptr)
+	{
+		delete scratchBuffer;
+		scratchBuffer = nullptr;
+	}
 }
 
 UnkBlas::~UnkBlas()
 {
+	releaseScratch();
+
 	if (handle != VK_NULL_HANDLE)
 	{
 		device->vkDestroyAccelerationStructureKHR(device->device, handle, nullptr);
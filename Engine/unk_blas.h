@@ -12,10 +12,13 @@ class UnkBlas
 public:
 	UnkDevice* device;
 	UnkBuffer* blasBuffer = nullptr;
+	UnkBuffer* scratchBuffer = nullptr;
 	VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
 	uint64_t deviceAddress = 0;
 
-	UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress, VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress);
+	UnkBlas(UnkDevice* device, Mesh& mesh, VkDeviceOrHostAddressConstKHR positionBufferDeviceAddress, VkDeviceOrHostAddressConstKHR indexPoolDeviceAddress, UnkCommandBuffer* commandBuffer);
 
 	~UnkBlas();
+
+	void releaseScratch();
 };
\ No newline at end of file
@@ -4,16 +4,23 @@
 
 unordered_map<UnkBuffer*, uint32_t> UnkBuffer::bufferMap;
 
-UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags)
+UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, bool concurrent)
 {
 	this->device = device;
 	this->size = size;
 
+	// concurrent sharing needs at least two distinct families
+	vector<uint32_t> families = device->getConcurrentQueueFamilies();
+	concurrent = concurrent && families.size() > 1;
+
 	VkBufferCreateInfo bufferCreateInfo
 	{
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = size,
-		.usage = usage
+		.usage = usage,
+		.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(families.size()) : 0,
+		.pQueueFamilyIndices = concurrent ? families.data() : nullptr
 	};
 
 	VmaAllocationCreateInfo vmaCreateInfo
@@ -27,7 +34,7 @@ UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags us
 	bufferMap[this] = 1;
 }
 
-UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, void* data, bool staging)
+UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, void* data, bool staging, bool concurrent)
 {
 	this->device = device;
 	this->size = size;
@@ -72,11 +79,17 @@ UnkBuffer::UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags us
 		.size = size
 	};
 
+	vector<uint32_t> families = device->getConcurrentQueueFamilies();
+	concurrent = concurrent && families.size() > 1;
+
 	VkBufferCreateInfo bufferCreateInfo
 	{
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = size,
-		.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+		.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(families.size()) : 0,
+		.pQueueFamilyIndices = concurrent ? families.data() : nullptr
 	};
 
 	VmaAllocationCreateInfo vmaCreateInfo
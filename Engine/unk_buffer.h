@@ -24,9 +24,10 @@ public:
 
 	static unordered_map<UnkBuffer*, uint32_t> bufferMap;
 	
-	UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags);
+	// concurrent buffers are shared by all queue families, so work on the compute queue can use them without ownership transfers
+	UnkBuffer(UnkDevice* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, bool concurrent = false);
 
-	UnkBuffer(UnkDevice* device, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, void* data, bool staging = false);
+	UnkBuffer(UnkDevice* device, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VmaAllocationCreateFlags flags, void* data, bool staging = false, bool concurrent = false);
 
 	void copy(UnkBuffer* other);
 
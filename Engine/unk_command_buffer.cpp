@@ -70,3 +70,22 @@ void UnkCommandBuffer::endCommand(bool submit)
 	VK_CHECK(vkWaitForFences(device->device, 1, &fence, VK_TRUE, UINT64_MAX));
 	vkDestroyFence(device->device, fence, nullptr);
 }
+
+
+/*
+* Ends and submits without waiting, completion is signalled through the given semaphore and fence
+*/
+void UnkCommandBuffer::submit(VkSemaphore signalSemaphore, VkFence fence)
+{
+	vkEndCommandBuffer(handle);
+
+	VkSubmitInfo submitInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &handle,
+		.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1u : 0u,
+		.pSignalSemaphores = &signalSemaphore
+	};
+	VK_CHECK(vkQueueSubmit(device->getQueue(queueIndex), 1, &submitInfo, fence));
+}
\ No newline at end of file
@@ -29,4 +29,6 @@ public:
 	void beginCommand();
 
 	void endCommand(bool submit = true);
+
+	void submit(VkSemaphore signalSemaphore, VkFence fence);
 };
\ No newline at end of file
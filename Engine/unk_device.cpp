@@ -126,6 +126,16 @@ uint32_t UnkDevice::getQueueFamilyIndex(VkQueueFlags queueFlags) const
 	throw std::runtime_error("could not find matching queue family");
 }
 
+vector<uint32_t> UnkDevice::getConcurrentQueueFamilies() const
+{
+	vector<uint32_t> families{ queues.graphics };
+
+	if (find(families.begin(), families.end(), queues.compute) == families.end()) families.push_back(queues.compute);
+	if (find(families.begin(), families.end(), queues.transfer) == families.end()) families.push_back(queues.transfer);
+
+	return families;
+}
+
 VkQueue UnkDevice::getQueue(uint32_t index)
 {
 	VkQueue queue;
@@ -180,6 +190,7 @@ void UnkDevice::createFunctionPointers()
 	vkCmdTraceRaysKHR = (PFN_vkCmdTraceRaysKHR)vkGetDeviceProcAddr(device, "vkCmdTraceRaysKHR");
 	vkDestroyAccelerationStructureKHR = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkDestroyAccelerationStructureKHR");
 	vkCreateAccelerationStructureKHR = (PFN_vkCreateAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkCreateAccelerationStructureKHR");
+	vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
 }
 
 UnkDevice::~UnkDevice()
@@ -42,6 +42,12 @@ public:
 	PFN_vkCmdTraceRaysKHR vkCmdTraceRaysKHR{ nullptr };
 	PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructureKHR{ nullptr };
 	PFN_vkDestroyAccelerationStructureKHR vkDestroyAccelerationStructureKHR{ nullptr };
+	PFN_vkCmdDrawMeshTasksEXT vkCmdDrawMeshTasksEXT{ nullptr }; // only loaded when meshShaderSupported
+
+	bool meshShaderSupported = false; // VK_EXT_mesh_shader is enabled with task and mesh shaders
+	bool textureCompressionBC = false; // BC1 to BC7 images can be sampled
+	bool textureUpdateAfterBind = false; // sampled image arrays can be written while command buffers using other elements are pending
+	bool fragmentStoresAndAtomics = false; // fragment shaders may write storage buffers, texture feedback is recorded there
 
 	UnkDevice();
 
@@ -51,6 +57,9 @@ public:
 
 	uint32_t getQueueFamilyIndex(VkQueueFlags queueFlags) const;
 
+	// distinct families of the graphics, compute and transfer queues, for resources shared between them
+	vector<uint32_t> getConcurrentQueueFamilies() const;
+
 	VkQueue getQueue(uint32_t index);
 
 	void createAllocator(VkInstance instance);
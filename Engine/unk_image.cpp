@@ -1,19 +1,145 @@
 #include "unk_image.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
 unordered_map<UnkImage*, uint32_t> UnkImage::imageMap;
 
-UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, void* data)
+/*
+* Uploads the pixels and, when asked, the full mip chain
+* Levels are blitted from level 0 in the upload command buffer when the format can be linearly filtered,
+* otherwise they are box filtered on the cpu and copied with level 0
+*/
+UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, void* data, bool mipmaps)
 {
 	this->device = device;
 	this->size = width * height * 4;
 	this->width = width;
 	this->height = height;
 	this->format = format;
+	this->mipLevels = mipmaps ? getMipLevelCount(width, height) : 1;
+
+	bool blit = false;
+	if (mipLevels > 1)
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(device->gpu, format, &formatProperties);
+
+		VkFormatFeatureFlags features = tiling == VK_IMAGE_TILING_OPTIMAL ? formatProperties.optimalTilingFeatures : formatProperties.linearTilingFeatures;
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		blit = (features & required) == required;
+	}
+
+	// level 0, followed by the cpu filtered levels when they can not be blitted
+	vector<uint8_t> pixels(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+	vector<VkBufferImageCopy> regions;
+
+	uint32_t levelWidth = width;
+	uint32_t levelHeight = height;
+	VkDeviceSize levelOffset = 0;
+
+	for (uint32_t level = 0; level < (blit ? 1 : mipLevels); level++)
+	{
+		if (level > 0)
+		{
+			uint32_t nextWidth = std::max(levelWidth / 2, 1u);
+			uint32_t nextHeight = std::max(levelHeight / 2, 1u);
+			VkDeviceSize nextOffset = pixels.size();
+
+			pixels.resize(nextOffset + nextWidth * nextHeight * 4);
+			downsample(pixels.data() + levelOffset, levelWidth, levelHeight, pixels.data() + nextOffset, format == VK_FORMAT_R8G8B8A8_SRGB);
+
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+			levelOffset = nextOffset;
+		}
+
+		regions.push_back(VkBufferImageCopy
+		{
+			.bufferOffset = levelOffset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource =
+			{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = level,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = {0, 0, 0},
+			.imageExtent =
+			{
+				levelWidth,
+				levelHeight,
+				1
+			}
+		});
+	}
+
+	upload(pixels.size(), [&](void* staging) { memcpy(staging, pixels.data(), pixels.size()); }, regions, tiling, usage, blit, view);
+}
+
+/*
+* Uploads an already encoded mip chain, block compressed formats included
+* The levels are packed from the full size down, levelOffsets gives where each starts
+*/
+UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, bool view, const void* data, VkDeviceSize size, const vector<VkDeviceSize>& levelOffsets)
+	: UnkImage(device, width, height, format, usage, view, size, levelOffsets, [&](void* staging) { memcpy(staging, data, size); })
+{
+}
+
+/*
+* As above, but fill writes the levels straight into the mapped staging buffer so they can be read from disk without a copy
+* Levels may be in any order within the size bytes
+*/
+UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, bool view, VkDeviceSize size, const vector<VkDeviceSize>& levelOffsets, const function<void(void*)>& fill)
+{
+	this->device = device;
+	this->size = size;
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	this->mipLevels = static_cast<uint32_t>(levelOffsets.size());
+
+	vector<VkBufferImageCopy> regions;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		regions.push_back(VkBufferImageCopy
+		{
+			.bufferOffset = levelOffsets[level],
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource =
+			{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = level,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = {0, 0, 0},
+			.imageExtent =
+			{
+				std::max(width >> level, 1u),
+				std::max(height >> level, 1u),
+				1
+			}
+		});
+	}
 
+	upload(size, fill, regions, VK_IMAGE_TILING_OPTIMAL, usage, false, view);
+}
+
+/*
+* Creates the image and copies the regions into it in a single submission, blitting the remaining levels if asked
+*/
+void UnkImage::upload(VkDeviceSize dataSize, const function<void(void*)>& fill, const vector<VkBufferImageCopy>& regions, VkImageTiling tiling, VkImageUsageFlags usage, bool blit, bool view)
+{
 	UnkBuffer* stagingBuffer = new UnkBuffer
 	(
 		device,
-		size,
+		dataSize,
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
@@ -37,11 +163,11 @@ UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat
 			.height = height,
 			.depth = 1
 		},
-		.mipLevels = 1,
+		.mipLevels = mipLevels,
 		.arrayLayers = 1,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 		.tiling = tiling,
-		.usage = usage,
+		.usage = usage | (blit ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0u),
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 	};
@@ -50,40 +176,28 @@ UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat
 	{
 		throw runtime_error("failed to create image");
 	}
-	memcpy(stagingBuffer->base.pMappedData, data, size);
-
-	transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	fill(stagingBuffer->base.pMappedData);
 
+	// copy, blits and transitions go in one submission
 	UnkCommandBuffer* commandBuffer = new UnkCommandBuffer(device, UnkCommandBuffer::GRAPHICS, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-	VkBufferImageCopy region
-	{
-		.bufferOffset = 0,
-		.bufferRowLength = 0,
-		.bufferImageHeight = 0,
-		.imageSubresource =
-		{
-			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.mipLevel = 0,
-			.baseArrayLayer = 0,
-			.layerCount = 1
-		},
-		.imageOffset = {0, 0, 0},
-		.imageExtent =
-		{
-			width,
-			height,
-			1
-		}
-	};
+	transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandBuffer);
 
-	vkCmdCopyBufferToImage(commandBuffer->handle, stagingBuffer->handle, this->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	vkCmdCopyBufferToImage(commandBuffer->handle, stagingBuffer->handle, this->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+	if (blit)
+	{
+		generateMipmaps(commandBuffer);
+	}
+	else
+	{
+		transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, commandBuffer);
+	}
 
 	commandBuffer->endCommand(true);
 
 	delete commandBuffer;
-
-	transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	delete stagingBuffer;
 
 	UnkImage::imageMap[this] = 1;
 
@@ -100,7 +214,7 @@ UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat
 		{
 			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 			.baseMipLevel = 0,
-			.levelCount = 1,
+			.levelCount = mipLevels,
 			.baseArrayLayer = 0,
 			.layerCount = 1
 		}
@@ -110,8 +224,6 @@ UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat
 	{
 		throw runtime_error("failed to create image view");
 	}
-
-	delete stagingBuffer;
 }
 
 UnkImage::UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, VkImageAspectFlags aspectMask)
@@ -228,7 +340,7 @@ void UnkImage::transitionImageLayout(VkImageAspectFlags aspect, VkImageLayout ol
 		{
 			.aspectMask = aspect,
 			.baseMipLevel = 0,
-			.levelCount = 1,
+			.levelCount = mipLevels,
 			.baseArrayLayer = 0,
 			.layerCount = 1,
 		},
@@ -275,7 +387,14 @@ void UnkImage::transitionImageLayout(VkImageAspectFlags aspect, VkImageLayout ol
 		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+		destinationStage = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_GENERAL && newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+	{
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		sourceStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 	}
 
 	if (commandBuffer == nullptr)
@@ -294,6 +413,144 @@ void UnkImage::transitionImageLayout(VkImageAspectFlags aspect, VkImageLayout ol
 	}
 }
 
+uint32_t UnkImage::getMipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+	{
+		levels++;
+	}
+	return levels;
+}
+
+/*
+* Blits each level from the one above it, level 0 must hold the pixels in TRANSFER_DST_OPTIMAL
+* Every level ends up SHADER_READ_ONLY_OPTIMAL
+*/
+void UnkImage::generateMipmaps(UnkCommandBuffer* commandBuffer)
+{
+	VkImageMemoryBarrier barrier
+	{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = handle,
+		.subresourceRange =
+		{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		}
+	};
+
+	int32_t levelWidth = static_cast<int32_t>(width);
+	int32_t levelHeight = static_cast<int32_t>(height);
+
+	for (uint32_t level = 1; level < mipLevels; level++)
+	{
+		// the level above becomes the blit source
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t nextWidth = std::max(levelWidth / 2, 1);
+		int32_t nextHeight = std::max(levelHeight / 2, 1);
+
+		VkImageBlit blit
+		{
+			.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 },
+			.srcOffsets = { { 0, 0, 0 }, { levelWidth, levelHeight, 1 } },
+			.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+			.dstOffsets = { { 0, 0, 0 }, { nextWidth, nextHeight, 1 } }
+		};
+		vkCmdBlitImage(commandBuffer->handle, handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		// the source is done with
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	// the last level was only written
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer->handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/*
+* 2x2 box filter of an rgba8 level into the next, odd edges repeat their last texel
+* sRGB colour is averaged in linear space so minified textures do not darken
+*/
+void UnkImage::downsample(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* target, bool srgb)
+{
+	static array<float, 256> toLinear = []()
+	{
+		array<float, 256> table{};
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			table[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		return table;
+	}();
+
+	auto toSrgb = [](float c)
+	{
+		c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+	};
+
+	uint32_t targetWidth = std::max(width / 2, 1u);
+	uint32_t targetHeight = std::max(height / 2, 1u);
+
+	for (uint32_t y = 0; y < targetHeight; y++)
+	{
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+		for (uint32_t x = 0; x < targetWidth; x++)
+		{
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+			const uint8_t* texels[4] =
+			{
+				source + (y0 * width + x0) * 4,
+				source + (y0 * width + x1) * 4,
+				source + (y1 * width + x0) * 4,
+				source + (y1 * width + x1) * 4
+			};
+
+			uint8_t* out = target + (y * targetWidth + x) * 4;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				// alpha is always linear
+				if (srgb && c < 3)
+				{
+					float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]];
+					out[c] = toSrgb(0.25f * sum);
+				}
+				else
+				{
+					out[c] = static_cast<uint8_t>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
 UnkImage::~UnkImage()
 {
 	if (view != VK_NULL_HANDLE)
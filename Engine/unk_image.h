@@ -8,7 +8,9 @@
 #include "vk_mem_alloc.h"
 #include <vulkan/vulkan.h>
 
+#include <functional>
 #include <unordered_map>
+#include <vector>
 
 
 class UnkImage
@@ -25,13 +27,18 @@ public:
 	uint32_t width;
 	uint32_t height;
 	VkFormat format{};
+	uint32_t mipLevels = 1;
 
 	VmaAllocation allocation;
 	VmaAllocationInfo info;
 
 	static unordered_map<UnkImage*, uint32_t> imageMap;
 
-	UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, void* data);
+	UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, void* data, bool mipmaps = false);
+
+	UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, bool view, const void* data, VkDeviceSize size, const vector<VkDeviceSize>& levelOffsets);
+
+	UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, bool view, VkDeviceSize size, const vector<VkDeviceSize>& levelOffsets, const function<void(void*)>& fill);
 
 	UnkImage(UnkDevice* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, bool view, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -40,4 +47,15 @@ public:
 	~UnkImage();
 
 	void transitionImageLayout(VkImageAspectFlags  aspect, VkImageLayout oldLayout, VkImageLayout newLayout, UnkCommandBuffer* commandBuffer = nullptr);
+
+	// levels down to 1x1
+	static uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+	// 2x2 box filter of an rgba8 level into the next
+	static void downsample(const uint8_t* source, uint32_t width, uint32_t height, uint8_t* target, bool srgb);
+
+private:
+	void upload(VkDeviceSize dataSize, const function<void(void*)>& fill, const vector<VkBufferImageCopy>& regions, VkImageTiling tiling, VkImageUsageFlags usage, bool blit, bool view);
+
+	void generateMipmaps(UnkCommandBuffer* commandBuffer);
 };
\ No newline at end of file
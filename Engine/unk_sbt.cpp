@@ -0,0 +1,155 @@
+#include "unk_sbt.h"
+
+#include <cstring>
+#include <stdexcept>
+
+static inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a)
+{
+	return (v + a - 1) & ~(a - 1);
+}
+
+UnkSbt::UnkSbt(UnkDevice* device)
+{
+	this->device = device;
+
+	VkPhysicalDeviceRayTracingPipelinePropertiesKHR props
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR
+	};
+
+	VkPhysicalDeviceProperties2 props2
+	{
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		&props
+	};
+	vkGetPhysicalDeviceProperties2(device->gpu, &props2);
+
+	handleSize = props.shaderGroupHandleSize;
+	handleAlign = props.shaderGroupHandleAlignment;
+	baseAlign = props.shaderGroupBaseAlignment;
+	maxStride = props.maxShaderGroupStride;
+}
+
+void UnkSbt::addRaygen(uint32_t group)
+{
+	// the raygen region holds exactly one record
+	raygenRecords = { { group } };
+}
+
+uint32_t UnkSbt::addMiss(uint32_t group)
+{
+	missRecords.push_back({ group });
+	return static_cast<uint32_t>(missRecords.size() - 1);
+}
+
+/*
+* Returns the index of the record, the value instances use as their sbt offset
+*/
+uint32_t UnkSbt::addHit(uint32_t group, const void* data, uint32_t dataSize)
+{
+	Record record{ group };
+	if (data != nullptr)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		record.data.assign(bytes, bytes + dataSize);
+	}
+
+	hitRecords.push_back(record);
+	return static_cast<uint32_t>(hitRecords.size() - 1);
+}
+
+VkDeviceSize UnkSbt::getStride(const vector<Record>& records)
+{
+	size_t dataSize = 0;
+	for (auto& record : records)
+	{
+		dataSize = std::max(dataSize, record.data.size());
+	}
+
+	VkDeviceSize stride = alignUp(handleSize + dataSize, handleAlign);
+	if (stride > maxStride) throw runtime_error("shader record exceeds the maximum shader group stride");
+
+	return stride;
+}
+
+/*
+* Uploads all records, the regions are valid until the next build or clear
+*/
+void UnkSbt::build(VkPipeline pipeline, uint32_t groupCount)
+{
+	vector<uint8_t> handles(groupCount * handleSize);
+	VK_CHECK(device->vkGetRayTracingShaderGroupHandlesKHR(device->device, pipeline, 0, groupCount, handles.size(), handles.data()));
+
+	VkDeviceSize raygenStride = getStride(raygenRecords);
+	VkDeviceSize missStride = getStride(missRecords);
+	VkDeviceSize hitStride = getStride(hitRecords);
+
+	// raygen stride must equal its size
+	VkDeviceSize raygenSize = alignUp(raygenStride, baseAlign);
+	VkDeviceSize missSize = missStride * missRecords.size();
+	VkDeviceSize hitSize = hitStride * hitRecords.size();
+
+	VkDeviceSize raygenOffset = 0;
+	VkDeviceSize missOffset = alignUp(raygenOffset + raygenSize, baseAlign);
+	VkDeviceSize hitOffset = alignUp(missOffset + missSize, baseAlign);
+	VkDeviceSize size = std::max<VkDeviceSize>(hitOffset + hitSize, 1);
+
+	vector<uint8_t> blob(size, 0);
+	auto put = [&](const vector<Record>& records, VkDeviceSize offset, VkDeviceSize stride)
+		{
+			for (size_t i = 0; i < records.size(); i++)
+			{
+				if (records[i].group >= groupCount) throw runtime_error("shader record references a missing group");
+
+				uint8_t* dst = blob.data() + offset + i * stride;
+				memcpy(dst, handles.data() + records[i].group * handleSize, handleSize);
+
+				if (!records[i].data.empty())
+				{
+					memcpy(dst + handleSize, records[i].data.data(), records[i].data.size());
+				}
+			}
+		};
+	put(raygenRecords, raygenOffset, raygenStride);
+	put(missRecords, missOffset, missStride);
+	put(hitRecords, hitOffset, hitStride);
+
+	delete buffer;
+	buffer = new UnkBuffer
+	(
+		device,
+		size,
+		VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		0,
+		0,
+		blob.data()
+	);
+
+	VkBufferDeviceAddressInfo addressInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+		.buffer = buffer->handle
+	};
+	const VkDeviceAddress base = device->vkGetBufferDeviceAddressKHR(device->device, &addressInfo);
+
+	raygen = { base + raygenOffset, raygenSize, raygenSize };
+	miss = { base + missOffset, missStride, missSize };
+	hit = { base + hitOffset, hitStride, hitSize };
+	callable = { 0, 0, 0 };
+}
+
+/*
+* Drops all records, the buffer stays alive until the next build
+*/
+void UnkSbt::clear()
+{
+	raygenRecords.clear();
+	missRecords.clear();
+	hitRecords.clear();
+}
+
+UnkSbt::~UnkSbt()
+{
+	delete buffer;
+}
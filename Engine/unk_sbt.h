@@ -0,0 +1,57 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_buffer.h"
+#include "utils.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+using namespace std;
+
+/*
+* Shader binding table built from a list of records per region, each record is a group handle followed by inline data
+* Records of a region share the stride of the largest one, hit records are indexed by the sbt offset of an instance
+*/
+class UnkSbt
+{
+public:
+	UnkDevice* device;
+	UnkBuffer* buffer = nullptr;
+
+	uint32_t handleSize = 0;
+	uint32_t handleAlign = 0;
+	uint32_t baseAlign = 0;
+	uint32_t maxStride = 0;
+
+	VkStridedDeviceAddressRegionKHR raygen{}, miss{}, hit{}, callable{};
+
+	UnkSbt(UnkDevice* device);
+
+	~UnkSbt();
+
+	void addRaygen(uint32_t group);
+
+	uint32_t addMiss(uint32_t group);
+
+	uint32_t addHit(uint32_t group, const void* data = nullptr, uint32_t dataSize = 0);
+
+	uint32_t getHitCount() const { return static_cast<uint32_t>(hitRecords.size()); }
+
+	void build(VkPipeline pipeline, uint32_t groupCount);
+
+	void clear();
+
+private:
+	struct Record
+	{
+		uint32_t group;
+		vector<uint8_t> data;
+	};
+
+	vector<Record> raygenRecords;
+	vector<Record> missRecords;
+	vector<Record> hitRecords;
+
+	VkDeviceSize getStride(const vector<Record>& records);
+};
@@ -39,6 +39,20 @@ void UnkSwapchain::createSwapchain()
 		}
 	}
 
+	// check if images can be written as storage images (formatless, as swapchain formats are often BGRA)
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(device->gpu, surfaceFormat.format, &formatProperties);
+	storageSupported =
+		(surfaceProperties.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) &&
+		(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) &&
+		device->features.shaderStorageImageWriteWithoutFormat;
+
+	VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (storageSupported)
+	{
+		imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
 	// find best present mode (vsync)
 	uint32_t presentModeCount;
 	vector<VkPresentModeKHR> presentModes;
@@ -115,7 +129,7 @@ void UnkSwapchain::createSwapchain()
 		.imageColorSpace = surfaceFormat.colorSpace,
 		.imageExtent = extent,
 		.imageArrayLayers = 1,
-		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.imageUsage = imageUsage,
 		.imageSharingMode = imageSharingMode,
 		.queueFamilyIndexCount = static_cast<uint32_t>(queueSet.size()),
 		.pQueueFamilyIndices = queueIndices.data(),
@@ -37,6 +37,7 @@ public:
 	VkPresentModeKHR presentMode{};
 	VkExtent2D extent{};
 	VkSurfaceCapabilitiesKHR surfaceProperties{};
+	bool storageSupported = false; // images can be written directly by compute shaders
 
 	UnkSwapchain();
 
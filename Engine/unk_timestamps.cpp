@@ -0,0 +1,76 @@
+#include "unk_timestamps.h"
+
+UnkTimestamps::UnkTimestamps(UnkDevice* device, uint32_t pairCount)
+{
+	this->device = device;
+	this->pairCount = pairCount;
+
+	period = device->properties.limits.timestampPeriod;
+	supported = device->queueFamilyProperties[device->queues.graphics].timestampValidBits > 0 && period > 0.0f;
+	written.resize(pairCount, false);
+
+	if (!supported) return;
+
+	VkQueryPoolCreateInfo queryPoolInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 2 * pairCount
+	};
+	VK_CHECK(vkCreateQueryPool(device->device, &queryPoolInfo, nullptr, &queryPool));
+}
+
+void UnkTimestamps::begin(UnkCommandBuffer* commandBuffer, uint32_t pair, VkPipelineStageFlagBits stage)
+{
+	if (!supported) return;
+
+	vkCmdResetQueryPool(commandBuffer->handle, queryPool, 2 * pair, 2);
+	vkCmdWriteTimestamp(commandBuffer->handle, stage, queryPool, 2 * pair);
+}
+
+void UnkTimestamps::end(UnkCommandBuffer* commandBuffer, uint32_t pair, VkPipelineStageFlagBits stage)
+{
+	if (!supported) return;
+
+	vkCmdWriteTimestamp(commandBuffer->handle, stage, queryPool, 2 * pair + 1);
+	written[pair] = true;
+}
+
+/*
+* Returns false if the pair was not written since the last read or its results are not available yet
+*/
+bool UnkTimestamps::getMilliseconds(uint32_t pair, float* milliseconds)
+{
+	if (!supported || !written[pair]) return false;
+
+	// timestamp and availability for each query
+	uint64_t results[4];
+	VkResult res = vkGetQueryPoolResults
+	(
+		device->device,
+		queryPool,
+		2 * pair,
+		2,
+		sizeof(results),
+		results,
+		2 * sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+	);
+
+	if (res != VK_SUCCESS || results[1] == 0 || results[3] == 0)
+	{
+		return false;
+	}
+
+	*milliseconds = static_cast<float>(results[2] - results[0]) * period / 1000000.0f;
+	written[pair] = false;
+	return true;
+}
+
+UnkTimestamps::~UnkTimestamps()
+{
+	if (queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(device->device, queryPool, nullptr);
+	}
+}
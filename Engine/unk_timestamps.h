@@ -0,0 +1,34 @@
+#pragma once
+
+#include "unk_device.h"
+#include "unk_command_buffer.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+/*
+* Pairs of GPU timestamps, one pair per frame in flight
+* Results are read back without waiting, a pair is only reported once both queries are available
+*/
+class UnkTimestamps
+{
+public:
+	UnkDevice* device;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+
+	uint32_t pairCount;
+	float period; // nanoseconds per tick
+	bool supported = false;
+
+	vector<bool> written;
+
+	UnkTimestamps(UnkDevice* device, uint32_t pairCount);
+
+	~UnkTimestamps();
+
+	void begin(UnkCommandBuffer* commandBuffer, uint32_t pair, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+	void end(UnkCommandBuffer* commandBuffer, uint32_t pair, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	bool getMilliseconds(uint32_t pair, float* milliseconds);
+};
@@ -1,6 +1,10 @@
 #include "unk_tlas.h"
 
-UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& instances, vector<MVP>& transforms, vector<UnkBlas*>& blasses)
+/*
+* Records the build into the given command buffer, instance and scratch memory is kept alive until releaseScratch is called
+* once the command buffer has finished executing
+*/
+UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& instances, vector<MVP>& transforms, vector<UnkBlas*>& blasses, UnkCommandBuffer* commandBuffer)
 {
 	this->device = device;
 
@@ -18,8 +22,8 @@ UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& inst
 			{
 				.transform = toVkTransform(matrix),
 				.instanceCustomIndex = instIndex,
-				.mask = 0xFF,
-				.instanceShaderBindingTableRecordOffset = 0,
+				.mask = meshes[i].getInstanceMask(),
+				.instanceShaderBindingTableRecordOffset = static_cast<uint32_t>(i), // one hit record per mesh
 				.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
 				.accelerationStructureReference = blasses[i]->deviceAddress
 			};
@@ -29,15 +33,16 @@ UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& inst
 
 	const uint32_t instanceCount = asInstances.size();
 
-	UnkBuffer* instanceBuffer = new UnkBuffer
+	// write instances through mapped memory so building never blocks on a staging copy
+	instanceBuffer = new UnkBuffer
 	(
 		device,
-		sizeof(VkAccelerationStructureInstanceKHR) * instanceCount,
+		sizeof(VkAccelerationStructureInstanceKHR) * std::max<uint32_t>(instanceCount, 1),
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		0,
-		asInstances.data()
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT
 	);
+	memcpy(instanceBuffer->base.pMappedData, asInstances.data(), sizeof(VkAccelerationStructureInstanceKHR) * instanceCount);
 
 	// ge instance buffer device address
 	VkBufferDeviceAddressInfoKHR instanceBufferDeviceAI
@@ -87,14 +92,15 @@ UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& inst
 		&accelerationStructureBuildSizesInfo
 	);
 
-	// create top level acceleration structure buffer
+	// create top level acceleration structure buffer, built on the compute queue and traced on the graphics queue
 	tlasBuffer = new UnkBuffer
 	(
 		device,
 		accelerationStructureBuildSizesInfo.accelerationStructureSize,
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		0
+		0,
+		true
 	);
 
 	VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo
@@ -107,7 +113,7 @@ UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& inst
 	device->vkCreateAccelerationStructureKHR(device->device, &accelerationStructureCreateInfo, nullptr, &this->handle);
 
 	// create scratch buffer
-	UnkBuffer* scratchBuffer = new UnkBuffer
+	scratchBuffer = new UnkBuffer
 	(
 		device,
 		accelerationStructureBuildSizesInfo.buildScratchSize,
@@ -149,22 +155,29 @@ UnkTlas::UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& inst
 		}
 	};
 
-	UnkCommandBuffer* commandBuffer = new UnkCommandBuffer(device, UnkCommandBuffer::GRAPHICS, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
 	device->vkCmdBuildAccelerationStructuresKHR(commandBuffer->handle, 1, &buildInfo, accelerationBuildStructureRangeInfos.data());
 
-	commandBuffer->endCommand(true);
-
 	VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo
 	{
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
 		.accelerationStructure = this->handle
 	};
 	this->deviceAddress = device->vkGetAccelerationStructureDeviceAddressKHR(device->device, &accelerationDeviceAddressInfo);
+}
 
-	delete instanceBuffer;
-	delete scratchBuffer;
-	delete commandBuffer;
+void UnkTlas::releaseScratch()
+{
+	if (instanceBuffer != nullptr)
+	{
+		delete instanceBuffer;
+		instanceBuffer = nullptr;
+	}
+
+	if (scratchBuffer != nullptr)
+	{
+		delete scratchBuffer;
+		scratchBuffer = nullptr;
+	}
 }
 
 VkTransformMatrixKHR UnkTlas::toVkTransform(const mat4& m)
@@ -191,6 +204,8 @@ VkTransformMatrixKHR UnkTlas::toVkTransform(const mat4& m)
 
 UnkTlas::~UnkTlas()
 {
+	releaseScratch();
+
 	if (handle != VK_NULL_HANDLE)
 	{
 		device->vkDestroyAccelerationStructureKHR(device->device, handle, nullptr);
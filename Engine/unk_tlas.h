@@ -14,13 +14,17 @@ class UnkTlas
 {
 public:
 	UnkDevice* device;
-	UnkBuffer* tlasBuffer;
+	UnkBuffer* tlasBuffer = nullptr;
+	UnkBuffer* instanceBuffer = nullptr;
+	UnkBuffer* scratchBuffer = nullptr;
 	VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
 	uint64_t deviceAddress = 0;
 
-	UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& instances, vector<MVP>& transforms, vector<UnkBlas*>& blasses);
+	UnkTlas(UnkDevice* device, vector<Mesh>& meshes, vector<Instance>& instances, vector<MVP>& transforms, vector<UnkBlas*>& blasses, UnkCommandBuffer* commandBuffer);
 
 	~UnkTlas();
 
+	void releaseScratch();
+
 	VkTransformMatrixKHR toVkTransform(const mat4& m);
 };
\ No newline at end of file
@@ -0,0 +1,608 @@
+#include "visbuffer.h"
+#include <array>
+
+using namespace std;
+
+enum
+{
+	VIS_INSTANCE_BINDING,
+	VIS_TRANSFORM_BINDING,
+	VIS_POINT_LIGHT_BINDING,
+	VIS_DIR_LIGHT_BINDING,
+	VIS_CAMERA_BINDING,
+	VIS_POSITION_BINDING,
+	VIS_VERTEX_BINDING,
+	VIS_INDEX_BINDING,
+	VIS_VISIBILITY_BINDING,
+	VIS_RESULT_BINDING,
+	VIS_INDEX16_BINDING,
+	VIS_INSTANCE_LOD_BINDING,
+	VIS_FEEDBACK_BINDING,
+	VIS_TEXTURE_SLOT_BINDING,
+	VIS_TEXTURE_BINDING // variable count, must stay last
+};
+
+VisBuffer::VisBuffer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources)
+{
+	this->device = device;
+	this->swapchain = swapchain;
+	this->resources = resources;
+
+	createImages();
+	createDescriptorSets();
+	createRenderPass();
+	createPipeline();
+	createFramebuffer();
+
+	resolver = new Resolver(device, swapchain, resultImage);
+}
+
+void VisBuffer::createImages()
+{
+	visibilityImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R32G32_UINT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		true
+	);
+	visibilityImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	depthImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		findDepthFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT),
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		true,
+		VK_IMAGE_ASPECT_DEPTH_BIT
+	);
+	depthImage->transitionImageLayout(VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+	// hdr radiance, tonemapped and converted to the swapchain format by the resolver
+	resultImage = new UnkImage
+	(
+		device,
+		swapchain->extent.width,
+		swapchain->extent.height,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		true
+	);
+	resultImage->transitionImageLayout(VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void VisBuffer::destroyImages()
+{
+	delete visibilityImage;
+	delete depthImage;
+	delete resultImage;
+
+	visibilityImage = nullptr;
+	depthImage = nullptr;
+	resultImage = nullptr;
+}
+
+void VisBuffer::createDescriptorSets()
+{
+	uint32_t textureCount = resources->textures->capacity;
+
+	vector<VkDescriptorSetLayoutBinding> bindings;
+	vector<VkDescriptorBindingFlags> flags;
+
+	auto add = [&](UnkDescriptor* descriptor)
+		{
+			descriptors.push_back(descriptor);
+			bindings.push_back(descriptor->getLayoutBinding());
+			flags.push_back(descriptor->bindingFlags);
+		};
+
+	// the id pass only transforms vertices, everything else is read by the shading pass
+	add(new UnkBufferDescriptor(resources->instanceBuffer, &descriptorSet, VIS_INSTANCE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->transformBuffer, &descriptorSet, VIS_TRANSFORM_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->pointLightBuffer, &descriptorSet, VIS_POINT_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->dirLightBuffer, &descriptorSet, VIS_DIR_LIGHT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->cameraBuffer, &descriptorSet, VIS_CAMERA_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->positionBuffer, &descriptorSet, VIS_POSITION_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->attributeBuffer, &descriptorSet, VIS_VERTEX_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->indexBuffer, &descriptorSet, VIS_INDEX_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	vector<UnkImage*> visibilityImages{ visibilityImage };
+	add(new UnkImageDescriptor(visibilityImages, &descriptorSet, VIS_VISIBILITY_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+
+	vector<UnkImage*> resultImages{ resultImage };
+	add(new UnkImageDescriptor(resultImages, &descriptorSet, VIS_RESULT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0, VK_IMAGE_LAYOUT_GENERAL));
+
+	add(new UnkBufferDescriptor(resources->index16Buffer, &descriptorSet, VIS_INDEX16_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+	add(new UnkBufferDescriptor(resources->instanceLodBuffer, &descriptorSet, VIS_INSTANCE_LOD_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	add(new UnkBufferDescriptor(resources->textureFeedbackBuffer, &descriptorSet, VIS_FEEDBACK_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	add(new UnkBufferDescriptor(resources->textures->slotBuffer, &descriptorSet, VIS_TEXTURE_SLOT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0));
+
+	// the array itself is written slot by slot by the registry once the set is allocated
+	bindings.push_back(resources->textures->getLayoutBinding(VIS_TEXTURE_BINDING, VK_SHADER_STAGE_COMPUTE_BIT));
+	flags.push_back(resources->textures->getBindingFlags());
+
+	const size_t n = bindings.size();
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+		.bindingCount = static_cast<uint32_t>(n),
+		.pBindingFlags = flags.data(),
+	};
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = &bindingFlags,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+		.bindingCount = static_cast<uint32_t>(bindings.size()),
+		.pBindings = bindings.data()
+	};
+	VK_CHECK(vkCreateDescriptorSetLayout(device->device, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
+
+	vector<VkDescriptorPoolSize> poolSizes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		VkDescriptorPoolSize poolSize
+		{
+			.type = descriptors[i]->descriptorType,
+			.descriptorCount = descriptors[i]->count
+		};
+		poolSizes.push_back(poolSize);
+	}
+	poolSizes.push_back(VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = textureCount });
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+		.maxSets = 1,
+		.poolSizeCount = static_cast<uint32_t>(n),
+		.pPoolSizes = poolSizes.data(),
+	};
+	VK_CHECK(vkCreateDescriptorPool(device->device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+	uint32_t counts[] = { textureCount };
+	VkDescriptorSetVariableDescriptorCountAllocateInfo varCount
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+		.descriptorSetCount = 1,
+		.pDescriptorCounts = counts
+	};
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = &varCount,
+		.descriptorPool = descriptorPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &descriptorSetLayout
+	};
+	VK_CHECK(vkAllocateDescriptorSets(device->device, &descriptorSetAllocateInfo, &descriptorSet));
+
+	// link descriptors to buffer and image handles
+	vector<VkWriteDescriptorSet> writes;
+	for (int i = 0; i < descriptors.size(); i++)
+	{
+		writes.push_back(descriptors[i]->getDescriptorWrite());
+	}
+	vkUpdateDescriptorSets(device->device, writes.size(), writes.data(), 0, nullptr);
+
+	resources->textures->addSet(descriptorSet, VIS_TEXTURE_BINDING);
+}
+
+void VisBuffer::createRenderPass()
+{
+	VkAttachmentDescription visibilityAttachment
+	{
+		.format = VK_FORMAT_R32G32_UINT,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_GENERAL // read as a storage image by the shading pass
+	};
+	VkAttachmentReference visibilityRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+	VkAttachmentDescription depthAttachment
+	{
+		.format = depthImage->format,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+	VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass
+	{
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &visibilityRef,
+		.pDepthStencilAttachment = &depthRef
+	};
+
+	array<VkSubpassDependency, 2> dependencies{};
+
+	// the last frame's shading pass reads the visibility buffer cleared here
+	dependencies[0] =
+	{
+		.srcSubpass = VK_SUBPASS_EXTERNAL,
+		.dstSubpass = 0,
+		.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+	};
+
+	dependencies[1] =
+	{
+		.srcSubpass = 0,
+		.dstSubpass = VK_SUBPASS_EXTERNAL,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+
+	array<VkAttachmentDescription, 2> attachments = { visibilityAttachment, depthAttachment };
+	VkRenderPassCreateInfo renderPassInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = static_cast<uint32_t>(attachments.size()),
+		.pAttachments = attachments.data(),
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = static_cast<uint32_t>(dependencies.size()),
+		.pDependencies = dependencies.data()
+	};
+
+	VK_CHECK(vkCreateRenderPass(device->device, &renderPassInfo, nullptr, &renderPass));
+}
+
+void VisBuffer::createPipeline()
+{
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+	};
+
+	// positions only, attributes are fetched by the shading pass
+	VkVertexInputBindingDescription binding
+	{
+		.binding = 0,
+		.stride = sizeof(vec3),
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+	};
+
+	VkVertexInputAttributeDescription attributeDescription
+	{
+		.location = 0,
+		.binding = 0,
+		.format = VK_FORMAT_R32G32B32_SFLOAT,
+		.offset = 0
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertexInput
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &binding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &attributeDescription
+	};
+
+	// both passes share the layout, the shading pass takes the light counts
+	VkPushConstantRange pushConstant
+	{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PushConstants)
+	};
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstant
+	};
+	VK_CHECK(vkCreatePipelineLayout(device->device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	VkPipelineRasterizationStateCreateInfo rasterizer
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.cullMode = VK_CULL_MODE_NONE,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.depthBiasEnable = VK_FALSE,
+		.lineWidth = 1.0f,
+	};
+
+	VkPipelineColorBlendAttachmentState blendAttachment
+	{
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+	};
+
+	VkPipelineColorBlendStateCreateInfo blend
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &blendAttachment
+	};
+
+	VkPipelineViewportStateCreateInfo viewport
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = VK_TRUE,
+		.depthCompareOp = VK_COMPARE_OP_LESS,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.minDepthBounds = 0.0f,
+		.maxDepthBounds = 1.0f
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisample
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+	};
+
+	array<VkDynamicState, 2> dynamics{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamic
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = static_cast<uint32_t>(dynamics.size()),
+		.pDynamicStates = dynamics.data()
+	};
+
+	array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+
+	shaderStages[0] =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = loadShaderModule("shaders/visbuffer_vert.spv"),
+		.pName = "main"
+	};
+
+	shaderStages[1] =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = loadShaderModule("shaders/visbuffer_frag.spv"),
+		.pName = "main"
+	};
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = static_cast<uint32_t>(shaderStages.size()),
+		.pStages = shaderStages.data(),
+		.pVertexInputState = &vertexInput,
+		.pInputAssemblyState = &inputAssembly,
+		.pViewportState = &viewport,
+		.pRasterizationState = &rasterizer,
+		.pMultisampleState = &multisample,
+		.pDepthStencilState = &depthStencil,
+		.pColorBlendState = &blend,
+		.pDynamicState = &dynamic,
+		.layout = pipelineLayout,
+		.renderPass = renderPass
+	};
+
+	VK_CHECK(vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+	vkDestroyShaderModule(device->device, shaderStages[0].module, nullptr);
+	vkDestroyShaderModule(device->device, shaderStages[1].module, nullptr);
+
+	VkShaderModule shadeModule = loadShaderModule("shaders/visbuffer_shade.spv");
+
+	VkComputePipelineCreateInfo shadePipelineCreateInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage =
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shadeModule,
+			.pName = "main"
+		},
+		.layout = pipelineLayout
+	};
+	VK_CHECK(vkCreateComputePipelines(device->device, VK_NULL_HANDLE, 1, &shadePipelineCreateInfo, nullptr, &shadePipeline));
+
+	vkDestroyShaderModule(device->device, shadeModule, nullptr);
+}
+
+void VisBuffer::createFramebuffer()
+{
+	array<VkImageView, 2> attachments =
+	{
+		visibilityImage->view,
+		depthImage->view
+	};
+
+	VkFramebufferCreateInfo framebufferInfo
+	{
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = renderPass,
+		.attachmentCount = static_cast<uint32_t>(attachments.size()),
+		.pAttachments = attachments.data(),
+		.width = swapchain->extent.width,
+		.height = swapchain->extent.height,
+		.layers = 1
+	};
+
+	VK_CHECK(vkCreateFramebuffer(device->device, &framebufferInfo, nullptr, &framebuffer));
+}
+
+void VisBuffer::handleResize()
+{
+	vkDestroyFramebuffer(device->device, framebuffer, nullptr);
+	destroyImages();
+
+	createImages();
+	createFramebuffer();
+
+	UnkImageDescriptor* visibilityDescriptor = static_cast<UnkImageDescriptor*>(descriptors[VIS_VISIBILITY_BINDING]);
+	visibilityDescriptor->images = { visibilityImage };
+
+	UnkImageDescriptor* resultDescriptor = static_cast<UnkImageDescriptor*>(descriptors[VIS_RESULT_BINDING]);
+	resultDescriptor->images = { resultImage };
+
+	vector<VkWriteDescriptorSet> descriptorWrites{ visibilityDescriptor->getDescriptorWrite(), resultDescriptor->getDescriptorWrite() };
+	vkUpdateDescriptorSets(device->device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+	resolver->handleResize(resultImage);
+}
+
+void VisBuffer::draw(uint32_t index)
+{
+	UnkCommandBuffer* commandBuffer = swapchain->frames[index].commandBuffer;
+	commandBuffer->beginCommand();
+
+	resources->textures->recordSlots(commandBuffer);
+	recordLods(commandBuffer, index);
+
+	// empty texels hold no triangle
+	array<VkClearValue, 2> clearValues{};
+	clearValues[0].color.uint32[0] = UINT32_MAX;
+	clearValues[0].color.uint32[1] = UINT32_MAX;
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassBegin
+	{
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = renderPass,
+		.framebuffer = framebuffer,
+		.renderArea =
+		{
+			.extent = swapchain->extent
+		},
+		.clearValueCount = static_cast<uint32_t>(clearValues.size()),
+		.pClearValues = clearValues.data()
+	};
+
+	vkCmdBeginRenderPass(commandBuffer->handle, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	VkViewport viewport
+	{
+		.width = static_cast<float>(swapchain->extent.width),
+		.height = static_cast<float>(swapchain->extent.height),
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f
+	};
+	vkCmdSetViewport(commandBuffer->handle, 0, 1, &viewport);
+
+	VkRect2D scissor
+	{
+		.extent = swapchain->extent
+	};
+	vkCmdSetScissor(commandBuffer->handle, 0, 1, &scissor);
+
+	VkDeviceSize offset = 0;
+
+	vkCmdBindVertexBuffers(commandBuffer->handle, 0, 1, &resources->positionBuffer->handle, &offset);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+	// culling does not change between groups here, only the index pool does
+	for (const DrawGroup& group : resources->drawGroups)
+	{
+		vkCmdBindIndexBuffer(commandBuffer->handle, resources->getIndexBuffer(group.indexType)->handle, 0, group.indexType);
+		vkCmdDrawIndexedIndirect
+		(
+			commandBuffer->handle,
+			resources->drawCommandBuffer->handle,
+			group.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+			group.drawCount,
+			sizeof(VkDrawIndexedIndirectCommand)
+		);
+	}
+
+	vkCmdEndRenderPass(commandBuffer->handle);
+
+	// shade once per pixel
+	PushConstants constants
+	{
+		.pointLightCount = static_cast<uint32_t>(resources->pointLights.size()),
+		.dirLightCount = static_cast<uint32_t>(resources->dirLights.size())
+	};
+
+	vkCmdBindPipeline(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, shadePipeline);
+	vkCmdBindDescriptorSets(commandBuffer->handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer->handle, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &constants);
+	vkCmdDispatch(commandBuffer->handle, (swapchain->extent.width + 7) / 8, (swapchain->extent.height + 7) / 8, 1);
+
+	resolver->record(commandBuffer, index, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, swapchain->extent);
+
+	commandBuffer->endCommand(false);
+
+	if (swapchain->frames[index].swapchainReleaseSemaphore == VK_NULL_HANDLE)
+	{
+		VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &swapchain->frames[index].swapchainReleaseSemaphore);
+	}
+
+	VkPipelineStageFlags waitStage = resolver->getWaitStage();
+
+	VkSubmitInfo info
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &swapchain->frames[index].swapchainAcquireSemaphore,
+		.pWaitDstStageMask = &waitStage,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer->handle,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &swapchain->frames[index].swapchainReleaseSemaphore
+	};
+	vkQueueSubmit(device->getQueue(device->queues.graphics), 1, &info, swapchain->frames[index].queueSubmitFence);
+}
+
+VisBuffer::~VisBuffer()
+{
+	delete resolver;
+
+	if (framebuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyFramebuffer(device->device, framebuffer, nullptr);
+	}
+
+	destroyImages();
+
+	if (shadePipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(device->device, shadePipeline, nullptr);
+	}
+
+	if (renderPass != VK_NULL_HANDLE)
+	{
+		vkDestroyRenderPass(device->device, renderPass, nullptr);
+	}
+}
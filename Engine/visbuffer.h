@@ -0,0 +1,43 @@
+#pragma once
+#include "pipeline.h"
+#include "resolver.h"
+
+/*
+* Rasterizes only instance and triangle ids into a 64 bit visibility buffer, a compute pass then fetches the
+* vertices of each visible triangle from the vertex and index buffers and shades every pixel exactly once
+*/
+class VisBuffer : public Pipeline
+{
+public:
+	VkRenderPass renderPass{ VK_NULL_HANDLE };
+	VkFramebuffer framebuffer{ VK_NULL_HANDLE };
+
+	UnkImage* visibilityImage = nullptr; // rg32ui, instance record index and triangle index
+	UnkImage* depthImage = nullptr;
+	UnkImage* resultImage = nullptr;
+	Resolver* resolver = nullptr;
+
+	VkPipeline shadePipeline = VK_NULL_HANDLE;
+
+	VisBuffer() = default;
+
+	VisBuffer(UnkDevice* device, UnkSwapchain* swapchain, DeviceResources* resources);
+
+	~VisBuffer() override;
+
+	void createImages();
+
+	void destroyImages();
+
+	void createRenderPass();
+
+	void createPipeline();
+
+	void createDescriptorSets();
+
+	void createFramebuffer();
+
+	void handleResize();
+
+	void draw(uint32_t imageIndex);
+};